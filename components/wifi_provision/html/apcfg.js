@@ -0,0 +1,289 @@
+var gateway = `ws://${window.location.hostname}/ws`;
+var websocket;
+let scanTimeId;
+let connectTimeId;  // 连接超时计时器（每收到一次连接进度重新计时）
+let scanResults = {};  // 本次扫描已收到的热点（按SSID去重，保留信号最强的）
+let channelSwitching = false;  // 设备通知热点即将切换信道，连接中断是预期的
+let statusQueried = false;     // 切换信道重连后查询过连接结果
+
+window.addEventListener('load', onLoad);
+
+function onLoad(event) {
+    initWebSocket();
+}
+
+function initWebSocket() {
+    console.log('Connecting to WebSocket...');
+    updateConnectionStatus(false, '正在连接设备...');
+    websocket = new WebSocket(gateway);
+    websocket.onopen = onOpen;
+    websocket.onclose = onClose;
+    websocket.onmessage = onMessage;
+}
+
+function onOpen(event) {
+    console.log('WebSocket connected');
+    updateConnectionStatus(true, '设备已连接');
+    if (channelSwitching) {
+        // 切换信道期间可能错过了连接结果，主动查询一次
+        channelSwitching = false;
+        statusQueried = true;
+        websocket.send(JSON.stringify({ cmd: 'status' }));
+    }
+}
+
+function onClose(event) {
+    console.log('WebSocket closed');
+    if (channelSwitching) {
+        // 热点切换信道造成的短暂中断：保留连接超时计时，尽快重连
+        updateConnectionStatus(false, '设备切换信道中，重连中...');
+        setTimeout(initWebSocket, 500);
+        return;
+    }
+    updateConnectionStatus(false, '连接断开，重连中...');
+    // 清除连接超时计时器
+    clearTimeout(connectTimeId);
+    setTimeout(initWebSocket, 3000);
+}
+
+function updateConnectionStatus(connected, text) {
+    const dot = document.getElementById('ws-status');
+    const textEl = document.getElementById('ws-text');
+    dot.className = connected ? 'status-dot connected' : 'status-dot';
+    textEl.textContent = text;
+}
+
+function onMessage(event) {
+    const data = JSON.parse(event.data);
+    console.log('Received:', data);
+
+    // 处理WiFi列表（渐进式扫描会分多批到达，没有done字段时视为一次性结果）
+    if (data.wifi_list) {
+        handleWifiList(data.wifi_list, data.batch || 0, data.done !== false, !!data.top);
+    }
+
+    // 连接进度（认证中/等待IP/重试）
+    if (data.progress) {
+        handleConnectProgress(data);
+    }
+
+    // 处理连接状态
+    if (data.status) {
+        handleConnectStatus(data);
+    }
+
+    // 热点即将切换到路由器所在的信道
+    if (data.channel_switch) {
+        channelSwitching = true;
+        showStatus(`设备正在切换到信道 ${data.channel_switch}，连接可能短暂中断...`, 'success');
+    }
+
+    // 切换信道重连后查询到的状态
+    if (statusQueried && data.state) {
+        statusQueried = false;
+        if (data.state === 'connected' && data.ip) {
+            handleConnectStatus({ status: 'connected', ssid: data.ssid, ip: data.ip });
+        }
+    }
+
+    // 配网耗时时间线（固件开启CONFIG_WIFI_PROVISION_TRACE_PUSH时推送）
+    if (data.timeline) {
+        console.table(data.timeline.map(e => ({ event: e.ev, ms: e.t })));
+    }
+}
+
+function handleWifiList(wifiList, batch, done, snapshot) {
+    const container = document.getElementById('wifi-list-container');
+    const listEl = document.getElementById('wifi-list');
+    const btn = document.getElementById('scan-btn');
+
+    // 第一批到达时清空上一次的结果
+    if (batch === 0) {
+        scanResults = {};
+    }
+
+    let sortedList;
+    if (snapshot) {
+        // 设备已去重并排好序，每批都是完整列表
+        sortedList = wifiList;
+    } else {
+        // 合并本批结果（同名SSID只保留信号最强的）
+        wifiList.forEach(wifi => {
+            if (!scanResults[wifi.ssid] || scanResults[wifi.ssid].rssi < wifi.rssi) {
+                scanResults[wifi.ssid] = wifi;
+            }
+        });
+        sortedList = Object.values(scanResults).sort((a, b) => b.rssi - a.rssi);
+    }
+
+    listEl.innerHTML = '';
+    sortedList.forEach(wifi => {
+        const item = document.createElement('div');
+        item.className = 'wifi-item';
+        item.innerHTML = `
+            <div class="wifi-info">
+                <span>${wifi.encrypted ? '🔒' : '🌐'}</span>
+                <span class="name">${wifi.ssid}</span>
+            </div>
+            <div class="wifi-meta">
+                <span class="${getSignalClass(wifi.rssi)}">${getSignalIcon(wifi.rssi)}</span>
+                <span>${wifi.rssi}dBm</span>
+            </div>
+        `;
+
+        item.addEventListener('click', () => {
+            document.getElementById('ssid').value = wifi.ssid;
+            document.getElementById('password').focus();
+            // 高亮选中项
+            document.querySelectorAll('.wifi-item').forEach(el => el.style.background = '');
+            item.style.background = '#e3f2fd';
+        });
+
+        listEl.appendChild(item);
+    });
+
+    // 第一批结果到达就显示列表，用户可以提前选择网络
+    container.classList.add('show');
+    hideLoading();
+
+    if (!done) {
+        showStatus(`扫描中，已发现 ${sortedList.length} 个网络...`, 'success');
+        return;
+    }
+
+    clearTimeout(scanTimeId);
+    btn.disabled = false;
+    btn.innerHTML = '<span>🔄</span><span>重新扫描</span>';
+    showStatus(`扫描完成，发现 ${sortedList.length} 个网络`, 'success');
+}
+
+// 连接失败的环节对应的提示
+const STAGE_HINTS = {
+    scan: '找不到该网络，请确认名称和距离',
+    auth: '认证被拒绝，请检查密码',
+    assoc: '路由器拒绝接入（可能客户端已满）',
+    handshake: '密码错误',
+    link: '连接中断',
+};
+
+function startConnectTimeout(ms) {
+    const btn = document.getElementById('submit-btn');
+    clearTimeout(connectTimeId);
+    connectTimeId = setTimeout(() => {
+        hideLoading();
+        btn.disabled = false;
+        btn.innerHTML = '<span>🚀</span><span>重新配网</span>';
+        showStatus('连接超时，请重试', 'error');
+    }, ms);
+}
+
+function handleConnectProgress(data) {
+    let text;
+    if (data.progress === 'auth') {
+        text = data.retry > 0 ? `正在重新连接 "${data.ssid}"（第${data.retry}次重试）...` : `正在认证 "${data.ssid}"...`;
+    } else if (data.progress === 'dhcp') {
+        text = `已接入 "${data.ssid}"，正在获取IP...`;
+    } else if (data.progress === 'retry') {
+        text = `${STAGE_HINTS[data.stage] || '连接中断'}（原因 ${data.reason}），稍后重试...`;
+    } else {
+        return;
+    }
+    showLoading(text);
+    // 设备还在推进，说明没有卡住：每一步后重新计时
+    startConnectTimeout(15000);
+}
+
+function handleConnectStatus(data) {
+    channelSwitching = false;
+    // 清除连接超时计时器
+    clearTimeout(connectTimeId);
+    hideLoading();
+
+    const btn = document.getElementById('submit-btn');
+
+    if (data.status === 'connected') {
+        // 确认收到，设备随即关闭热点（不等固定延时）
+        websocket.send(JSON.stringify({ cmd: 'ack', status: 'connected' }));
+        showStatus(`✓ 已连接到 "${data.ssid}"，IP: ${data.ip}`, 'success');
+        btn.disabled = true;
+        btn.innerHTML = '<span>✓</span><span>连接成功</span>';
+        updateConnectionStatus(true, '配网成功');
+    } else if (data.status === 'failed') {
+        const hint = STAGE_HINTS[data.stage] || '请检查密码后重试';
+        showStatus(`✗ 连接 "${data.ssid}" 失败：${hint}`, 'error');
+        btn.disabled = false;
+        btn.innerHTML = '<span>🚀</span><span>重新配网</span>';
+        // 清空密码框，聚焦以便重新输入
+        document.getElementById('password').value = '';
+        document.getElementById('password').focus();
+    }
+}
+
+// 扫描按钮
+document.getElementById('scan-btn').addEventListener('click', function () {
+    const btn = this;
+    const listEl = document.getElementById('wifi-list');
+
+    btn.disabled = true;
+    btn.innerHTML = '<span>⏳</span><span>扫描中...</span>';
+    listEl.innerHTML = '';
+    showLoading('正在扫描WiFi网络...');
+
+    websocket.send(JSON.stringify({ cmd: 'scan' }));
+
+    scanTimeId = setTimeout(() => {
+        btn.innerHTML = '<span>📡</span><span>重新扫描</span>';
+        btn.disabled = false;
+        hideLoading();
+        showStatus('扫描超时，请重试', 'error');
+    }, 15000);
+});
+
+// 配网按钮
+document.getElementById('submit-btn').addEventListener('click', function () {
+    const ssid = document.getElementById('ssid').value.trim();
+    const password = document.getElementById('password').value;
+
+    if (!ssid) {
+        showStatus('请输入或选择WiFi名称', 'error');
+        return;
+    }
+
+    // 连接过程中按钮保持可用：发现密码输错可以直接改了重新提交，设备会取代正在进行的连接
+    this.innerHTML = '<span>⏳</span><span>连接中，可修改后重新提交</span>';
+    showLoading(`正在连接 "${ssid}"...`);
+    showStatus('', '');
+
+    websocket.send(JSON.stringify({ cmd: 'connect', ssid, password }));
+
+    // 设置连接超时（15秒，收到连接进度后重新计时）
+    startConnectTimeout(15000);
+});
+
+function showLoading(text) {
+    document.getElementById('loading-text').textContent = text;
+    document.getElementById('loading').classList.add('show');
+}
+
+function hideLoading() {
+    document.getElementById('loading').classList.remove('show');
+}
+
+function showStatus(message, type) {
+    const el = document.getElementById('status');
+    el.textContent = message;
+    el.className = 'status ' + type;
+}
+
+function getSignalIcon(rssi) {
+    if (rssi >= -50) return '●●●●';
+    if (rssi >= -65) return '●●●○';
+    if (rssi >= -75) return '●●○○';
+    return '●○○○';
+}
+
+function getSignalClass(rssi) {
+    if (rssi >= -50) return 'signal-strong';
+    if (rssi >= -70) return 'signal-medium';
+    return 'signal-weak';
+}
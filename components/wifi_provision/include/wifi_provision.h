@@ -2,6 +2,9 @@
 #define WIFI_PROVISION_H
 
 #include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * @brief WiFi 状态枚举
@@ -9,20 +12,142 @@
 typedef enum {
     WIFI_PROVISION_STATE_CONNECTED,    // WiFi连接成功并获取IP
     WIFI_PROVISION_STATE_DISCONNECTED, // WiFi断开连接
-    WIFI_PROVISION_STATE_CONNECT_FAIL  // WiFi连接失败
+    WIFI_PROVISION_STATE_CONNECT_FAIL, // WiFi连接失败
+    WIFI_PROVISION_STATE_AP_TIMEOUT,   // 配网热点空闲超时，热点和 Web 服务器已关闭
+    WIFI_PROVISION_STATE_APCFG_START,  // 进入配网模式（只通知订阅者）
+    WIFI_PROVISION_STATE_APCFG_STOP,   // 退出配网，热点和 Web 服务器已关闭（只通知订阅者）
+    WIFI_PROVISION_STATE_CONNECTING,   // 收到配网账号密码，开始连接（只通知订阅者）
+    WIFI_PROVISION_STATE_LINK_QUALITY, // 链路质量等级变化，见 status.link_quality（只通知订阅者）
 } wifi_provision_state_t;
 
 /**
- * @brief WiFi 状态变化回调函数指针
+ * @brief WiFi 状态变化回调函数指针（只收到 CONNECTED/DISCONNECTED/CONNECT_FAIL/AP_TIMEOUT）
  */
 typedef void (*wifi_provision_cb_t)(wifi_provision_state_t state);
 
+/**
+ * @brief STA 连接阶段
+ */
+typedef enum {
+    WIFI_PROVISION_PHASE_IDLE,       // 未连接
+    WIFI_PROVISION_PHASE_CONNECTING, // 正在用配网提交的账号密码连接
+    WIFI_PROVISION_PHASE_CONNECTED,  // 已连接并获取 IP
+} wifi_provision_phase_t;
+
+/**
+ * @brief 链路质量等级（按平均 RSSI 划分，带回差）
+ */
+typedef enum {
+    WIFI_PROVISION_LINK_UNKNOWN, // 未连接或还没有采样
+    WIFI_PROVISION_LINK_GOOD,    // 平均 RSSI >= -65 dBm
+    WIFI_PROVISION_LINK_FAIR,
+    WIFI_PROVISION_LINK_POOR,    // 平均 RSSI <= -78 dBm，可以减少自己的流量；会在后台尝试漫游
+} wifi_provision_link_quality_t;
+
+/** RSSI 历史记录长度（采样次数） */
+#define WIFI_PROVISION_LINK_HISTORY_LEN 16
+
+/**
+ * @brief 链路监测统计（连接后每 2 秒采样一次 RSSI）
+ */
+typedef struct {
+    int8_t rssi;                                     // 最近一次采样
+    int8_t rssi_avg;                                 // 指数加权平均（α = 1/4）
+    wifi_provision_link_quality_t quality;
+    uint8_t history_len;                             // history 中的有效采样数
+    int8_t history[WIFI_PROVISION_LINK_HISTORY_LEN]; // 最近的采样，从旧到新
+    uint32_t samples;                                // 本次连接的总采样次数
+} wifi_provision_link_stats_t;
+
+/**
+ * @brief 配网状态快照（所有字段在同一把锁内一起更新，读到的总是一致的）
+ */
+typedef struct {
+    wifi_provision_phase_t phase;
+    bool apcfg_active;  // 配网热点是否开启
+    char ssid[33];      // 当前或最近一次连接的网络
+    uint32_t ip;        // 已连接时的 IP（网络字节序），否则为 0
+    int8_t rssi;        // 信号强度：获取 IP 时的值，之后随链路监测更新为平均值
+    uint8_t channel;    // 获取 IP 时的信道
+    wifi_provision_link_quality_t link_quality;
+    int64_t since_us;   // 进入当前阶段的时间（esp_timer_get_time）
+} wifi_provision_status_t;
+
+/**
+ * @brief 状态事件
+ */
+typedef struct {
+    wifi_provision_state_t type;
+    uint8_t reason;                 // DISCONNECTED/CONNECT_FAIL：断线原因（wifi_err_reason_t），其他为 0
+    bool provisioning;              // CONNECTED/CONNECT_FAIL 是否是配网提交的账号密码的结果
+    int64_t time_us;                // 事件时间（esp_timer_get_time）
+    wifi_provision_status_t status; // 事件发生后的状态
+} wifi_provision_event_t;
+
+/**
+ * @brief 状态事件订阅回调
+ *
+ * 在产生事件的任务中同步调用（WiFi 事件来自系统事件任务，其他来自配网任务或 Web 服务器任务），
+ * 不同订阅者按订阅顺序依次调用；不要阻塞，也不要在回调中订阅/取消订阅。
+ */
+typedef void (*wifi_provision_event_cb_t)(const wifi_provision_event_t *event, void *arg);
+
+/** 订阅者数量上限（不含 wifi_provision_init 的回调） */
+#define WIFI_PROVISION_MAX_SUBSCRIBERS 4
+
+/** 自动选择热点信道：跟随 STA 的信道，没有时扫描选择 1/6/11 中最空闲的 */
+#define WIFI_PROVISION_AP_CHANNEL_AUTO 0
+
+/**
+ * @brief 配网热点参数
+ */
+typedef struct {
+    const char *ap_ssid;       // 热点名称（1~32 字节），NULL 使用默认 "ESP32_wifi"
+    const char *ap_password;   // 热点密码（8~63 字节），空字符串为开放热点，NULL 使用默认
+    const char *ap_ip;         // 热点 IP（网页地址），NULL 使用默认 "192.168.100.1"
+    uint8_t ap_channel;        // 信道 1~13，或 WIFI_PROVISION_AP_CHANNEL_AUTO
+    uint8_t ap_max_connection; // 最大客户端数量（1~4），0 使用默认值 4
+} wifi_provision_config_t;
+
+#define WIFI_PROVISION_DEFAULT_CONFIG() { \
+    .ap_ssid = NULL,                      \
+    .ap_password = NULL,                  \
+    .ap_ip = NULL,                        \
+    .ap_channel = WIFI_PROVISION_AP_CHANNEL_AUTO, \
+    .ap_max_connection = 0,               \
+}
+
 /**
  * @brief 初始化 WiFi 配网组件
  * 
  * @param callback WiFi 状态变化的回调函数
+ * @param config   热点参数，NULL 使用 WIFI_PROVISION_DEFAULT_CONFIG()
+ * @return ESP_OK 成功，ESP_ERR_INVALID_ARG 热点参数无效（组件未初始化）
+ */
+esp_err_t wifi_provision_init(wifi_provision_cb_t callback, const wifi_provision_config_t *config);
+
+/**
+ * @brief 订阅状态事件（可以在 wifi_provision_init 之前调用）
+ * @return ESP_OK 成功（重复订阅同一 cb/arg 也返回成功），ESP_ERR_INVALID_ARG cb 为 NULL，ESP_ERR_NO_MEM 订阅者已满
+ */
+esp_err_t wifi_provision_subscribe(wifi_provision_event_cb_t cb, void *arg);
+
+/**
+ * @brief 取消订阅
+ * @return ESP_OK 成功，ESP_ERR_NOT_FOUND 没有这个订阅
  */
-void wifi_provision_init(wifi_provision_cb_t callback);
+esp_err_t wifi_provision_unsubscribe(wifi_provision_event_cb_t cb, void *arg);
+
+/**
+ * @brief 读取当前状态快照（代替轮询 IP）
+ */
+void wifi_provision_get_status(wifi_provision_status_t *out);
+
+/**
+ * @brief 读取链路监测统计
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 未连接
+ */
+esp_err_t wifi_provision_get_link_stats(wifi_provision_link_stats_t *out);
 
 /**
  * @brief 启动 AP 配网模式
@@ -30,4 +155,163 @@ void wifi_provision_init(wifi_provision_cb_t callback);
  */
 void wifi_provision_start_apcfg(void);
 
+/**
+ * @brief 删除所有保存的网络（恢复出厂设置）
+ *
+ * 当前连接不会主动断开，调用后通常直接 esp_restart()；
+ * 预签名配网数据的 seq 记录会保留，旧的配网数据仍然不能重放。
+ * @return ESP_OK 成功，其他为清除驱动配置失败的错误码
+ */
+esp_err_t wifi_provision_forget_all(void);
+
+/**
+ * @brief WebSocket 命令消息（只读视图，只在处理函数执行期间有效）
+ */
+typedef struct wifi_provision_msg wifi_provision_msg_t;
+
+/**
+ * @brief 命令处理函数（在 Web 服务器任务中执行，不要长时间阻塞）
+ */
+typedef void (*wifi_provision_cmd_handler_t)(const wifi_provision_msg_t *msg);
+
+/**
+ * @brief 注册 WebSocket 命令
+ *
+ * 网页或工具发送 {"cmd":"<name>",...} 时调用 handler。内置命令：
+ * scan、connect、ack、status、forget、provision（以及开启追踪时的 timeline、开启诊断时的 diag）；同名注册会替换已有处理函数。
+ *
+ * @param name    命令名（不超过 23 字节，必须长期有效，通常是字符串常量）
+ * @param handler 处理函数
+ * @return ESP_OK 成功，ESP_ERR_INVALID_ARG 参数无效，ESP_ERR_NO_MEM 命令表已满
+ */
+esp_err_t wifi_provision_register_command(const char *name, wifi_provision_cmd_handler_t handler);
+
+/**
+ * @brief 读取消息中的字符串字段（反转义后写入 out，总是以'\0'结尾）
+ * @return 字符串长度；字段不存在、类型不符或 out 放不下时返回 -1
+ */
+int wifi_provision_msg_get_string(const wifi_provision_msg_t *msg, const char *key, char *out, size_t out_len);
+
+/** 读取消息中的整数字段，不存在或类型不符时返回 false */
+bool wifi_provision_msg_get_int(const wifi_provision_msg_t *msg, const char *key, int32_t *out);
+
+/** 读取消息中的布尔字段，不存在或类型不符时返回 false */
+bool wifi_provision_msg_get_bool(const wifi_provision_msg_t *msg, const char *key, bool *out);
+
+/** 消息中是否有该字段（任意类型） */
+bool wifi_provision_msg_has(const wifi_provision_msg_t *msg, const char *key);
+
+/**
+ * @brief 向所有网页客户端发送一条文本消息（通常是命令的 JSON 回复）
+ *
+ * 数据会被拷贝，发送在后台完成。
+ *
+ * @return ESP_OK 已提交，ESP_FAIL Web 服务器未运行，ESP_ERR_NO_MEM 内存不足
+ */
+esp_err_t wifi_provision_send_text(const char *text, size_t len);
+
+/**
+ * @brief 配网耗时追踪点
+ */
+typedef enum {
+    WIFI_PROVISION_TRACE_APCFG_START,      // 调用 wifi_provision_start_apcfg（时间零点）
+    WIFI_PROVISION_TRACE_AP_START,         // 热点启动完成（WIFI_EVENT_AP_START）
+    WIFI_PROVISION_TRACE_HTTPD_START,      // Web 服务器启动完成
+    WIFI_PROVISION_TRACE_PAGE_REQUEST,     // 首次收到网页请求
+    WIFI_PROVISION_TRACE_WS_HANDSHAKE,     // 首次 WebSocket 握手
+    WIFI_PROVISION_TRACE_SCAN_START,       // 开始扫描
+    WIFI_PROVISION_TRACE_SCAN_FIRST_BATCH, // 第一批扫描结果
+    WIFI_PROVISION_TRACE_SCAN_END,         // 扫描结束
+    WIFI_PROVISION_TRACE_CREDENTIALS,      // 收到网页提交的账号密码
+    WIFI_PROVISION_TRACE_STA_ASSOCIATED,   // STA 关联成功
+    WIFI_PROVISION_TRACE_DHCP_DONE,        // 获取到 IP
+    WIFI_PROVISION_TRACE_STATUS_SENT,      // "connected" 状态已提交发送
+    WIFI_PROVISION_TRACE_STATUS_ACKED,     // 网页确认收到 "connected" 状态
+    WIFI_PROVISION_TRACE_AP_TEARDOWN,      // 热点和 Web 服务器已关闭
+    WIFI_PROVISION_TRACE_MAX
+} wifi_provision_trace_point_t;
+
+/**
+ * @brief 时间线中的一个事件
+ */
+typedef struct {
+    wifi_provision_trace_point_t point;
+    int64_t time_us; // 相对本次配网开始的时间（微秒）
+} wifi_provision_trace_event_t;
+
+/**
+ * @brief 导出最近一次配网的时间线（按时间先后排列）
+ *
+ * 需开启 CONFIG_WIFI_PROVISION_TRACE，否则始终返回 0。
+ *
+ * @param events     输出数组
+ * @param max_events 数组容量
+ * @return 写入的事件数
+ */
+size_t wifi_provision_get_timeline(wifi_provision_trace_event_t *events, size_t max_events);
+
+/**
+ * @brief 追踪点名称（如 "ap_start"），用于日志和导出
+ */
+const char *wifi_provision_trace_point_name(wifi_provision_trace_point_t point);
+
+/**
+ * @brief 内存统计的子系统
+ */
+typedef enum {
+    WIFI_PROVISION_MEM_WS_SERVER,    // Web 服务器（接收缓冲区、异步发送的帧）
+    WIFI_PROVISION_MEM_WIFI_MANAGER, // WiFi 管理器（扫描缓存）
+    WIFI_PROVISION_MEM_PROVISION,    // 配网流程
+    WIFI_PROVISION_MEM_MAX
+} wifi_provision_mem_subsys_t;
+
+/**
+ * @brief 记录栈水位的任务
+ */
+typedef enum {
+    WIFI_PROVISION_TASK_PROV,  // 配网流程任务 prov_task
+    WIFI_PROVISION_TASK_WIFI,  // WiFi 管理器任务（扫描/连接）
+    WIFI_PROVISION_TASK_HTTPD, // Web 服务器任务（未运行时为 0）
+    WIFI_PROVISION_TASK_MAX
+} wifi_provision_diag_task_t;
+
+/**
+ * @brief 一个子系统的堆用量
+ */
+typedef struct {
+    uint32_t current_bytes; // 当前占用
+    uint32_t peak_bytes;    // 本次配网会话中的峰值
+    uint32_t allocs;        // 本次配网会话中的分配次数
+    uint32_t frees;         // 本次配网会话中的释放次数
+} wifi_provision_mem_stats_t;
+
+/**
+ * @brief 诊断快照
+ */
+typedef struct {
+    wifi_provision_mem_stats_t mem[WIFI_PROVISION_MEM_MAX];
+    uint32_t free_heap;                               // 当前剩余堆
+    uint32_t min_free_heap;                           // 上电以来的最小剩余堆
+    uint32_t free_internal;                           // 当前剩余内部RAM（开启PSRAM时与 free_heap 不同）
+    uint32_t min_free_internal;                       // 上电以来的最小剩余内部RAM
+    uint32_t httpd_heap;                              // 最近一次启动 Web 服务器消耗的堆（估算）
+    uint32_t stack_free[WIFI_PROVISION_TASK_MAX];     // 各任务栈的历史最小剩余（字节）
+    uint32_t sessions;                                // 上电以来的配网次数
+} wifi_provision_diag_t;
+
+/**
+ * @brief 获取内存和栈的诊断快照
+ *
+ * 网页或工具也可以发送 {"cmd":"diag"} 获取同样的数据。
+ *
+ * @return ESP_OK 成功，ESP_ERR_NOT_SUPPORTED 未开启 CONFIG_WIFI_PROVISION_DIAG
+ */
+esp_err_t wifi_provision_get_diag(wifi_provision_diag_t *diag);
+
+/** 子系统名称（如 "ws_server"），用于日志和导出 */
+const char *wifi_provision_mem_subsys_name(wifi_provision_mem_subsys_t sub);
+
+/** 任务名称（如 "prov_task"），用于日志和导出 */
+const char *wifi_provision_diag_task_name(wifi_provision_diag_task_t task);
+
 #endif // WIFI_PROVISION_H
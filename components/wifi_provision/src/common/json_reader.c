@@ -0,0 +1,464 @@
+/**
+ * @file json_reader.c
+ * @brief 扁平JSON读取器 - 无对象树、无堆分配的顶层字段解析
+ *
+ * 【为什么不用cJSON解析？】
+ * 网页和工具发来的命令都是一层对象（{"cmd":"scan"}、{"cmd":"connect","ssid":...}），
+ * cJSON_Parse会为每个字段分配节点，处理完再全部释放。
+ * 这里扫描一遍原文，只记下每个顶层字段的位置，命令处理函数按需读取。
+ */
+
+#include "json_reader.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief 解析游标
+ */
+typedef struct
+{
+    const char *p;
+    const char *end;
+} jr_cursor_t;
+
+static void jr_skip_ws(jr_cursor_t *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r'))
+    {
+        c->p++;
+    }
+}
+
+/**
+ * @brief 跳过一个字符串（游标在开头的引号上），返回内容范围
+ */
+static bool jr_skip_string(jr_cursor_t *c, const char **start, size_t *len)
+{
+    if (c->p >= c->end || *c->p != '"')
+    {
+        return false;
+    }
+    const char *s = ++c->p;
+    while (c->p < c->end)
+    {
+        char ch = *c->p;
+        if (ch == '\\')
+        {
+            c->p += 2;
+            continue;
+        }
+        if (ch == '"')
+        {
+            *start = s;
+            *len = (size_t)(c->p - s);
+            c->p++;
+            return c->p <= c->end;
+        }
+        if ((unsigned char)ch < 0x20)
+        {
+            return false;
+        }
+        c->p++;
+    }
+    return false;
+}
+
+/**
+ * @brief 跳过嵌套的对象/数组（只匹配括号，字符串内的括号不计）
+ */
+static bool jr_skip_container(jr_cursor_t *c)
+{
+    int depth = 0;
+    while (c->p < c->end)
+    {
+        char ch = *c->p;
+        if (ch == '"')
+        {
+            const char *s;
+            size_t n;
+            if (!jr_skip_string(c, &s, &n))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (ch == '{' || ch == '[')
+        {
+            depth++;
+        }
+        else if (ch == '}' || ch == ']')
+        {
+            if (--depth == 0)
+            {
+                c->p++;
+                return true;
+            }
+        }
+        c->p++;
+    }
+    return false;
+}
+
+static bool jr_is_digit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+/**
+ * @brief 跳过一串数字，至少要有一位
+ */
+static bool jr_skip_digits(jr_cursor_t *c)
+{
+    const char *s = c->p;
+    while (c->p < c->end && jr_is_digit(*c->p))
+    {
+        c->p++;
+    }
+    return c->p > s;
+}
+
+/**
+ * @brief 跳过一个数字：-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+ */
+static bool jr_skip_number(jr_cursor_t *c)
+{
+    if (c->p < c->end && *c->p == '-')
+    {
+        c->p++;
+    }
+    if (c->p < c->end && *c->p == '0')
+    {
+        c->p++;
+    }
+    else if (!jr_skip_digits(c))
+    {
+        return false; // 单独的'-'
+    }
+    if (c->p < c->end && *c->p == '.')
+    {
+        c->p++;
+        if (!jr_skip_digits(c))
+        {
+            return false;
+        }
+    }
+    if (c->p < c->end && (*c->p == 'e' || *c->p == 'E'))
+    {
+        c->p++;
+        if (c->p < c->end && (*c->p == '+' || *c->p == '-'))
+        {
+            c->p++;
+        }
+        if (!jr_skip_digits(c))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 解析一个值，记录类型和原文范围
+ */
+static bool jr_parse_value(jr_cursor_t *c, json_field_t *f)
+{
+    if (c->p >= c->end)
+    {
+        return false;
+    }
+    const char *start = c->p;
+    char ch = *c->p;
+    if (ch == '"')
+    {
+        f->type = JSON_FIELD_STRING;
+        return jr_skip_string(c, &f->value, &f->value_len);
+    }
+    if (ch == '{' || ch == '[')
+    {
+        f->type = (ch == '{') ? JSON_FIELD_OBJECT : JSON_FIELD_ARRAY;
+        if (!jr_skip_container(c))
+        {
+            return false;
+        }
+    }
+    else if (ch == 't' || ch == 'f' || ch == 'n')
+    {
+        const char *word = (ch == 't') ? "true" : (ch == 'f') ? "false" : "null";
+        size_t n = strlen(word);
+        if ((size_t)(c->end - c->p) < n || memcmp(c->p, word, n) != 0)
+        {
+            return false;
+        }
+        f->type = (ch == 'n') ? JSON_FIELD_NULL : JSON_FIELD_BOOL;
+        c->p += n;
+    }
+    else if (ch == '-' || jr_is_digit(ch))
+    {
+        f->type = JSON_FIELD_NUMBER;
+        if (!jr_skip_number(c))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+    f->value = start;
+    f->value_len = (size_t)(c->p - start);
+    return true;
+}
+
+/**
+ * @brief 顶层对象之后只允许空白
+ */
+static bool jr_at_end(jr_cursor_t *c)
+{
+    jr_skip_ws(c);
+    return c->p == c->end;
+}
+
+bool json_reader_parse(json_reader_t *r, const char *json, size_t len)
+{
+    jr_cursor_t c = {.p = json, .end = json + len};
+    r->count = 0;
+
+    jr_skip_ws(&c);
+    if (c.p >= c.end || *c.p != '{')
+    {
+        return false;
+    }
+    c.p++;
+    jr_skip_ws(&c);
+    if (c.p < c.end && *c.p == '}')
+    {
+        c.p++;
+        return jr_at_end(&c);
+    }
+
+    while (c.p < c.end)
+    {
+        if (r->count >= JSON_READER_MAX_FIELDS)
+        {
+            return false;
+        }
+        json_field_t *f = &r->fields[r->count];
+        jr_skip_ws(&c);
+        if (!jr_skip_string(&c, &f->key, &f->key_len))
+        {
+            return false;
+        }
+        jr_skip_ws(&c);
+        if (c.p >= c.end || *c.p != ':')
+        {
+            return false;
+        }
+        c.p++;
+        jr_skip_ws(&c);
+        if (!jr_parse_value(&c, f))
+        {
+            return false;
+        }
+        r->count++;
+
+        jr_skip_ws(&c);
+        if (c.p < c.end && *c.p == ',')
+        {
+            c.p++;
+            continue;
+        }
+        if (c.p >= c.end || *c.p != '}')
+        {
+            return false;
+        }
+        c.p++;
+        return jr_at_end(&c);
+    }
+    return false;
+}
+
+const json_field_t *json_reader_find(const json_reader_t *r, const char *key)
+{
+    size_t key_len = strlen(key);
+    for (int i = 0; i < r->count; i++)
+    {
+        if (r->fields[i].key_len == key_len && memcmp(r->fields[i].key, key, key_len) == 0)
+        {
+            return &r->fields[i];
+        }
+    }
+    return NULL;
+}
+
+static int jr_hex4(const char *s)
+{
+    int v = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char ch = s[i];
+        v <<= 4;
+        if (ch >= '0' && ch <= '9')
+            v |= ch - '0';
+        else if (ch >= 'a' && ch <= 'f')
+            v |= ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F')
+            v |= ch - 'A' + 10;
+        else
+            return -1;
+    }
+    return v;
+}
+
+/**
+ * @brief 把Unicode码点编码为UTF-8
+ * @return 写入的字节数，空间不足返回0
+ */
+static size_t jr_put_utf8(char *out, size_t room, uint32_t cp)
+{
+    if (cp < 0x80 && room >= 1)
+    {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800 && room >= 2)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000 && room >= 3)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    if (cp >= 0x10000 && room >= 4)
+    {
+        out[0] = (char)(0xF0 | (cp >> 18));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        return 4;
+    }
+    return 0;
+}
+
+int json_reader_get_string(const json_reader_t *r, const char *key, char *out, size_t out_len)
+{
+    const json_field_t *f = json_reader_find(r, key);
+    if (f == NULL || f->type != JSON_FIELD_STRING || out_len == 0)
+    {
+        return -1;
+    }
+
+    const char *s = f->value;
+    const char *end = f->value + f->value_len;
+    size_t n = 0;
+    while (s < end)
+    {
+        size_t room = out_len - 1 - n; // 保留结束符
+        char ch = *s++;
+        if (ch != '\\')
+        {
+            if (room < 1)
+                return -1;
+            out[n++] = ch;
+            continue;
+        }
+        if (s >= end)
+            return -1;
+        char esc = *s++;
+        char plain = 0;
+        switch (esc)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            plain = esc;
+            break;
+        case 'b':
+            plain = '\b';
+            break;
+        case 'f':
+            plain = '\f';
+            break;
+        case 'n':
+            plain = '\n';
+            break;
+        case 'r':
+            plain = '\r';
+            break;
+        case 't':
+            plain = '\t';
+            break;
+        case 'u':
+        {
+            if (end - s < 4)
+                return -1;
+            int cp = jr_hex4(s);
+            // \u0000会在输出中插入NUL，返回的长度与strlen不一致
+            if (cp <= 0 || (cp >= 0xDC00 && cp <= 0xDFFF))
+                return -1;
+            s += 4;
+            // 代理对：\uD8xx\uDCxx 组成一个补充平面字符，单独的代理项无法编码为UTF-8
+            if (cp >= 0xD800 && cp <= 0xDBFF)
+            {
+                if (end - s < 6 || s[0] != '\\' || s[1] != 'u')
+                    return -1;
+                int lo = jr_hex4(s + 2);
+                if (lo < 0xDC00 || lo > 0xDFFF)
+                    return -1;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                s += 6;
+            }
+            size_t w = jr_put_utf8(&out[n], room, (uint32_t)cp);
+            if (w == 0)
+                return -1;
+            n += w;
+            continue;
+        }
+        default:
+            return -1;
+        }
+        if (room < 1)
+            return -1;
+        out[n++] = plain;
+    }
+    out[n] = '\0';
+    return (int)n;
+}
+
+bool json_reader_get_int(const json_reader_t *r, const char *key, int32_t *out)
+{
+    const json_field_t *f = json_reader_find(r, key);
+    if (f == NULL || f->type != JSON_FIELD_NUMBER || f->value_len >= 12)
+    {
+        return false;
+    }
+    char num[12];
+    memcpy(num, f->value, f->value_len);
+    num[f->value_len] = '\0';
+    char *endp;
+    errno = 0;
+    long v = strtol(num, &endp, 10);
+    // 溢出时strtol返回LONG_MAX/LONG_MIN（errno为ERANGE），64位long还要检查int32范围
+    if (*endp != '\0' || errno == ERANGE || v < INT32_MIN || v > INT32_MAX)
+    {
+        return false;
+    }
+    *out = (int32_t)v;
+    return true;
+}
+
+bool json_reader_get_bool(const json_reader_t *r, const char *key, bool *out)
+{
+    const json_field_t *f = json_reader_find(r, key);
+    if (f == NULL || f->type != JSON_FIELD_BOOL)
+    {
+        return false;
+    }
+    *out = (f->value[0] == 't');
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef _JSON_READER_H_
+#define _JSON_READER_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** 单条消息最多记录的顶层字段数 */
+#define JSON_READER_MAX_FIELDS 12
+
+typedef enum
+{
+    JSON_FIELD_STRING, // 值不含引号，可能包含转义序列
+    JSON_FIELD_NUMBER,
+    JSON_FIELD_BOOL,
+    JSON_FIELD_NULL,
+    JSON_FIELD_OBJECT, // 嵌套对象/数组只记录原始文本范围，不展开
+    JSON_FIELD_ARRAY,
+} json_field_type_t;
+
+/** 顶层字段：键和值都指向输入文本，不拷贝 */
+typedef struct
+{
+    const char *key;
+    size_t key_len;
+    const char *value;
+    size_t value_len;
+    json_field_type_t type;
+} json_field_t;
+
+/**
+ * @brief 扁平JSON读取器
+ *
+ * 只解析顶层对象的键值对，记录每个值在原文中的位置，不分配内存、不构建对象树。
+ * 字符串在读取时才反转义到调用者的缓冲区。
+ * 输入文本必须在读取期间保持有效。
+ */
+typedef struct
+{
+    json_field_t fields[JSON_READER_MAX_FIELDS];
+    int count;
+} json_reader_t;
+
+/**
+ * @brief 解析顶层对象
+ * @return true 成功；false 不是合法的JSON对象（对象之后还有非空白内容也算）或字段过多
+ */
+bool json_reader_parse(json_reader_t *r, const char *json, size_t len);
+
+/** 按键名查找字段（键名按原文比较，不处理键中的转义） */
+const json_field_t *json_reader_find(const json_reader_t *r, const char *key);
+
+/**
+ * @brief 读取字符串字段并反转义到out（总是以'\0'结尾）
+ * @return 字符串长度；字段不存在、不是字符串、out放不下或含有无效转义
+ *         （\u0000、不成对的代理项）时返回-1
+ */
+int json_reader_get_string(const json_reader_t *r, const char *key, char *out, size_t out_len);
+
+/** 读取整数字段，不存在、不是整数或超出int32范围时返回false */
+bool json_reader_get_int(const json_reader_t *r, const char *key, int32_t *out);
+
+/** 读取布尔字段，不存在或不是布尔值时返回false */
+bool json_reader_get_bool(const json_reader_t *r, const char *key, bool *out);
+
+#endif
@@ -0,0 +1,254 @@
+/**
+ * @file json_writer.c
+ * @brief 流式JSON写入器 - 无对象树、无堆分配的JSON序列化
+ *
+ * 【为什么不用cJSON生成？】
+ * cJSON需要先为每个字段分配一个节点组成对象树，再打印成另一份字符串，
+ * 扫描到几十个热点时堆上同时存在两份完整数据。
+ * 这里直接按顺序把文本写入固定缓冲区，峰值内存就是缓冲区本身。
+ */
+
+#include "json_writer.h"
+#include <stdio.h>
+#include <string.h>
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap)
+{
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->cap = cap;
+    if (cap > 0)
+    {
+        buf[0] = '\0';
+    }
+    else
+    {
+        w->overflow = true;
+    }
+}
+
+/**
+ * @brief 写入原始数据（末尾始终保留1字节给结束符）
+ */
+static void jw_put(json_writer_t *w, const char *data, size_t n)
+{
+    if (w->overflow)
+    {
+        return;
+    }
+    if (w->len + n + 1 > w->cap)
+    {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+    w->buf[w->len] = '\0';
+}
+
+static void jw_putc(json_writer_t *w, char c)
+{
+    jw_put(w, &c, 1);
+}
+
+/**
+ * @brief 写入值或键名之前的逗号处理
+ */
+static void jw_separator(json_writer_t *w)
+{
+    if (w->after_key)
+    {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth > 0 && w->count[w->depth - 1]++ > 0)
+    {
+        jw_putc(w, ',');
+    }
+}
+
+static void jw_open(json_writer_t *w, char c)
+{
+    jw_separator(w);
+    if (w->depth >= JSON_WRITER_MAX_DEPTH)
+    {
+        w->overflow = true;
+        return;
+    }
+    jw_putc(w, c);
+    w->count[w->depth++] = 0;
+}
+
+static void jw_close(json_writer_t *w, char c)
+{
+    if (w->depth == 0)
+    {
+        w->overflow = true;
+        return;
+    }
+    w->depth--;
+    jw_putc(w, c);
+}
+
+void json_writer_object_begin(json_writer_t *w)
+{
+    jw_open(w, '{');
+}
+
+void json_writer_object_end(json_writer_t *w)
+{
+    jw_close(w, '}');
+}
+
+void json_writer_array_begin(json_writer_t *w)
+{
+    jw_open(w, '[');
+}
+
+void json_writer_array_end(json_writer_t *w)
+{
+    jw_close(w, ']');
+}
+
+/**
+ * @brief 写入带引号并转义的字符串
+ *
+ * 【转义规则（RFC 8259）】
+ * - 引号和反斜杠前加反斜杠
+ * - 0x00~0x1F控制字符使用\n、\t或\u00XX
+ * - 其它字节（包括UTF-8多字节字符）原样输出
+ */
+static void jw_quoted(json_writer_t *w, const char *str, size_t max_len)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    jw_putc(w, '"');
+    for (size_t i = 0; i < max_len && str[i] != '\0'; i++)
+    {
+        unsigned char c = (unsigned char)str[i];
+        switch (c)
+        {
+        case '"':
+            jw_put(w, "\\\"", 2);
+            break;
+        case '\\':
+            jw_put(w, "\\\\", 2);
+            break;
+        case '\n':
+            jw_put(w, "\\n", 2);
+            break;
+        case '\r':
+            jw_put(w, "\\r", 2);
+            break;
+        case '\t':
+            jw_put(w, "\\t", 2);
+            break;
+        default:
+            if (c < 0x20)
+            {
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F]};
+                jw_put(w, esc, sizeof(esc));
+            }
+            else
+            {
+                jw_putc(w, (char)c);
+            }
+            break;
+        }
+    }
+    jw_putc(w, '"');
+}
+
+void json_writer_key(json_writer_t *w, const char *key)
+{
+    jw_separator(w);
+    jw_quoted(w, key, SIZE_MAX);
+    jw_putc(w, ':');
+    w->after_key = true;
+}
+
+void json_writer_string_n(json_writer_t *w, const char *str, size_t max_len)
+{
+    jw_separator(w);
+    jw_quoted(w, str, max_len);
+}
+
+void json_writer_string(json_writer_t *w, const char *str)
+{
+    json_writer_string_n(w, str, SIZE_MAX);
+}
+
+void json_writer_int(json_writer_t *w, int32_t value)
+{
+    char num[12];
+    int n = snprintf(num, sizeof(num), "%ld", (long)value);
+    jw_separator(w);
+    jw_put(w, num, (size_t)n);
+}
+
+void json_writer_bool(json_writer_t *w, bool value)
+{
+    jw_separator(w);
+    if (value)
+    {
+        jw_put(w, "true", 4);
+    }
+    else
+    {
+        jw_put(w, "false", 5);
+    }
+}
+
+void json_writer_kv_string(json_writer_t *w, const char *key, const char *str)
+{
+    json_writer_key(w, key);
+    json_writer_string(w, str);
+}
+
+void json_writer_kv_int(json_writer_t *w, const char *key, int32_t value)
+{
+    json_writer_key(w, key);
+    json_writer_int(w, value);
+}
+
+void json_writer_kv_bool(json_writer_t *w, const char *key, bool value)
+{
+    json_writer_key(w, key);
+    json_writer_bool(w, value);
+}
+
+size_t json_writer_remaining(const json_writer_t *w)
+{
+    if (w->overflow || w->len + 1 >= w->cap)
+    {
+        return 0;
+    }
+    return w->cap - w->len - 1;
+}
+
+json_writer_mark_t json_writer_mark(const json_writer_t *w)
+{
+    return *w;
+}
+
+void json_writer_rollback(json_writer_t *w, const json_writer_mark_t *mark)
+{
+    *w = *mark;
+    if (w->cap > 0)
+    {
+        w->buf[w->len] = '\0';
+    }
+}
+
+const char *json_writer_finish(json_writer_t *w, size_t *len)
+{
+    if (w->overflow || w->depth != 0)
+    {
+        return NULL;
+    }
+    if (len)
+    {
+        *len = w->len;
+    }
+    return w->buf;
+}
@@ -0,0 +1,65 @@
+#ifndef _JSON_WRITER_H_
+#define _JSON_WRITER_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** 最大嵌套深度（对象/数组） */
+#define JSON_WRITER_MAX_DEPTH 8
+
+/**
+ * @brief 流式JSON写入器
+ *
+ * 直接把JSON文本写入调用者提供的缓冲区，不构建对象树，不分配内存。
+ * 缓冲区写满后置位overflow，之后的写入全部忽略。
+ * 结构体可以直接拷贝保存，用于写入失败时回滚（见json_writer_mark）。
+ */
+typedef struct
+{
+    char *buf;                             // 输出缓冲区
+    size_t cap;                            // 缓冲区容量（含结束符）
+    size_t len;                            // 已写入长度（不含结束符）
+    bool overflow;                         // 是否发生过溢出
+    bool after_key;                        // 刚写完键名，下一个值不需要逗号
+    uint8_t depth;                         // 当前嵌套深度
+    uint16_t count[JSON_WRITER_MAX_DEPTH]; // 每层已写入的元素数量
+} json_writer_t;
+
+/** 回滚点：保存的写入器状态 */
+typedef json_writer_t json_writer_mark_t;
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap);
+
+void json_writer_object_begin(json_writer_t *w);
+void json_writer_object_end(json_writer_t *w);
+void json_writer_array_begin(json_writer_t *w);
+void json_writer_array_end(json_writer_t *w);
+
+/** 写入对象的键名，随后必须写入一个值 */
+void json_writer_key(json_writer_t *w, const char *key);
+
+/** 写入字符串值（自动转义），最多读取max_len字节或遇到'\0'为止 */
+void json_writer_string_n(json_writer_t *w, const char *str, size_t max_len);
+void json_writer_string(json_writer_t *w, const char *str);
+void json_writer_int(json_writer_t *w, int32_t value);
+void json_writer_bool(json_writer_t *w, bool value);
+
+/** 便捷函数：写入 "key":value */
+void json_writer_kv_string(json_writer_t *w, const char *key, const char *str);
+void json_writer_kv_int(json_writer_t *w, const char *key, int32_t value);
+void json_writer_kv_bool(json_writer_t *w, const char *key, bool value);
+
+/** 剩余可写字节数 */
+size_t json_writer_remaining(const json_writer_t *w);
+
+/** 保存/恢复回滚点 */
+json_writer_mark_t json_writer_mark(const json_writer_t *w);
+void json_writer_rollback(json_writer_t *w, const json_writer_mark_t *mark);
+
+/**
+ * @brief 结束写入
+ * @param len 输出JSON长度（可为NULL）
+ * @return 以'\0'结尾的JSON字符串，发生溢出或括号未闭合时返回NULL
+ */
+const char *json_writer_finish(json_writer_t *w, size_t *len);
+#endif
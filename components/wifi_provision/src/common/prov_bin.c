@@ -0,0 +1,109 @@
+/**
+ * @file prov_bin.c
+ * @brief 配网二进制协议编解码（格式见 prov_bin.h）
+ *
+ * 【为什么要二进制协议？】
+ * 批量配网工具一次要处理上百台设备，JSON 的解析和传输都是开销：
+ * 一个热点在 JSON 中约 50 字节，TLV 只需 5 字节加 SSID 长度，
+ * 双方都不需要转义和解析文本。浏览器仍然使用 JSON。
+ */
+
+#include "prov_bin.h"
+#include <string.h>
+
+void prov_bin_writer_init(prov_bin_writer_t *w, uint8_t *buf, size_t cap, uint8_t opcode)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = false;
+    prov_bin_put_u8(w, opcode);
+}
+
+void prov_bin_put_u8(prov_bin_writer_t *w, uint8_t value)
+{
+    if (w->overflow || w->len + 1 > w->cap)
+    {
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->len++] = value;
+}
+
+bool prov_bin_put_tlv(prov_bin_writer_t *w, uint8_t type, const void *value, size_t value_len)
+{
+    if (w->overflow || value_len > 255 || w->len + 2 + value_len > w->cap)
+    {
+        w->overflow = true;
+        return false;
+    }
+    w->buf[w->len++] = type;
+    w->buf[w->len++] = (uint8_t)value_len;
+    if (value_len > 0)
+    {
+        memcpy(&w->buf[w->len], value, value_len);
+        w->len += value_len;
+    }
+    return true;
+}
+
+bool prov_bin_put_ap(prov_bin_writer_t *w, const uint8_t *ssid, int8_t rssi, uint8_t authmode, uint8_t channel)
+{
+    uint8_t value[3 + 32];
+    size_t ssid_len = strnlen((const char *)ssid, 32);
+    value[0] = (uint8_t)rssi;
+    value[1] = authmode;
+    value[2] = channel;
+    memcpy(&value[3], ssid, ssid_len);
+    return prov_bin_put_tlv(w, PROV_BIN_T_AP, value, 3 + ssid_len);
+}
+
+size_t prov_bin_remaining(const prov_bin_writer_t *w)
+{
+    return w->overflow ? 0 : w->cap - w->len;
+}
+
+const uint8_t *prov_bin_finish(const prov_bin_writer_t *w, size_t *out_len)
+{
+    if (w->overflow)
+    {
+        return NULL;
+    }
+    if (out_len)
+    {
+        *out_len = w->len;
+    }
+    return w->buf;
+}
+
+int prov_bin_reader_init(prov_bin_reader_t *r, const uint8_t *buf, size_t len)
+{
+    r->buf = buf;
+    r->len = len;
+    r->pos = 0;
+    if (len == 0)
+    {
+        return -1;
+    }
+    r->pos = 1;
+    return buf[0];
+}
+
+bool prov_bin_next_tlv(prov_bin_reader_t *r, uint8_t *type, const uint8_t **value, uint8_t *value_len)
+{
+    if (r->pos + 2 > r->len)
+    {
+        return false;
+    }
+    uint8_t t = r->buf[r->pos];
+    uint8_t l = r->buf[r->pos + 1];
+    if (r->pos + 2 + l > r->len)
+    {
+        return false;
+    }
+    *type = t;
+    *value_len = l;
+    *value = &r->buf[r->pos + 2];
+    r->pos += 2 + l;
+    return true;
+}
@@ -0,0 +1,104 @@
+#ifndef _PROV_BIN_H_
+#define _PROV_BIN_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 配网二进制协议（/ws 端点的二进制帧）
+ *
+ * 帧格式：[opcode:1][TLV...]，TLV 为 [type:1][len:1][value:len]
+ * 多字节整数不出现在 TLV 里，不存在字节序问题；IP 按网络字节序存放。
+ *
+ * 客户端 -> 设备
+ *   0x01 SCAN_REQ     无 TLV
+ *   0x02 CONNECT      SSID、PASSWORD
+ *   0x03 ACK          STATUS（确认收到的状态）
+ *   0x04 PROVISION    BLOB（预签名配网数据，格式见 prov_blob.h；被拒绝时回复 STATUS = REJECTED）
+ *
+ * 设备 -> 客户端
+ *   0x81 SCAN_RESULT  [batch:1][flags:1] 后跟若干 AP，flags bit0 = 最后一批，bit1 = 完整列表（替换之前的批次）
+ *   0x82 STATUS       STATUS、SSID、IP（可选）、REASON（失败时的断线原因，可选）
+ *
+ * AP 值布局：[rssi:int8][authmode:1][channel:1][ssid:0~32]
+ */
+
+#define PROV_BIN_OP_SCAN_REQ    0x01
+#define PROV_BIN_OP_CONNECT     0x02
+#define PROV_BIN_OP_ACK         0x03
+#define PROV_BIN_OP_PROVISION   0x04
+#define PROV_BIN_OP_SCAN_RESULT 0x81
+#define PROV_BIN_OP_STATUS      0x82
+
+#define PROV_BIN_T_SSID     0x01
+#define PROV_BIN_T_PASSWORD 0x02
+#define PROV_BIN_T_AP       0x03
+#define PROV_BIN_T_STATUS   0x04
+#define PROV_BIN_T_IP       0x05
+#define PROV_BIN_T_BLOB     0x06
+#define PROV_BIN_T_REASON   0x07
+
+#define PROV_BIN_STATUS_CONNECTED 0
+#define PROV_BIN_STATUS_FAILED    1
+#define PROV_BIN_STATUS_REJECTED  2
+
+#define PROV_BIN_SCAN_FLAG_DONE     0x01
+#define PROV_BIN_SCAN_FLAG_SNAPSHOT 0x02 // 本帧是完整的排序列表（设备端前N名），替换而不是合并之前的批次
+
+/** 一个 AP 记录最多占用的字节数（TLV头 + 固定字段 + 32字节SSID） */
+#define PROV_BIN_AP_MAX_SIZE (2 + 3 + 32)
+
+/**
+ * @brief 二进制帧写入器
+ *
+ * 与 json_writer 相同，写满后置位 overflow 并忽略后续写入；
+ * 单个 TLV 要么完整写入，要么一个字节都不写。
+ */
+typedef struct
+{
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} prov_bin_writer_t;
+
+/** 初始化并写入操作码 */
+void prov_bin_writer_init(prov_bin_writer_t *w, uint8_t *buf, size_t cap, uint8_t opcode);
+
+/** 写入一个原始字节（用于 SCAN_RESULT 的固定头） */
+void prov_bin_put_u8(prov_bin_writer_t *w, uint8_t value);
+
+/** 写入一个 TLV，value_len 不能超过 255 */
+bool prov_bin_put_tlv(prov_bin_writer_t *w, uint8_t type, const void *value, size_t value_len);
+
+/** 写入一个 AP 记录，ssid 最多读取 32 字节或遇到'\0'为止 */
+bool prov_bin_put_ap(prov_bin_writer_t *w, const uint8_t *ssid, int8_t rssi, uint8_t authmode, uint8_t channel);
+
+size_t prov_bin_remaining(const prov_bin_writer_t *w);
+
+/** 结束写入，溢出时返回 NULL */
+const uint8_t *prov_bin_finish(const prov_bin_writer_t *w, size_t *out_len);
+
+/**
+ * @brief 二进制帧读取器（不拷贝，值指针直接指向输入缓冲区）
+ */
+typedef struct
+{
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+} prov_bin_reader_t;
+
+/**
+ * @brief 开始读取一帧
+ * @return 操作码，空帧返回 -1
+ */
+int prov_bin_reader_init(prov_bin_reader_t *r, const uint8_t *buf, size_t len);
+
+/**
+ * @brief 读取下一个 TLV
+ * @return true 成功；false 已读完或 TLV 被截断
+ */
+bool prov_bin_next_tlv(prov_bin_reader_t *r, uint8_t *type, const uint8_t **value, uint8_t *value_len);
+
+#endif
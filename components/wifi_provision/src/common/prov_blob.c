@@ -0,0 +1,117 @@
+/**
+ * @file prov_blob.c
+ * @brief 预签名配网数据的校验与解析
+ *
+ * 【为什么需要签名？】
+ * 配网热点的密码是固定的，任何人都能连上并提交数据。
+ * 普通网页配网需要有人在现场操作，而这条快速通道一次请求就会改掉设备的网络，
+ * 因此只接受用产品密钥签名过的数据。
+ */
+
+#include "prov_blob.h"
+#include "esp_log.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/md.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#define TAG "prov_blob"
+
+#define PROV_BLOB_NVS_NAMESPACE "wifi_prov"
+#define PROV_BLOB_NVS_KEY_SEQ   "blob_seq"
+
+/**
+ * @brief 比较MAC（耗时与内容无关，避免逐字节试探）
+ */
+static bool mac_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+static uint32_t blob_last_seq(void)
+{
+    uint32_t seq = 0;
+    nvs_handle_t nvs;
+    if (nvs_open(PROV_BLOB_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        nvs_get_u32(nvs, PROV_BLOB_NVS_KEY_SEQ, &seq);
+        nvs_close(nvs);
+    }
+    return seq;
+}
+
+esp_err_t prov_blob_parse(const uint8_t *blob, size_t len, prov_blob_creds_t *out)
+{
+    const char *key = CONFIG_WIFI_PROVISION_BLOB_KEY;
+    if (key[0] == 0)
+        return ESP_ERR_NOT_SUPPORTED;
+    if (blob == NULL || out == NULL || len < 3 + 4 + PROV_BLOB_MAC_LEN || len > PROV_BLOB_MAX_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+
+    // 逐个字段检查长度，任何一个越界都视为格式错误
+    size_t pos = 0;
+    if (blob[pos++] != PROV_BLOB_VERSION)
+        return ESP_ERR_INVALID_SIZE;
+    uint8_t ssid_len = blob[pos++];
+    if (ssid_len == 0 || ssid_len > 32 || pos + ssid_len + 1 > len)
+        return ESP_ERR_INVALID_SIZE;
+    const uint8_t *ssid = blob + pos;
+    pos += ssid_len;
+    uint8_t pw_len = blob[pos++];
+    if (pw_len > 64 || pos + pw_len + 4 + PROV_BLOB_MAC_LEN != len)
+        return ESP_ERR_INVALID_SIZE;
+    const uint8_t *password = blob + pos;
+    pos += pw_len;
+    uint32_t seq = blob[pos] | (blob[pos + 1] << 8) | (blob[pos + 2] << 16) | ((uint32_t)blob[pos + 3] << 24);
+    pos += 4;
+
+    uint8_t mac[32];
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const unsigned char *)key, strlen(key),
+                        blob, pos, mac) != 0)
+        return ESP_FAIL;
+    if (!mac_equal(mac, blob + pos, PROV_BLOB_MAC_LEN))
+    {
+        ESP_LOGW(TAG, "签名校验失败");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    uint32_t last = blob_last_seq();
+    if (seq < last)
+    {
+        ESP_LOGW(TAG, "拒绝旧数据 seq=%lu（已接受 %lu）", (unsigned long)seq, (unsigned long)last);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(out, 0, sizeof(*out));
+    memcpy(out->ssid, ssid, ssid_len);
+    memcpy(out->password, password, pw_len);
+    out->seq = seq;
+    return ESP_OK;
+}
+
+esp_err_t prov_blob_parse_base64(const char *text, size_t len, prov_blob_creds_t *out)
+{
+    uint8_t blob[PROV_BLOB_MAX_SIZE];
+    size_t blob_len = 0;
+    if (text == NULL ||
+        mbedtls_base64_decode(blob, sizeof(blob), &blob_len, (const unsigned char *)text, len) != 0)
+        return ESP_ERR_INVALID_SIZE;
+    return prov_blob_parse(blob, blob_len, out);
+}
+
+void prov_blob_accept(uint32_t seq)
+{
+    if (seq == blob_last_seq())
+        return;
+    nvs_handle_t nvs;
+    if (nvs_open(PROV_BLOB_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK)
+    {
+        nvs_set_u32(nvs, PROV_BLOB_NVS_KEY_SEQ, seq);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
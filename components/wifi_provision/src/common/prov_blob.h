@@ -0,0 +1,47 @@
+#ifndef _PROV_BLOB_H_
+#define _PROV_BLOB_H_
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 预签名配网数据（批量部署时由安装工具一次提交，跳过扫描和网页交互）
+ *
+ * 格式：[version:1][ssid_len:1][ssid][pw_len:1][password][seq:4 LE][mac:16]
+ * mac 为 HMAC-SHA256(CONFIG_WIFI_PROVISION_BLOB_KEY, 前面所有字节) 的前16字节。
+ *
+ * seq 由签发方递增，设备记录接受过的最大值，拒绝更小的 seq，
+ * 防止有人在热点上重放旧数据把设备切回以前的网络；相同 seq 可以重复提交。
+ */
+
+#define PROV_BLOB_VERSION 1
+#define PROV_BLOB_MAC_LEN 16
+
+/** 数据最大长度：头部 + 32字节SSID + 64字节密码 + seq + mac */
+#define PROV_BLOB_MAX_SIZE (3 + 32 + 64 + 4 + PROV_BLOB_MAC_LEN)
+
+typedef struct
+{
+    char ssid[33];
+    char password[65];
+    uint32_t seq;
+} prov_blob_creds_t;
+
+/**
+ * @brief 校验并解析配网数据
+ *
+ * @return ESP_OK 成功
+ *         ESP_ERR_NOT_SUPPORTED 未配置签名密钥
+ *         ESP_ERR_INVALID_SIZE 格式错误
+ *         ESP_ERR_INVALID_CRC 签名不匹配
+ *         ESP_ERR_INVALID_STATE seq 比已接受的旧（重放）
+ */
+esp_err_t prov_blob_parse(const uint8_t *blob, size_t len, prov_blob_creds_t *out);
+
+/** 解析 base64 编码的配网数据（WebSocket JSON 命令使用），返回值同 prov_blob_parse */
+esp_err_t prov_blob_parse_base64(const char *text, size_t len, prov_blob_creds_t *out);
+
+/** 记录已接受的 seq（写入NVS），之后更小的 seq 会被拒绝 */
+void prov_blob_accept(uint32_t seq);
+
+#endif
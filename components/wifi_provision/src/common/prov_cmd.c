@@ -0,0 +1,156 @@
+/**
+ * @file prov_cmd.c
+ * @brief WebSocket 命令分发 - 按 "cmd" 字段查表调用处理函数
+ *
+ * 【为什么要命令表？】
+ * 以前每条消息都完整 cJSON_Parse 一遍，再逐个 cJSON_GetObjectItem 试探 scan/ssid/password，
+ * 每加一个命令就多一次查找。现在消息只用 json_reader 扫描一遍顶层字段，
+ * 按 "cmd" 在有序表中二分查找，命令再多单条消息的开销也基本不变。
+ *
+ * 【处理函数拿到什么？】
+ * wifi_provision_msg_t 是解析结果的只读视图，字段按需读取，不复制、不建树，
+ * 只在处理函数执行期间有效（指向 WebSocket 接收缓冲区）。
+ */
+
+#include "prov_cmd.h"
+#include "json_reader.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "prov_cmd"
+
+struct wifi_provision_msg
+{
+    json_reader_t reader;
+};
+
+typedef struct
+{
+    const char *name;
+    wifi_provision_cmd_handler_t handler;
+} prov_cmd_entry_t;
+
+/** 命令表（按名称升序排列，注册时插入排序） */
+static prov_cmd_entry_t cmd_table[PROV_CMD_MAX];
+static int cmd_count = 0;
+static portMUX_TYPE cmd_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * 旧格式兼容：没有 "cmd" 字段时按特征键推断命令
+ * {"scan":"start"} / {"ssid":..,"password":..} / {"ack":"connected"}
+ */
+static const struct
+{
+    const char *key;
+    const char *cmd;
+} legacy_keys[] = {
+    {"scan", "scan"},
+    {"ssid", "connect"},
+    {"ack", "ack"},
+};
+
+static int cmd_compare(const void *key, const void *entry)
+{
+    return strcmp((const char *)key, ((const prov_cmd_entry_t *)entry)->name);
+}
+
+esp_err_t wifi_provision_register_command(const char *name, wifi_provision_cmd_handler_t handler)
+{
+    if (name == NULL || handler == NULL || strlen(name) == 0 || strlen(name) > PROV_CMD_NAME_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    taskENTER_CRITICAL(&cmd_lock);
+    int pos = 0;
+    while (pos < cmd_count && strcmp(cmd_table[pos].name, name) < 0)
+    {
+        pos++;
+    }
+    if (pos < cmd_count && strcmp(cmd_table[pos].name, name) == 0)
+    {
+        cmd_table[pos].handler = handler; // 同名命令覆盖（应用可以替换内置命令）
+    }
+    else if (cmd_count >= PROV_CMD_MAX)
+    {
+        ret = ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        memmove(&cmd_table[pos + 1], &cmd_table[pos], (cmd_count - pos) * sizeof(cmd_table[0]));
+        cmd_table[pos].name = name;
+        cmd_table[pos].handler = handler;
+        cmd_count++;
+    }
+    taskEXIT_CRITICAL(&cmd_lock);
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "命令表已满(%d)，无法注册: %s", PROV_CMD_MAX, name);
+    }
+    return ret;
+}
+
+esp_err_t prov_cmd_dispatch(const char *json, size_t len)
+{
+    wifi_provision_msg_t msg;
+    if (!json_reader_parse(&msg.reader, json, len))
+    {
+        ESP_LOGW(TAG, "无法解析的消息(%d字节)", (int)len);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char name[PROV_CMD_NAME_MAX + 1];
+    if (json_reader_get_string(&msg.reader, "cmd", name, sizeof(name)) < 0)
+    {
+        name[0] = '\0';
+        for (size_t i = 0; i < sizeof(legacy_keys) / sizeof(legacy_keys[0]); i++)
+        {
+            if (json_reader_find(&msg.reader, legacy_keys[i].key))
+            {
+                strcpy(name, legacy_keys[i].cmd);
+                break;
+            }
+        }
+    }
+
+    wifi_provision_cmd_handler_t handler = NULL;
+    taskENTER_CRITICAL(&cmd_lock);
+    const prov_cmd_entry_t *entry = bsearch(name, cmd_table, cmd_count, sizeof(cmd_table[0]), cmd_compare);
+    if (entry)
+    {
+        handler = entry->handler;
+    }
+    taskEXIT_CRITICAL(&cmd_lock);
+
+    if (handler == NULL)
+    {
+        ESP_LOGW(TAG, "未知命令: \"%s\"", name);
+        return ESP_ERR_NOT_FOUND;
+    }
+    handler(&msg);
+    return ESP_OK;
+}
+
+int wifi_provision_msg_get_string(const wifi_provision_msg_t *msg, const char *key, char *out, size_t out_len)
+{
+    return json_reader_get_string(&msg->reader, key, out, out_len);
+}
+
+bool wifi_provision_msg_get_int(const wifi_provision_msg_t *msg, const char *key, int32_t *out)
+{
+    return json_reader_get_int(&msg->reader, key, out);
+}
+
+bool wifi_provision_msg_get_bool(const wifi_provision_msg_t *msg, const char *key, bool *out)
+{
+    return json_reader_get_bool(&msg->reader, key, out);
+}
+
+bool wifi_provision_msg_has(const wifi_provision_msg_t *msg, const char *key)
+{
+    return json_reader_find(&msg->reader, key) != NULL;
+}
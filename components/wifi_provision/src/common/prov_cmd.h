@@ -0,0 +1,23 @@
+#ifndef _PROV_CMD_H_
+#define _PROV_CMD_H_
+#include "esp_err.h"
+#include "wifi_provision.h"
+#include <stddef.h>
+
+/** 命令表容量（内置命令 + 应用注册的命令） */
+#define PROV_CMD_MAX 16
+
+/** 命令名最大长度（不含结束符） */
+#define PROV_CMD_NAME_MAX 23
+
+/**
+ * @brief 解析一条 JSON 文本消息并分发给对应的命令处理函数
+ *
+ * 命令名取自 "cmd" 字段；没有 "cmd" 的旧格式消息按特征键推断（见 prov_cmd.c）。
+ *
+ * @return ESP_OK 已处理，ESP_ERR_INVALID_ARG 不是合法的 JSON 对象，
+ *         ESP_ERR_NOT_FOUND 没有对应的命令
+ */
+esp_err_t prov_cmd_dispatch(const char *json, size_t len);
+
+#endif
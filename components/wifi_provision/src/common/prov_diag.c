@@ -0,0 +1,150 @@
+/**
+ * @file prov_diag.c
+ * @brief 配网内存/栈诊断 - 按子系统统计堆用量和任务栈水位
+ *
+ * 【用途】
+ * 反复进入配网后堆不够用，是哪个模块占着不放？
+ * 各模块的动态分配通过PROV_MALLOC/PROV_FREE记账，这里统计每个子系统
+ * 的当前用量、峰值和本次会话的分配/释放次数，再加上系统剩余堆和
+ * 各任务栈的历史最小剩余，通过wifi_provision_get_diag()导出。
+ *
+ * 【开销】
+ * 开启时每块内存多8字节头部记录大小和子系统，记账在临界区内完成；
+ * 关闭CONFIG_WIFI_PROVISION_DIAG后宏直接展开为malloc/free（大块数据按PROV_BULK_RAW_MALLOC分配）。
+ */
+
+#include "prov_diag.h"
+#include "esp_system.h"
+#include <string.h>
+
+#if CONFIG_WIFI_PROVISION_DIAG
+
+/** 分配头部，8字节保证返回给调用者的指针仍然8字节对齐 */
+typedef struct
+{
+    uint32_t size;
+    uint32_t sub;
+} diag_hdr_t;
+
+static wifi_provision_mem_stats_t diag_mem[WIFI_PROVISION_MEM_MAX];
+static TaskHandle_t diag_tasks[WIFI_PROVISION_TASK_MAX];
+static uint32_t diag_sessions = 0;
+static uint32_t diag_httpd_heap = 0;
+static portMUX_TYPE diag_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void *prov_diag_malloc(wifi_provision_mem_subsys_t sub, size_t size, bool bulk)
+{
+    size_t total = sizeof(diag_hdr_t) + size;
+    diag_hdr_t *hdr = bulk ? PROV_BULK_RAW_MALLOC(total) : malloc(total);
+    if (hdr == NULL)
+        return NULL;
+    hdr->size = size;
+    hdr->sub = sub;
+
+    taskENTER_CRITICAL(&diag_lock);
+    wifi_provision_mem_stats_t *st = &diag_mem[sub];
+    st->current_bytes += size;
+    if (st->current_bytes > st->peak_bytes)
+        st->peak_bytes = st->current_bytes;
+    st->allocs++;
+    taskEXIT_CRITICAL(&diag_lock);
+    return hdr + 1;
+}
+
+void prov_diag_free(wifi_provision_mem_subsys_t sub, void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    diag_hdr_t *hdr = (diag_hdr_t *)ptr - 1;
+
+    // 以头部记录的子系统为准，调用者传错也不会把账记乱
+    taskENTER_CRITICAL(&diag_lock);
+    wifi_provision_mem_stats_t *st = &diag_mem[hdr->sub];
+    st->current_bytes -= hdr->size;
+    st->frees++;
+    taskEXIT_CRITICAL(&diag_lock);
+    free(hdr);
+}
+
+void prov_diag_session_reset(void)
+{
+    taskENTER_CRITICAL(&diag_lock);
+    for (int i = 0; i < WIFI_PROVISION_MEM_MAX; i++)
+    {
+        diag_mem[i].peak_bytes = diag_mem[i].current_bytes;
+        diag_mem[i].allocs = 0;
+        diag_mem[i].frees = 0;
+    }
+    diag_sessions++;
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+void prov_diag_set_task(wifi_provision_diag_task_t which, TaskHandle_t handle)
+{
+    taskENTER_CRITICAL(&diag_lock);
+    diag_tasks[which] = handle;
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+void prov_diag_set_httpd_heap(uint32_t bytes)
+{
+    diag_httpd_heap = bytes;
+}
+
+esp_err_t wifi_provision_get_diag(wifi_provision_diag_t *out)
+{
+    if (out == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(out, 0, sizeof(*out));
+    out->free_heap = esp_get_free_heap_size();
+    out->min_free_heap = esp_get_minimum_free_heap_size();
+    out->free_internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    out->min_free_internal = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    // 持锁读取水位，避免任务在两次读取之间注销后被删除
+    taskENTER_CRITICAL(&diag_lock);
+    memcpy(out->mem, diag_mem, sizeof(out->mem));
+    out->sessions = diag_sessions;
+    out->httpd_heap = diag_httpd_heap;
+    for (int i = 0; i < WIFI_PROVISION_TASK_MAX; i++)
+    {
+        if (diag_tasks[i])
+            out->stack_free[i] = uxTaskGetStackHighWaterMark(diag_tasks[i]);
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t wifi_provision_get_diag(wifi_provision_diag_t *out)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
+
+const char *wifi_provision_mem_subsys_name(wifi_provision_mem_subsys_t sub)
+{
+    static const char *const names[WIFI_PROVISION_MEM_MAX] = {
+        [WIFI_PROVISION_MEM_WS_SERVER] = "ws_server",
+        [WIFI_PROVISION_MEM_WIFI_MANAGER] = "wifi_manager",
+        [WIFI_PROVISION_MEM_PROVISION] = "wifi_provision",
+    };
+    if (sub < 0 || sub >= WIFI_PROVISION_MEM_MAX)
+        return "unknown";
+    return names[sub];
+}
+
+const char *wifi_provision_diag_task_name(wifi_provision_diag_task_t task)
+{
+    static const char *const names[WIFI_PROVISION_TASK_MAX] = {
+        [WIFI_PROVISION_TASK_PROV] = "prov_task",
+        [WIFI_PROVISION_TASK_WIFI] = "wifi_mgr",
+        [WIFI_PROVISION_TASK_HTTPD] = "httpd",
+    };
+    if (task < 0 || task >= WIFI_PROVISION_TASK_MAX)
+        return "unknown";
+    return names[task];
+}
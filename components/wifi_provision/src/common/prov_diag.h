@@ -0,0 +1,56 @@
+#ifndef _PROV_DIAG_H_
+#define _PROV_DIAG_H_
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "wifi_provision.h"
+#include <stdlib.h>
+
+/**
+ * 大块数据（扫描结果、JSON输出、WebSocket接收缓冲）的存放位置
+ *
+ * 开启CONFIG_WIFI_PROVISION_BUFFERS_IN_PSRAM时优先从PSRAM分配，不够再用内部RAM；
+ * 静态缓冲区用PROV_BULK_BSS标记，SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY开启时链接到PSRAM。
+ * 释放统一用free()/PROV_FREE。
+ */
+#if CONFIG_WIFI_PROVISION_BUFFERS_IN_PSRAM
+#define PROV_BULK_RAW_MALLOC(size) \
+    heap_caps_malloc_prefer(size, 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define PROV_BULK_BSS EXT_RAM_BSS_ATTR
+#else
+#define PROV_BULK_RAW_MALLOC(size) malloc(size)
+#define PROV_BULK_BSS
+#endif
+
+#if CONFIG_WIFI_PROVISION_DIAG
+/** @param bulk true 按大块数据分配（见PROV_BULK_RAW_MALLOC） */
+void *prov_diag_malloc(wifi_provision_mem_subsys_t sub, size_t size, bool bulk);
+void prov_diag_free(wifi_provision_mem_subsys_t sub, void *ptr);
+
+/** 开始新的配网会话：清零分配计数，峰值从当前用量重新统计 */
+void prov_diag_session_reset(void);
+
+/** 登记/注销任务（NULL表示任务已退出），任务删除前必须注销 */
+void prov_diag_set_task(wifi_provision_diag_task_t which, TaskHandle_t handle);
+
+/** 记录httpd_start消耗的堆（服务器内部分配无法逐个统计） */
+void prov_diag_set_httpd_heap(uint32_t bytes);
+
+#define PROV_MALLOC(sub, size)        prov_diag_malloc(sub, size, false)
+#define PROV_MALLOC_BULK(sub, size)   prov_diag_malloc(sub, size, true)
+#define PROV_FREE(sub, ptr)           prov_diag_free(sub, ptr)
+#define PROV_DIAG_SESSION_RESET()     prov_diag_session_reset()
+#define PROV_DIAG_SET_TASK(which, h)  prov_diag_set_task(which, h)
+#define PROV_DIAG_SET_HTTPD_HEAP(n)   prov_diag_set_httpd_heap(n)
+#else
+#define PROV_MALLOC(sub, size)        malloc(size)
+#define PROV_MALLOC_BULK(sub, size)   PROV_BULK_RAW_MALLOC(size)
+#define PROV_FREE(sub, ptr)           free(ptr)
+#define PROV_DIAG_SESSION_RESET()     ((void)0)
+#define PROV_DIAG_SET_TASK(which, h)  ((void)0)
+#define PROV_DIAG_SET_HTTPD_HEAP(n)   ((void)0)
+#endif
+
+#endif
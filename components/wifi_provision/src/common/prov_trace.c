@@ -0,0 +1,115 @@
+/**
+ * @file prov_trace.c
+ * @brief 配网耗时追踪 - 记录关键步骤的时间戳
+ *
+ * 【用途】
+ * 从按键进入配网到网页显示"已连接"，时间花在哪一步？
+ * 各模块在关键位置调用PROV_TRACE(point)，这里用esp_timer记录时间戳，
+ * 通过wifi_provision_get_timeline()导出，用于对比不同固件版本和射频环境。
+ *
+ * 首次进入配网前时间零点为上电时刻，因此开机快速重连的关联/获取IP耗时也会被记录。
+ *
+ * 【开销】
+ * 每次记录只是一次esp_timer_get_time()加环形缓冲区写入；
+ * 关闭CONFIG_WIFI_PROVISION_TRACE后所有追踪点编译为空。
+ */
+
+#include "prov_trace.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#if CONFIG_WIFI_PROVISION_TRACE
+
+static wifi_provision_trace_event_t trace_ring[PROV_TRACE_RING_SIZE];
+static int trace_head = 0;             // 最旧事件的位置
+static int trace_count = 0;            // 有效事件数
+static int64_t trace_origin_us = 0;    // 本次会话的零点
+static uint32_t trace_seen = 0;        // 已记录过的时间点（用于record_once）
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void prov_trace_reset(void)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&trace_lock);
+    trace_head = 0;
+    trace_count = 0;
+    trace_seen = 0;
+    trace_origin_us = now;
+    taskEXIT_CRITICAL(&trace_lock);
+}
+
+/**
+ * @brief 写入环形缓冲区，写满后覆盖最旧的事件
+ */
+static void trace_push(wifi_provision_trace_point_t point, int64_t now, bool once)
+{
+    taskENTER_CRITICAL(&trace_lock);
+    uint32_t bit = 1u << point;
+    if (!(once && (trace_seen & bit)))
+    {
+        trace_seen |= bit;
+        int idx = (trace_head + trace_count) % PROV_TRACE_RING_SIZE;
+        if (trace_count == PROV_TRACE_RING_SIZE)
+            trace_head = (trace_head + 1) % PROV_TRACE_RING_SIZE;
+        else
+            trace_count++;
+        trace_ring[idx].point = point;
+        trace_ring[idx].time_us = now - trace_origin_us;
+    }
+    taskEXIT_CRITICAL(&trace_lock);
+}
+
+void prov_trace_record(wifi_provision_trace_point_t point)
+{
+    trace_push(point, esp_timer_get_time(), false);
+}
+
+void prov_trace_record_once(wifi_provision_trace_point_t point)
+{
+    trace_push(point, esp_timer_get_time(), true);
+}
+
+size_t wifi_provision_get_timeline(wifi_provision_trace_event_t *events, size_t max_events)
+{
+    if (events == NULL)
+        return 0;
+
+    size_t n = 0;
+    taskENTER_CRITICAL(&trace_lock);
+    for (int i = 0; i < trace_count && n < max_events; i++)
+        events[n++] = trace_ring[(trace_head + i) % PROV_TRACE_RING_SIZE];
+    taskEXIT_CRITICAL(&trace_lock);
+    return n;
+}
+
+#else
+
+size_t wifi_provision_get_timeline(wifi_provision_trace_event_t *events, size_t max_events)
+{
+    return 0;
+}
+
+#endif
+
+const char *wifi_provision_trace_point_name(wifi_provision_trace_point_t point)
+{
+    static const char *const names[WIFI_PROVISION_TRACE_MAX] = {
+        [WIFI_PROVISION_TRACE_APCFG_START] = "apcfg_start",
+        [WIFI_PROVISION_TRACE_AP_START] = "ap_start",
+        [WIFI_PROVISION_TRACE_HTTPD_START] = "httpd_start",
+        [WIFI_PROVISION_TRACE_PAGE_REQUEST] = "page_request",
+        [WIFI_PROVISION_TRACE_WS_HANDSHAKE] = "ws_handshake",
+        [WIFI_PROVISION_TRACE_SCAN_START] = "scan_start",
+        [WIFI_PROVISION_TRACE_SCAN_FIRST_BATCH] = "scan_first_batch",
+        [WIFI_PROVISION_TRACE_SCAN_END] = "scan_end",
+        [WIFI_PROVISION_TRACE_CREDENTIALS] = "credentials",
+        [WIFI_PROVISION_TRACE_STA_ASSOCIATED] = "sta_associated",
+        [WIFI_PROVISION_TRACE_DHCP_DONE] = "dhcp_done",
+        [WIFI_PROVISION_TRACE_STATUS_SENT] = "status_sent",
+        [WIFI_PROVISION_TRACE_STATUS_ACKED] = "status_acked",
+        [WIFI_PROVISION_TRACE_AP_TEARDOWN] = "ap_teardown",
+    };
+    if (point < 0 || point >= WIFI_PROVISION_TRACE_MAX || names[point] == NULL)
+        return "unknown";
+    return names[point];
+}
@@ -0,0 +1,28 @@
+#ifndef _PROV_TRACE_H_
+#define _PROV_TRACE_H_
+#include "sdkconfig.h"
+#include "wifi_provision.h"
+
+/** 时间线环形缓冲区容量（事件数） */
+#define PROV_TRACE_RING_SIZE 32
+
+#if CONFIG_WIFI_PROVISION_TRACE
+/** 开始新的配网会话：清空时间线，之后的时间以此刻为零点 */
+void prov_trace_reset(void);
+
+/** 记录一个时间点 */
+void prov_trace_record(wifi_provision_trace_point_t point);
+
+/** 记录一个时间点（每个会话只记录第一次） */
+void prov_trace_record_once(wifi_provision_trace_point_t point);
+
+#define PROV_TRACE_RESET()       prov_trace_reset()
+#define PROV_TRACE(point)        prov_trace_record(point)
+#define PROV_TRACE_ONCE(point)   prov_trace_record_once(point)
+#else
+#define PROV_TRACE_RESET()       ((void)0)
+#define PROV_TRACE(point)        ((void)0)
+#define PROV_TRACE_ONCE(point)   ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * @file scan_topn.c
+ * @brief 扫描结果前N名选择（见 scan_topn.h）
+ *
+ * 【为什么在设备上选？】
+ * 写字楼里一次扫描能看到上百个BSSID，全部发给网页既占WebSocket带宽，
+ * 又让手机每批都重新合并排序整个列表。用户只会在信号最强的几个网络里选，
+ * 所以设备上只保留前N名，每批发出的都是排好序的完整列表。
+ *
+ * 【复杂度】
+ * 每条记录先线性查找同名SSID（N很小，比哈希表省内存），
+ * 再按最小堆替换最弱的一个：O(N + log N)。
+ */
+
+#include "scan_topn.h"
+#include <stdlib.h>
+#include <string.h>
+
+static bool ssid_equal(const uint8_t *a, const uint8_t *b)
+{
+    return strncmp((const char *)a, (const char *)b, 32) == 0;
+}
+
+static void heap_swap(wifi_ap_record_t *h, int a, int b)
+{
+    wifi_ap_record_t tmp = h[a];
+    h[a] = h[b];
+    h[b] = tmp;
+}
+
+static void sift_up(scan_topn_t *t, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (t->heap[parent].rssi <= t->heap[i].rssi)
+            break;
+        heap_swap(t->heap, parent, i);
+        i = parent;
+    }
+}
+
+static void sift_down(scan_topn_t *t, int i)
+{
+    for (;;)
+    {
+        int min = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+        if (l < t->count && t->heap[l].rssi < t->heap[min].rssi)
+            min = l;
+        if (r < t->count && t->heap[r].rssi < t->heap[min].rssi)
+            min = r;
+        if (min == i)
+            return;
+        heap_swap(t->heap, min, i);
+        i = min;
+    }
+}
+
+void scan_topn_init(scan_topn_t *t, wifi_ap_record_t *buf, int cap)
+{
+    t->heap = buf;
+    t->cap = cap;
+    t->count = 0;
+}
+
+void scan_topn_reset(scan_topn_t *t)
+{
+    t->count = 0;
+}
+
+bool scan_topn_add(scan_topn_t *t, const wifi_ap_record_t *ap, int n)
+{
+    bool changed = false;
+    for (int i = 0; i < n; i++)
+    {
+        if (ap[i].ssid[0] == 0)
+            continue; // 隐藏网络，用户无法从列表中选择
+
+        int j = 0;
+        while (j < t->count && !ssid_equal(t->heap[j].ssid, ap[i].ssid))
+            j++;
+
+        if (j < t->count)
+        {
+            // 同一网络的另一个BSSID：信号变强，在最小堆中向下沉
+            if (ap[i].rssi > t->heap[j].rssi)
+            {
+                t->heap[j] = ap[i];
+                sift_down(t, j);
+                changed = true;
+            }
+        }
+        else if (t->count < t->cap)
+        {
+            t->heap[t->count] = ap[i];
+            sift_up(t, t->count);
+            t->count++;
+            changed = true;
+        }
+        else if (t->cap > 0 && ap[i].rssi > t->heap[0].rssi)
+        {
+            t->heap[0] = ap[i];
+            sift_down(t, 0);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static int rssi_desc(const void *a, const void *b)
+{
+    return ((const wifi_ap_record_t *)b)->rssi - ((const wifi_ap_record_t *)a)->rssi;
+}
+
+int scan_topn_sorted(const scan_topn_t *t, wifi_ap_record_t *out)
+{
+    memcpy(out, t->heap, t->count * sizeof(wifi_ap_record_t));
+    qsort(out, t->count, sizeof(wifi_ap_record_t), rssi_desc);
+    return t->count;
+}
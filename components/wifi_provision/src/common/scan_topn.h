@@ -0,0 +1,38 @@
+#ifndef _SCAN_TOPN_H_
+#define _SCAN_TOPN_H_
+#include "esp_wifi.h"
+#include <stdbool.h>
+
+/**
+ * 扫描结果的前N名选择
+ *
+ * 按SSID去重（保留信号最强的BSSID），丢弃隐藏网络，用固定大小的最小堆
+ * 保留信号最强的N个。周围有几百个热点时占用的内存和输出长度也不变。
+ */
+typedef struct
+{
+    wifi_ap_record_t *heap; // 最小堆，heap[0]是保留的热点中信号最弱的
+    int cap;
+    int count;
+} scan_topn_t;
+
+/** @param buf 调用者提供的存储，至少cap个记录 */
+void scan_topn_init(scan_topn_t *t, wifi_ap_record_t *buf, int cap);
+
+/** 开始新一次扫描 */
+void scan_topn_reset(scan_topn_t *t);
+
+/**
+ * @brief 合并一批扫描记录，可以对多批结果重复调用
+ * @return 保留的集合或其中的信号强度有变化
+ */
+bool scan_topn_add(scan_topn_t *t, const wifi_ap_record_t *ap, int n);
+
+/**
+ * @brief 按信号从强到弱输出当前结果（不改变堆）
+ * @param out 至少cap个记录
+ * @return 输出的记录数
+ */
+int scan_topn_sorted(const scan_topn_t *t, wifi_ap_record_t *out);
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * @file dns_server.c
+ * @brief 强制门户DNS服务器 - 让手机连上热点后立即弹出配网页面
+ *
+ * 【为什么需要？】
+ * 手机连上WiFi后会访问固定的检测地址（如connectivitycheck.gstatic.com/generate_204、
+ * captive.apple.com/hotspot-detect.html），返回结果不对就认为是"需要登录的网络"，
+ * 自动弹出登录页面。热点上没有DNS服务时这些域名解析失败，手机只会提示"无互联网连接"，
+ * 用户还要手动打开浏览器输入192.168.100.1。
+ *
+ * 【工作方式】
+ * 监听UDP 53端口，对任何域名的A记录查询都应答热点IP；AAAA等其他类型回复"无记录"，
+ * 让手机尽快退回IPv4。HTTP请求到达后由ws_server的通配路由重定向到配网页面。
+ *
+ * 【报文格式（RFC 1035）】
+ * [头部12字节][问题：域名标签序列 + 类型2字节 + 类2字节][回答...]
+ * 应答直接在请求报文上修改：保留头部和第一个问题，丢弃附加记录（如EDNS），追加一条回答。
+ */
+
+#include "dns_server.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
+
+#define TAG "dns_server"
+
+#define DNS_PORT        53
+#define DNS_MAX_PACKET  512 // 不支持EDNS时UDP报文的上限
+#define DNS_HEADER_SIZE 12
+#define DNS_ANSWER_SIZE 16 // 名称指针2 + 类型2 + 类2 + TTL4 + 长度2 + 地址4
+
+#define DNS_FLAG_QR     0x8000 // 应答
+#define DNS_FLAG_OPCODE 0x7800 // 操作码，0为标准查询
+#define DNS_FLAG_RD     0x0100 // 期望递归（原样带回）
+#define DNS_FLAG_RA     0x0080 // 支持递归
+#define DNS_RCODE_NOTIMP 4
+
+#define DNS_TYPE_A   1
+#define DNS_TYPE_ANY 255
+#define DNS_CLASS_IN 1
+
+/** 应答地址（网络字节序） */
+static uint32_t dns_answer_ip = 0;
+
+/** 运行标志：清零后任务在下一次接收超时时退出 */
+static volatile bool dns_running = false;
+
+/** 任务句柄：任务确认退出（socket已关闭）后才清空，停止超时时保留 */
+static TaskHandle_t dns_task_handle = NULL;
+
+/** 任务退出时释放，stop等待它以确保socket已关闭、端口可以再次绑定 */
+static SemaphoreHandle_t dns_done_sem = NULL;
+static StaticSemaphore_t dns_done_sem_buf;
+
+static uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void wr16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+/**
+ * @brief 跳过问题中的域名，返回类型字段的偏移，格式错误返回-1
+ *
+ * 查询中的域名不会使用压缩指针，遇到指针按格式错误处理
+ */
+static int dns_skip_name(const uint8_t *pkt, int len, int off)
+{
+    while (off < len)
+    {
+        uint8_t label = pkt[off];
+        if (label == 0)
+            return off + 1;
+        if (label & 0xC0)
+            return -1;
+        off += 1 + label;
+    }
+    return -1;
+}
+
+/**
+ * @brief 在请求报文上就地构造应答
+ * @return 应答长度，0表示不应答（不是查询或格式错误）
+ */
+static int dns_build_reply(uint8_t *pkt, int len)
+{
+    if (len < DNS_HEADER_SIZE)
+        return 0;
+    uint16_t flags = rd16(pkt + 2);
+    if (flags & DNS_FLAG_QR)
+        return 0; // 不处理其他服务器发来的应答
+
+    uint16_t reply_flags = DNS_FLAG_QR | DNS_FLAG_RA | (flags & (DNS_FLAG_OPCODE | DNS_FLAG_RD));
+    if ((flags & DNS_FLAG_OPCODE) != 0 || rd16(pkt + 4) == 0)
+    {
+        // 非标准查询：只回头部
+        wr16(pkt + 2, reply_flags | DNS_RCODE_NOTIMP);
+        memset(pkt + 4, 0, 8);
+        return DNS_HEADER_SIZE;
+    }
+
+    int qtype_off = dns_skip_name(pkt, len, DNS_HEADER_SIZE);
+    if (qtype_off < 0 || qtype_off + 4 > len)
+        return 0;
+    uint16_t qtype = rd16(pkt + qtype_off);
+    uint16_t qclass = rd16(pkt + qtype_off + 2);
+    int end = qtype_off + 4;
+
+    wr16(pkt + 2, reply_flags);
+    wr16(pkt + 4, 1); // 只回答第一个问题
+    wr16(pkt + 6, 0);
+    wr16(pkt + 8, 0);
+    wr16(pkt + 10, 0);
+
+    if ((qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY) && qclass == DNS_CLASS_IN &&
+        end + DNS_ANSWER_SIZE <= DNS_MAX_PACKET)
+    {
+        uint8_t *a = pkt + end;
+        wr16(a, 0xC000 | DNS_HEADER_SIZE); // 指向问题中的域名
+        wr16(a + 2, DNS_TYPE_A);
+        wr16(a + 4, DNS_CLASS_IN);
+        wr16(a + 6, 0);
+        wr16(a + 8, DNS_SERVER_TTL_S);
+        wr16(a + 10, 4);
+        memcpy(a + 12, &dns_answer_ip, 4);
+        wr16(pkt + 6, 1);
+        end += DNS_ANSWER_SIZE;
+    }
+    return end;
+}
+
+static void dns_task(void *arg)
+{
+    int sock = (int)(intptr_t)arg;
+    uint8_t pkt[DNS_MAX_PACKET];
+
+    while (dns_running)
+    {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&from, &from_len);
+        if (len <= 0)
+            continue; // 超时，回去检查运行标志
+
+        int reply_len = dns_build_reply(pkt, len);
+        if (reply_len > 0)
+        {
+            sendto(sock, pkt, reply_len, 0, (struct sockaddr *)&from, from_len);
+        }
+    }
+
+    close(sock);
+    xSemaphoreGive(dns_done_sem);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 等待DNS任务退出
+ *
+ * @return ESP_OK 已退出（socket已关闭），ESP_ERR_TIMEOUT 任务还在运行
+ */
+static esp_err_t dns_wait_exit(void)
+{
+    if (xSemaphoreTake(dns_done_sem, pdMS_TO_TICKS(DNS_SERVER_STOP_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+    dns_task_handle = NULL;
+    return ESP_OK;
+}
+
+esp_err_t dns_server_start(const char *ip)
+{
+    if (dns_task_handle != NULL)
+    {
+        if (dns_running)
+            return ESP_OK;
+        // 上一次停止超时，任务可能还占着53端口：再等一次
+        if (dns_wait_exit() != ESP_OK)
+        {
+            ESP_LOGE(TAG, "上一个DNS任务还没有退出");
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    struct in_addr addr;
+    if (ip == NULL || inet_aton(ip, &addr) == 0)
+        return ESP_ERR_INVALID_ARG;
+    dns_answer_ip = addr.s_addr;
+
+    if (dns_done_sem == NULL)
+    {
+        dns_done_sem = xSemaphoreCreateBinaryStatic(&dns_done_sem_buf);
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "创建socket失败");
+        return ESP_FAIL;
+    }
+
+    struct sockaddr_in bind_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = DNS_SERVER_STOP_TIMEOUT_MS * 1000 / 2,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0)
+    {
+        ESP_LOGE(TAG, "绑定端口%d失败", DNS_PORT);
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    dns_running = true;
+    if (xTaskCreate(dns_task, "prov_dns", DNS_SERVER_TASK_STACK_SIZE, (void *)(intptr_t)sock,
+                    DNS_SERVER_TASK_PRIORITY, &dns_task_handle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "创建DNS任务失败");
+        dns_running = false;
+        dns_task_handle = NULL;
+        close(sock);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "强制门户DNS已启动，所有域名解析为 %s", ip);
+    return ESP_OK;
+}
+
+esp_err_t dns_server_stop(void)
+{
+    if (dns_task_handle == NULL)
+        return ESP_OK;
+    dns_running = false;
+    if (dns_wait_exit() != ESP_OK)
+    {
+        // 保留句柄：下一次启动或停止会继续等待，不会在端口还被占用时重新绑定
+        ESP_LOGE(TAG, "等待DNS任务退出超时");
+        return ESP_ERR_TIMEOUT;
+    }
+    ESP_LOGI(TAG, "强制门户DNS已停止");
+    return ESP_OK;
+}
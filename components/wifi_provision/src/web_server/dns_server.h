@@ -0,0 +1,29 @@
+#ifndef _DNS_SERVER_H_
+#define _DNS_SERVER_H_
+#include "esp_err.h"
+
+/** DNS应答使用的TTL（秒），配网结束后手机很快就会忘掉这个假地址 */
+#define DNS_SERVER_TTL_S 10
+
+/** DNS任务的栈大小（字节）和优先级 */
+#define DNS_SERVER_TASK_STACK_SIZE 3072
+#define DNS_SERVER_TASK_PRIORITY   4
+
+/** 等待DNS任务退出的最长时间（毫秒），也是任务检查停止标志的间隔 */
+#define DNS_SERVER_STOP_TIMEOUT_MS 500
+
+/**
+ * @brief 启动强制门户DNS服务器：热点上所有A记录查询都应答为ip
+ * @param ip 点分十进制IPv4地址（热点地址）
+ * @return ESP_OK成功（已在运行也返回成功），ESP_ERR_INVALID_ARG地址无效，ESP_FAIL创建socket/任务失败，
+ *         ESP_ERR_INVALID_STATE上一次停止的任务还没有退出
+ */
+esp_err_t dns_server_start(const char *ip);
+
+/**
+ * @brief 停止DNS服务器（未运行时什么也不做）
+ * @return ESP_OK已停止并关闭socket，ESP_ERR_TIMEOUT任务没有按时退出（下一次启动/停止时继续等待）
+ */
+esp_err_t dns_server_stop(void);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _WEB_ASSETS_H_
+#define _WEB_ASSETS_H_
+#include "ws_server.h"
+
+/**
+ * 编译期网页资源表，由tools/web_assets.py根据html/目录生成（web_assets.c在构建目录中）
+ * 第一项是首页"/"，其余资源的引用地址带有内容哈希
+ */
+extern const ws_server_asset_t web_assets[];
+extern const size_t web_assets_count;
+
+#endif
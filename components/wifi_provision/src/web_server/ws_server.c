@@ -3,9 +3,10 @@
  * @brief WebSocket服务器模块 - 提供HTTP+WebSocket服务
  *
  * 【模块功能】
- * 1. 提供HTTP服务（根路径"/"返回配网HTML页面）
+ * 1. 提供HTTP服务（从编译期资源表返回配网页面及其css/js）
  * 2. 提供WebSocket服务（"/ws"端点用于双向通信）
- * 3. 支持服务器主动推送消息到浏览器
+ * 3. 支持服务器主动推送消息到浏览器（同步广播或异步队列发送）
+ * 4. 强制门户：其他路径重定向到配网页面（配合dns_server使用）
  *
  * 【HTTP与WebSocket的区别】
  * HTTP:      请求-响应模式，客户端发请求，服务器返回响应，然后连接关闭
@@ -19,11 +20,19 @@
  */
 
 #include "ws_server.h"
+#include "prov_diag.h"
+#include "prov_trace.h"
 #include "esp_err.h"
 #include "esp_http_server.h" // ESP-IDF HTTP服务器API
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "soc/gpio_sig_map.h"
 #include "string.h"
+#include <freertos/FreeRTOS.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #define TAG "ws_server"
 
@@ -31,52 +40,495 @@
  *                           模块静态变量
  *============================================================================*/
 
-/** 配网HTML页面内容指针（来自SPIFFS） */
-static const char *http_html = NULL;
+/**
+ * 静态资源表（编译期生成，指针在服务器运行期间一直有效）
+ *
+ * 【缓存策略】
+ * 每个资源带预先算好的ETag，请求头If-None-Match一致时只回304；
+ * 首页以外的资源地址带版本号，可以长期缓存，再次打开配网页时几乎不用传输数据
+ */
+static const ws_server_asset_t *http_assets = NULL;
+static size_t http_asset_count = 0;
 
 /** WebSocket消息接收回调函数 */
 static ws_server_receive_cb ws_server_cb = NULL;
 
+/** POST /provision 回调函数 */
+static ws_server_post_cb ws_server_post_fn = NULL;
+
+/** 强制门户重定向地址（"http://<热点IP>/"），为空表示未启用 */
+static char ws_portal_location[32] = {0};
+
 /** HTTP服务器句柄（用于停止服务器） */
 static httpd_handle_t server_handle = NULL;
 
 /**
- * WebSocket客户端的socket描述符
+ * WebSocket接收缓冲区（服务器启动时一次性分配，停止时释放）
  *
- * 【为什么需要保存socket_fd？】
+ * 【为什么不用每帧malloc？】
+ * 反复打开配网时每帧malloc/free会造成堆碎片；客户端还可以声明
+ * 一个巨大的帧长度让设备分配内存失败。
+ * 所有URI处理函数都在同一个httpd任务中串行执行，
+ * 因此一个容量为max_frame_size的缓冲区就足够所有会话共用。
+ */
+static uint8_t *ws_rx_buf = NULL;
+static size_t ws_rx_max = 0; // 允许的最大帧长度（不含结束符）
+
+/**
+ * WebSocket会话表（按socket描述符索引）
+ *
+ * 【为什么需要会话表？】
  * WebSocket连接建立后，服务器想主动推送消息时
- * 需要知道发到哪个socket。这个值在WebSocket握手时获取。
+ * 需要知道发到哪个socket。热点最多允许4台手机连接，
+ * 每个客户端的socket都要记录下来，广播时逐个发送。
  *
  * 【socket描述符】
  * 操作系统分配的整数，代表一个网络连接
  * 类似于文件句柄，用于读写网络数据
+ *
+ * 【帧类型协商】
+ * 会话默认使用文本帧（浏览器JSON）；客户端发来二进制帧后该会话切换为二进制协议，
+ * 之后只接收二进制帧，反之亦然。广播时按帧类型只发给对应的会话。
+ *
+ * 【线程安全】
+ * 握手和关闭回调运行在httpd任务中，而广播由扫描任务、配网任务调用，
+ * 因此读写会话表都在临界区内完成，发送前先拷贝一份快照
+ *
+ * 【掉线检测】
+ * 手机信号差或直接离开热点时不会发送CLOSE，TCP连接要很久才超时，
+ * 会话一直占着表项和httpd的socket，发给它的数据还会卡住httpd任务。
+ * 因此定时向每个会话发送PING，超过ping_timeout没有收到任何帧（浏览器自动回复PONG）
+ * 就关闭它；发送失败的会话也立即关闭。
+ */
+typedef struct
+{
+    int fd;             // socket描述符，-1表示空闲
+    bool binary;        // 是否使用二进制协议
+    int64_t last_rx_us; // 最近一次收到该会话的帧（含PONG）的时间
+} ws_session_t;
+
+static ws_session_t ws_sessions[WS_SERVER_MAX_CLIENTS];
+static portMUX_TYPE ws_sessions_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** 保活定时器（esp_timer任务中只投递工作，PING在httpd任务中发送） */
+static esp_timer_handle_t ws_ping_timer = NULL;
+static int64_t ws_ping_timeout_us = 0;
+static bool ws_ping_scheduled = false; // 是否已向httpd投递了保活工作（ws_sessions_lock保护）
+
+/**
+ * 最近一次HTTP/WebSocket请求的时间（微秒）
+ *
+ * 上层据此判断配网页面是否无人使用、何时关闭热点。
+ * 64位变量在32位CPU上不能原子读写，和会话表共用ws_sessions_lock。
  */
-static int socket_fd = -1;
+static int64_t ws_last_activity_us = 0;
+
+/**
+ * 异步发送队列（环形缓冲区）
+ *
+ * 【为什么需要异步发送？】
+ * httpd_ws_send_data会阻塞调用者直到数据写入socket，
+ * 手机信号差时扫描任务、配网任务都会被卡住。
+ * 异步模式下生产者只把数据拷贝进队列就返回，
+ * 真正的发送通过httpd_queue_work交给httpd任务完成。
+ *
+ * 【队列策略】
+ * - 合并：coalesce_key和帧类型都相同的待发送帧只保留最新的一条（如新状态替换旧状态）
+ * - 满队列：丢弃最旧的一帧，保证新数据能进入队列
+ */
+typedef struct
+{
+    uint8_t *payload;               // 数据拷贝（队列持有，发送后释放）
+    size_t len;                     // 数据长度
+    uint8_t coalesce_key;           // 合并键，0表示不合并
+    ws_server_frame_type_t type;    // 帧类型（决定发给哪些会话）
+    ws_server_send_done_cb done_cb; // 发送完成回调
+    void *done_arg;                 // 回调参数
+} ws_tx_frame_t;
+
+static ws_tx_frame_t ws_tx_queue[WS_SERVER_TX_QUEUE_LEN];
+static int ws_tx_head = 0;           // 队头（最旧的帧）
+static int ws_tx_count = 0;          // 队列中帧数量
+static bool ws_tx_scheduled = false; // 是否已向httpd投递了发送工作
+static bool ws_tx_open = false;      // 是否接受新的帧（开始停止服务器时清除）
+static portMUX_TYPE ws_tx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/*============================================================================
+ *                           会话表管理
+ *============================================================================*/
+
+/**
+ * @brief 清空会话表
+ */
+static void ws_session_reset(void)
+{
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    for (int i = 0; i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        ws_sessions[i].fd = -1;
+    }
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+}
+
+/**
+ * @brief 登记新的WebSocket会话
+ *
+ * 会话表已满时顶替最久没有收到数据的会话：手机Wi-Fi不稳定反复重连时，
+ * 旧连接往往已经失效，新连接不应因此被拒绝
+ *
+ * @param evicted 输出被顶替的会话fd，没有顶替时为-1（调用者负责关闭它）
+ * @return ESP_OK 成功
+ */
+static esp_err_t ws_session_add(int fd, int *evicted)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    int64_t now = esp_timer_get_time();
+    *evicted = -1;
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    // 同一个fd重复握手时不重复登记
+    for (int i = 0; i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        if (ws_sessions[i].fd == fd)
+        {
+            ret = ESP_OK;
+            break;
+        }
+    }
+    for (int i = 0; ret != ESP_OK && i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        if (ws_sessions[i].fd < 0)
+        {
+            ws_sessions[i].fd = fd;
+            ws_sessions[i].binary = false;
+            ws_sessions[i].last_rx_us = now;
+            ret = ESP_OK;
+        }
+    }
+    if (ret != ESP_OK)
+    {
+        int oldest = 0;
+        for (int i = 1; i < WS_SERVER_MAX_CLIENTS; i++)
+        {
+            if (ws_sessions[i].last_rx_us < ws_sessions[oldest].last_rx_us)
+                oldest = i;
+        }
+        *evicted = ws_sessions[oldest].fd;
+        ws_sessions[oldest].fd = fd;
+        ws_sessions[oldest].binary = false;
+        ws_sessions[oldest].last_rx_us = now;
+        ret = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+    return ret;
+}
+
+/**
+ * @brief 记录收到会话的一帧
+ */
+static void ws_session_seen(int fd)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    for (int i = 0; i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        if (ws_sessions[i].fd == fd)
+            ws_sessions[i].last_rx_us = now;
+    }
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+}
+
+/**
+ * @brief 从会话表中移除会话（fd不在表中时什么也不做）
+ */
+static void ws_session_remove(int fd)
+{
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    for (int i = 0; i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        if (ws_sessions[i].fd == fd)
+        {
+            ws_sessions[i].fd = -1;
+        }
+    }
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+}
+
+/**
+ * @brief 设置会话使用的帧类型（跟随客户端最近一次发来的数据帧）
+ */
+static void ws_session_set_type(int fd, ws_server_frame_type_t type)
+{
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    for (int i = 0; i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        if (ws_sessions[i].fd == fd)
+        {
+            ws_sessions[i].binary = (type == WS_SERVER_FRAME_BINARY);
+        }
+    }
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+}
+
+/**
+ * @brief 拷贝当前有效会话的fd
+ *
+ * @param fds  输出数组，至少WS_SERVER_MAX_CLIENTS个元素
+ * @param type 只拷贝使用该帧类型的会话，传-1表示全部
+ * @return 会话数量
+ */
+static int ws_session_snapshot(int *fds, int type)
+{
+    int count = 0;
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    for (int i = 0; i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        if (ws_sessions[i].fd >= 0 &&
+            (type < 0 || ws_sessions[i].binary == (type == WS_SERVER_FRAME_BINARY)))
+        {
+            fds[count++] = ws_sessions[i].fd;
+        }
+    }
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+    return count;
+}
+
+/**
+ * @brief 记录一次HTTP/WebSocket活动
+ */
+static void ws_touch(void)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    ws_last_activity_us = now;
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+}
+
+/**
+ * @brief httpd关闭socket时的回调 - 清理会话表
+ *
+ * 【调用时机】
+ * 客户端断开、服务器LRU清理或httpd_stop时，httpd在自己的任务中调用。
+ * 注册了close_fn后，关闭socket的工作由我们负责。
+ */
+static void ws_on_close(httpd_handle_t hd, int sockfd)
+{
+    ws_session_remove(sockfd);
+    close(sockfd);
+}
+
+/**
+ * @brief 关闭一个会话：立即移出会话表，socket由httpd在自己的任务中关闭
+ */
+static void ws_session_drop(int fd, const char *why)
+{
+    ESP_LOGW(TAG, "关闭WebSocket会话 socket_fd=%d（%s）", fd, why);
+    ws_session_remove(fd);
+    httpd_sess_trigger_close(server_handle, fd);
+}
+
+/*============================================================================
+ *                           保活
+ *============================================================================*/
+
+/**
+ * @brief 保活工作函数 - 运行在httpd任务中
+ *
+ * 超时的会话直接关闭，其余会话各发一个PING
+ */
+static void ws_ping_work(void *arg)
+{
+    ws_session_t sessions[WS_SERVER_MAX_CLIENTS];
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    memcpy(sessions, ws_sessions, sizeof(sessions));
+    ws_ping_scheduled = false;
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+
+    int64_t now = esp_timer_get_time();
+    httpd_ws_frame_t ping = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_PING,
+    };
+    for (int i = 0; i < WS_SERVER_MAX_CLIENTS; i++)
+    {
+        int fd = sessions[i].fd;
+        if (fd < 0)
+            continue;
+        if (httpd_ws_get_fd_info(server_handle, fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+        {
+            ws_session_remove(fd);
+        }
+        else if (now - sessions[i].last_rx_us > ws_ping_timeout_us)
+        {
+            ws_session_drop(fd, "PING超时");
+        }
+        else if (httpd_ws_send_frame_async(server_handle, fd, &ping) != ESP_OK)
+        {
+            ws_session_drop(fd, "PING发送失败");
+        }
+    }
+}
+
+/**
+ * @brief 保活定时器回调（esp_timer任务中执行，不能阻塞）
+ */
+static void ws_ping_timer_cb(void *arg)
+{
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    bool schedule = !ws_ping_scheduled && server_handle != NULL;
+    if (schedule)
+        ws_ping_scheduled = true;
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+
+    // 上一次的工作还没执行（httpd忙）时不重复投递
+    if (schedule && httpd_queue_work(server_handle, ws_ping_work, NULL) != ESP_OK)
+    {
+        taskENTER_CRITICAL(&ws_sessions_lock);
+        ws_ping_scheduled = false;
+        taskEXIT_CRITICAL(&ws_sessions_lock);
+    }
+}
+
 /*============================================================================
  *                           HTTP请求处理
  *============================================================================*/
 
 /**
- * @brief HTTP GET"/"请求处理 - 返回配网页面
+ * @brief 强制门户：资源表中没有的GET请求都重定向到配网页面
+ *
+ * 【为什么能自动弹出配网页？】
+ * DNS服务器把所有域名都解析到热点，手机的联网检测请求因此落到这里：
+ * - Android: /generate_204 期望204
+ * - iOS/macOS: /hotspot-detect.html 期望"Success"页面
+ * - Windows: /connecttest.txt、/ncsi.txt 期望固定文本
+ * 收到302后系统判定需要登录，直接用重定向地址打开登录窗口。
+ *
+ * 检测请求会周期性出现，不计为活动，否则手机连着就永远不会空闲超时。
+ */
+static esp_err_t captive_redirect(httpd_req_t *r)
+{
+    httpd_resp_set_status(r, "302 Found");
+    httpd_resp_set_hdr(r, "Location", ws_portal_location);
+    httpd_resp_set_hdr(r, "Cache-Control", "no-store");
+    return httpd_resp_send(r, NULL, 0);
+}
+
+/**
+ * @brief 在资源表中查找请求路径（忽略"?"之后的查询参数）
+ */
+static const ws_server_asset_t *find_asset(const char *uri)
+{
+    size_t len = strcspn(uri, "?");
+    for (size_t i = 0; i < http_asset_count; i++)
+    {
+        const char *path = http_assets[i].path;
+        if (strlen(path) == len && strncmp(path, uri, len) == 0)
+        {
+            return &http_assets[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief If-None-Match中是否有与ETag一致的项
+ *
+ * 请求头可以是逗号分隔的列表，每项可能带弱校验前缀W/，"*"匹配任何资源；
+ * 按弱比较（忽略W/）判断，GET请求的条件缓存就是这样定义的
+ *
+ * @param list 请求头的值（可能被截断，截断的最后一项不完整，不会误匹配）
+ * @param etag 资源的ETag（带引号）
+ */
+static bool etag_list_match(const char *list, const char *etag)
+{
+    size_t etag_len = strlen(etag);
+    const char *p = list;
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t' || *p == ',')
+            p++;
+        const char *start = p;
+        while (*p && *p != ',')
+            p++;
+        const char *end = p;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+
+        if (end - start == 1 && *start == '*')
+            return true;
+        if (end - start > 2 && start[0] == 'W' && start[1] == '/')
+            start += 2;
+        if ((size_t)(end - start) == etag_len && memcmp(start, etag, etag_len) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief HTTP GET通配请求处理 - 从资源表返回网页文件
  *
  * @param r HTTP请求对象，包含请求信息和响应发送接口
  * @return ESP_OK 成功
  *
  * 【调用时机】
- * 当浏览器访问 http://192.168.100.1/ 时调用
+ * 浏览器访问 http://192.168.100.1/ 以及页面引用的css/js时调用
+ *
+ * 【缓存与压缩】
+ * - 请求头If-None-Match中有与ETag一致的项（或为*）时直接返回304，不发送内容
+ * - 资源为gzip数据时附加Content-Encoding: gzip，由浏览器解压
+ * - max_age_s为0（首页）时用Cache-Control: no-cache，每次使用前需用ETag验证，
+ *   这样固件升级后页面也能及时更新；其他资源地址带版本号，直接长期缓存
  *
- * 【请求咍处理器注册】
- * 需要在启动服务器后使用httpd_register_uri_handler注册
+ * 【找不到资源】
+ * 启用强制门户时重定向到配网页，否则返回404
  */
-esp_err_t get_hyyp_req(httpd_req_t *r)
+static esp_err_t asset_handler(httpd_req_t *r)
 {
-    /**
-     * httpd_resp_send: 发送HTTP响应
-     * @param r         请求对象
-     * @param http_html 响应内容（HTML字符串）
-     * @param HTTPD_RESP_USE_STRLEN 自动计算字符串长度
-     */
-    esp_err_t ret = httpd_resp_send(r, http_html, HTTPD_RESP_USE_STRLEN);
+    const ws_server_asset_t *asset = find_asset(r->uri);
+    if (asset == NULL)
+    {
+        if (ws_portal_location[0])
+        {
+            return captive_redirect(r);
+        }
+        return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+    }
+
+    if (strcmp(asset->path, "/") == 0)
+    {
+        PROV_TRACE_ONCE(WIFI_PROVISION_TRACE_PAGE_REQUEST);
+    }
+    PROV_DIAG_SET_TASK(WIFI_PROVISION_TASK_HTTPD, xTaskGetCurrentTaskHandle());
+    ws_touch();
+
+    char cache_control[48];
+    if (asset->max_age_s)
+    {
+        snprintf(cache_control, sizeof(cache_control), "public, max-age=%" PRIu32 ", immutable", asset->max_age_s);
+    }
+    else
+    {
+        strcpy(cache_control, "no-cache");
+    }
+    httpd_resp_set_hdr(r, "ETag", asset->etag);
+    httpd_resp_set_hdr(r, "Cache-Control", cache_control);
+
+    // 浏览器可能带上多个缓存版本的ETag；超长时按截断的内容匹配
+    char if_none_match[WS_SERVER_IF_NONE_MATCH_MAX] = {0};
+    esp_err_t hdr_ret = httpd_req_get_hdr_value_str(r, "If-None-Match", if_none_match, sizeof(if_none_match));
+    if ((hdr_ret == ESP_OK || hdr_ret == ESP_ERR_HTTPD_RESULT_TRUNC) && etag_list_match(if_none_match, asset->etag))
+    {
+        httpd_resp_set_status(r, "304 Not Modified");
+        return httpd_resp_send(r, NULL, 0);
+    }
+
+    httpd_resp_set_type(r, asset->mime);
+    if (asset->gzip)
+    {
+        httpd_resp_set_hdr(r, "Content-Encoding", "gzip");
+    }
+
+    // 长度在编译期确定（gzip数据不能用strlen计算长度）
+    esp_err_t ret = httpd_resp_send(r, (const char *)asset->data, asset->len);
 
     // 错误码104 (ECONNRESET) 表示客户端关闭了连接，这是正常情况
     // 浏览器可能在收到响应前就关闭了连接（刷新页面、导航离开等）
@@ -95,11 +547,69 @@ esp_err_t get_hyyp_req(httpd_req_t *r)
  */
 static esp_err_t favicon_handler(httpd_req_t *r)
 {
+    ws_touch();
     // 返回204 No Content，浏览器会停止请求图标
     httpd_resp_set_status(r, "204 No Content");
     return httpd_resp_send(r, NULL, 0);
 }
 
+/**
+ * @brief 处理POST /provision请求 - 一次请求完成配网
+ *
+ * 请求体是原始二进制数据，读入WebSocket共用的接收缓冲区
+ * （所有处理函数都在httpd任务中串行执行），交给上层校验，
+ * 上层的返回值映射为HTTP状态码。
+ */
+static esp_err_t post_provision_handler(httpd_req_t *r)
+{
+    if (ws_server_post_fn == NULL)
+    {
+        return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+    }
+    PROV_DIAG_SET_TASK(WIFI_PROVISION_TASK_HTTPD, xTaskGetCurrentTaskHandle());
+    ws_touch();
+    if (r->content_len == 0 || r->content_len > ws_rx_max)
+    {
+        return httpd_resp_send_err(r, HTTPD_400_BAD_REQUEST, "bad body length");
+    }
+
+    size_t got = 0;
+    while (got < r->content_len)
+    {
+        int n = httpd_req_recv(r, (char *)ws_rx_buf + got, r->content_len - got);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT)
+            continue;
+        if (n <= 0)
+            return ESP_FAIL; // 连接已断开，httpd会关闭该socket
+        got += n;
+    }
+
+    char resp[96] = {0};
+    esp_err_t ret = ws_server_post_fn(ws_rx_buf, got, resp, sizeof(resp));
+    switch (ret)
+    {
+    case ESP_OK:
+        httpd_resp_set_status(r, "202 Accepted");
+        break;
+    case ESP_ERR_INVALID_SIZE:
+    case ESP_ERR_INVALID_ARG:
+        httpd_resp_set_status(r, "400 Bad Request");
+        break;
+    case ESP_ERR_INVALID_CRC:
+    case ESP_ERR_INVALID_STATE:
+        httpd_resp_set_status(r, "403 Forbidden");
+        break;
+    case ESP_ERR_NOT_SUPPORTED:
+        httpd_resp_set_status(r, "404 Not Found");
+        break;
+    default:
+        httpd_resp_set_status(r, "500 Internal Server Error");
+        break;
+    }
+    httpd_resp_set_type(r, "application/json");
+    return httpd_resp_sendstr(r, resp[0] ? resp : "{}");
+}
+
 /*============================================================================
  *                           WebSocket请求处理
  *============================================================================*/
@@ -112,17 +622,19 @@ static esp_err_t favicon_handler(httpd_req_t *r)
  *
  * 【函数工作流程】
  * 首次调用（HTTP GET请求，即WebSocket握手）：
- *   - 保存socket_fd以便后续主动推送
+ *   - 将socket_fd登记到会话表，以便后续主动推送
  *   - 直接返回ESP_OK，服务器自动完成WebSocket握手
  *
  * 后续调用（收到WebSocket数据帧）：
  *   - 第一次httpd_ws_recv_frame: 只获取帧长度（len=0）
- *   - 分配内存缓冲区
- *   - 第二次httpd_ws_recv_frame: 实际读取数据
- *   - 调用上层回调处理数据
+ *   - 超过max_frame_size的帧直接拒绝（不分配内存，httpd会关闭该连接）
+ *   - 第二次httpd_ws_recv_frame: 读取数据到预分配的接收缓冲区
+ *   - 调用上层回调处理数据（缓冲区只在回调期间有效）
  */
 esp_err_t handle_ws_req(httpd_req_t *r)
 {
+    PROV_DIAG_SET_TASK(WIFI_PROVISION_TASK_HTTPD, xTaskGetCurrentTaskHandle());
+
     /**
      * 【WebSocket握手检测】
      * 第一次WebSocket请求是HTTP GET（协议升级请求）
@@ -132,8 +644,17 @@ esp_err_t handle_ws_req(httpd_req_t *r)
     if (r->method == HTTP_GET)
     {
         // httpd_req_to_sockfd: 从请求对象获取socket描述符
-        socket_fd = httpd_req_to_sockfd(r);
-        ESP_LOGI(TAG, "WebSocket连接建立, socket_fd=%d", socket_fd);
+        int fd = httpd_req_to_sockfd(r);
+        int evicted = -1;
+        ws_touch();
+        ws_session_add(fd, &evicted);
+        if (evicted >= 0)
+        {
+            httpd_sess_trigger_close(r->handle, evicted);
+            ESP_LOGW(TAG, "WebSocket会话已满(%d)，断开最久没有数据的 socket_fd=%d", WS_SERVER_MAX_CLIENTS, evicted);
+        }
+        PROV_TRACE_ONCE(WIFI_PROVISION_TRACE_WS_HANDSHAKE);
+        ESP_LOGI(TAG, "WebSocket连接建立, socket_fd=%d", fd);
         return ESP_OK; // 服务器自动完成握手
     }
 
@@ -150,7 +671,7 @@ esp_err_t handle_ws_req(httpd_req_t *r)
     /**
      * 【第一阶段】获取帧长度
      * 传入len=0，函数不读取数据，只填充ws_pkt.len告诉我们数据有多长
-     * 这样我们才知道要分配多大的缓冲区
+     * 这样我们才能在读取数据之前检查长度是否超限
      */
     err = httpd_ws_recv_frame(r, &ws_pkt, 0);
     if (err != ESP_OK)
@@ -159,67 +680,262 @@ esp_err_t handle_ws_req(httpd_req_t *r)
         return err;
     }
 
-    ESP_LOGI(TAG, "WebSocket帧长度: %d字节", ws_pkt.len);
+    ESP_LOGD(TAG, "WebSocket帧长度: %d字节", ws_pkt.len);
 
-    // 分配缓冲区（+1用于字符串结束符）
-    uint8_t *buf = malloc(ws_pkt.len + 1);
-    if (buf == NULL)
+    /**
+     * 【长度检查】
+     * 帧数据还留在socket中没有读出，无法跳过这一帧继续解析后续数据，
+     * 因此返回错误让httpd关闭这个连接
+     */
+    if (ws_pkt.len > ws_rx_max)
     {
-        ESP_LOGE(TAG, "内存分配失败");
-        return ESP_ERR_NO_MEM;
+        ESP_LOGW(TAG, "WebSocket帧过大(%d > %d字节)，关闭连接", ws_pkt.len, ws_rx_max);
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    // 将缓冲区挂载到帧结构体
-    ws_pkt.payload = buf;
+    // 将预分配的接收缓冲区挂载到帧结构体
+    ws_pkt.payload = ws_rx_buf;
 
     /**
      * 【第二阶段】实际读取数据
-     * 现在ws_pkt.payload已指向我们的缓冲区
+     * 现在ws_pkt.payload已指向接收缓冲区
      * 传入ws_pkt.len告诉函数最多读取多少字节
      */
-    err = httpd_ws_recv_frame(r, &ws_pkt, ws_pkt.len);
-    if (err == ESP_OK)
+    if (ws_pkt.len > 0)
     {
-        // 检查帧类型是否为文本（本项目只处理JSON文本）
-        if (ws_pkt.type == HTTPD_WS_TYPE_TEXT)
+        err = httpd_ws_recv_frame(r, &ws_pkt, ws_pkt.len);
+        if (err != ESP_OK)
         {
-            buf[ws_pkt.len] = 0; // 添加字符串结束符
-            ESP_LOGI(TAG, "WebSocket收到: %s", ws_pkt.payload);
+            // 帧数据只读了一部分，后续数据无法再按帧解析，返回错误让httpd关闭连接
+            ESP_LOGE(TAG, "读取帧数据失败: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
 
-            // 调用上层回调处理消息
-            if (ws_server_cb)
-            {
-                ws_server_cb((const char *)buf, ws_pkt.len);
-            }
+    // 任何帧（包括PONG）都说明客户端还在
+    ws_session_seen(httpd_req_to_sockfd(r));
+
+    /**
+     * 【控制帧】
+     * 路由设置了handle_ws_control_frames，PING/PONG/CLOSE也交给这里：
+     * PONG只用于保活；PING原样回复PONG；CLOSE回复CLOSE后关闭连接
+     */
+    if (ws_pkt.type == HTTPD_WS_TYPE_PONG)
+    {
+        return ESP_OK;
+    }
+    if (ws_pkt.type == HTTPD_WS_TYPE_PING || ws_pkt.type == HTTPD_WS_TYPE_CLOSE)
+    {
+        ws_pkt.type = (ws_pkt.type == HTTPD_WS_TYPE_PING) ? HTTPD_WS_TYPE_PONG : HTTPD_WS_TYPE_CLOSE;
+        ws_pkt.final = true;
+        httpd_ws_send_frame(r, &ws_pkt);
+        if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE)
+        {
+            ws_session_remove(httpd_req_to_sockfd(r));
+            httpd_sess_trigger_close(r->handle, httpd_req_to_sockfd(r));
         }
-        else
+        return ESP_OK;
+    }
+
+    // 文本帧为浏览器的JSON，二进制帧为原生工具的紧凑协议，其余类型忽略
+    if (ws_pkt.type == HTTPD_WS_TYPE_TEXT || ws_pkt.type == HTTPD_WS_TYPE_BINARY)
+    {
+        ws_touch();
+        ws_server_frame_type_t type =
+            (ws_pkt.type == HTTPD_WS_TYPE_BINARY) ? WS_SERVER_FRAME_BINARY : WS_SERVER_FRAME_TEXT;
+        ws_rx_buf[ws_pkt.len] = 0; // 添加字符串结束符（缓冲区多预留了1字节）
+        ws_session_set_type(httpd_req_to_sockfd(r), type);
+        ESP_LOGD(TAG, "WebSocket收到%s帧: %d字节", type == WS_SERVER_FRAME_BINARY ? "二进制" : "文本",
+                 ws_pkt.len);
+
+        // 调用上层回调处理消息
+        if (ws_server_cb)
         {
-            ESP_LOGW(TAG, "收到非Text类型的WebSocket帧: %d", ws_pkt.type);
+            ws_server_cb(ws_rx_buf, ws_pkt.len, type);
         }
     }
     else
     {
-        ESP_LOGE(TAG, "读取帧数据失败: %s", esp_err_to_name(err));
+        ESP_LOGW(TAG, "收到不支持的WebSocket帧类型: %d", ws_pkt.type);
     }
-
-    // 释放缓冲区
-    free(buf);
     return ESP_OK;
 }
 
+/*============================================================================
+ *                           发送队列
+ *============================================================================*/
+
+/**
+ * @brief 把一帧发给会话表中使用该帧类型的所有客户端
+ *
+ * @param ws_pkt 要发送的帧
+ * @param async  true: 在httpd任务内调用，使用httpd_ws_send_frame_async
+ *               false: 在其它任务调用，使用httpd_ws_send_data（阻塞等待httpd任务发送）
+ * @return ESP_OK 至少一个客户端发送成功，ESP_FAIL 没有客户端或全部失败
+ */
+static esp_err_t ws_send_to_sessions(httpd_ws_frame_t *ws_pkt, bool async)
+{
+    int fds[WS_SERVER_MAX_CLIENTS];
+    int count = ws_session_snapshot(fds, ws_pkt->type == HTTPD_WS_TYPE_BINARY ? WS_SERVER_FRAME_BINARY
+                                                                             : WS_SERVER_FRAME_TEXT);
+    if (count == 0)
+    {
+        ESP_LOGD(TAG, "没有对应类型的WebSocket会话，跳过发送");
+        return ESP_FAIL;
+    }
+
+    int sent = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (httpd_ws_get_fd_info(server_handle, fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET)
+        {
+            ws_session_remove(fds[i]);
+            continue;
+        }
+
+        /**
+         * httpd_ws_send_data: 发送WebSocket帧
+         * @param server_handle HTTP服务器句柄
+         * @param fds[i]        目标客户端的socket描述符
+         * @param ws_pkt        要发送的WebSocket帧
+         */
+        esp_err_t ret = async ? httpd_ws_send_frame_async(server_handle, fds[i], ws_pkt)
+                              : httpd_ws_send_data(server_handle, fds[i], ws_pkt);
+        if (ret == ESP_OK)
+        {
+            sent++;
+        }
+        else
+        {
+            // 发送失败通常是客户端已经掉线，立即关闭，后续的帧不再在它身上等待超时
+            ESP_LOGE(TAG, "WebSocket发送失败(socket_fd=%d): %s", fds[i], esp_err_to_name(ret));
+            ws_session_drop(fds[i], "发送失败");
+        }
+    }
+    return sent > 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief 通知生产者帧的最终结果并释放数据
+ */
+static void ws_tx_frame_finish(ws_tx_frame_t *frame, esp_err_t result)
+{
+    if (frame->done_cb)
+    {
+        frame->done_cb(result, frame->done_arg);
+    }
+    PROV_FREE(WIFI_PROVISION_MEM_WS_SERVER, frame->payload);
+    frame->payload = NULL;
+}
+
+/**
+ * @brief 异步发送工作函数 - 运行在httpd任务中
+ *
+ * 依次取出队列中的帧广播给所有客户端，直到队列为空。
+ * 队列为空时清除ws_tx_scheduled，之后的入队会重新投递工作。
+ */
+static void ws_tx_work(void *arg)
+{
+    while (1)
+    {
+        ws_tx_frame_t frame;
+
+        taskENTER_CRITICAL(&ws_tx_lock);
+        if (ws_tx_count == 0)
+        {
+            ws_tx_scheduled = false;
+            taskEXIT_CRITICAL(&ws_tx_lock);
+            break;
+        }
+        frame = ws_tx_queue[ws_tx_head];
+        ws_tx_queue[ws_tx_head].payload = NULL;
+        ws_tx_head = (ws_tx_head + 1) % WS_SERVER_TX_QUEUE_LEN;
+        ws_tx_count--;
+        taskEXIT_CRITICAL(&ws_tx_lock);
+
+        httpd_ws_frame_t ws_pkt;
+        memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+        ws_pkt.payload = frame.payload;
+        ws_pkt.len = frame.len;
+        ws_pkt.type = (frame.type == WS_SERVER_FRAME_BINARY) ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT;
+
+        ws_tx_frame_finish(&frame, ws_send_to_sessions(&ws_pkt, true));
+    }
+}
+
+/**
+ * @brief 清空异步发送队列，所有未发送的帧以result回调
+ *
+ * @note 只能在没有ws_tx_work会执行时调用（httpd任务已经停止，或投递工作失败），避免重复取帧
+ */
+static void ws_tx_flush(esp_err_t result)
+{
+    while (1)
+    {
+        ws_tx_frame_t frame;
+
+        taskENTER_CRITICAL(&ws_tx_lock);
+        if (ws_tx_count == 0)
+        {
+            ws_tx_scheduled = false;
+            ws_tx_head = 0;
+            taskEXIT_CRITICAL(&ws_tx_lock);
+            break;
+        }
+        frame = ws_tx_queue[ws_tx_head];
+        ws_tx_queue[ws_tx_head].payload = NULL;
+        ws_tx_head = (ws_tx_head + 1) % WS_SERVER_TX_QUEUE_LEN;
+        ws_tx_count--;
+        taskEXIT_CRITICAL(&ws_tx_lock);
+
+        ws_tx_frame_finish(&frame, result);
+    }
+}
+
 /*============================================================================
  *                           服务器控制函数
  *============================================================================*/
 
+/** 保存强制门户重定向地址 */
+static void ws_set_portal(const char *host)
+{
+    if (host && host[0])
+    {
+        snprintf(ws_portal_location, sizeof(ws_portal_location), "http://%s/", host);
+    }
+    else
+    {
+        ws_portal_location[0] = 0;
+    }
+}
+
+/**
+ * 路由表（静态，按顺序注册）
+ *
+ * httpd按注册顺序匹配，第一个命中的处理函数生效，
+ * 因此通配路由必须放在最后，前面的精确路由优先。
+ * 所有路由总是注册，未配置的功能在处理函数中返回404。
+ */
+static const httpd_uri_t ws_routes[] = {
+    {.uri = "/ws", .method = HTTP_GET, .handler = handle_ws_req, .is_websocket = true, .handle_ws_control_frames = true},
+    {.uri = "/favicon.ico", .method = HTTP_GET, .handler = favicon_handler},
+    {.uri = "/provision", .method = HTTP_POST, .handler = post_provision_handler},
+    {.uri = "/*", .method = HTTP_GET, .handler = asset_handler},
+};
+
+#define WS_ROUTE_COUNT (sizeof(ws_routes) / sizeof(ws_routes[0]))
+
 /**
  * @brief 启动HTTP+WebSocket服务器
  *
- * @param config 服务器配置（HTML内容和消息回调）
+ * @param config 服务器配置（静态资源表和消息回调）
  * @return ESP_OK 成功，ESP_FAIL 参数错误
  *
- * 【注册的路由】
- * GET "/"   -> get_hyyp_req   -> 返回HTML网页
- * GET "/ws" -> handle_ws_req  -> WebSocket通信
+ * 【注册的路由】（见ws_routes）
+ * GET "/ws"          -> handle_ws_req   -> WebSocket通信
+ * GET "/favicon.ico" -> favicon_handler -> 204
+ * POST "/provision"  -> post_provision_handler -> 预签名配网数据（配置了post_cb时）
+ * GET 其他路径       -> asset_handler   -> 资源表中的网页文件，找不到时重定向到配网页（配置了portal_host时）或404
  */
 esp_err_t ws_server_start(ws_server_config_t *config)
 {
@@ -234,14 +950,30 @@ esp_err_t ws_server_start(ws_server_config_t *config)
     {
         ESP_LOGI(TAG, "HTTP服务器已在运行，无需重复启动");
         // 更新配置（回调函数可能变化）
-        http_html = config->html_code;
+        http_assets = config->assets;
+        http_asset_count = config->asset_count;
         ws_server_cb = config->cb;
+        ws_server_post_fn = config->post_cb;
+        ws_set_portal(config->portal_host);
         return ESP_OK;
     }
 
     // 保存配置到模块变量
-    http_html = config->html_code;
+    http_assets = config->assets;
+    http_asset_count = config->asset_count;
     ws_server_cb = config->cb;
+    ws_server_post_fn = config->post_cb;
+    ws_set_portal(config->portal_host);
+
+    // 预分配接收缓冲区（+1用于字符串结束符）
+    ws_rx_max = config->max_frame_size ? config->max_frame_size : WS_SERVER_DEFAULT_MAX_FRAME;
+    ws_rx_buf = PROV_MALLOC_BULK(WIFI_PROVISION_MEM_WS_SERVER, ws_rx_max + 1);
+    if (ws_rx_buf == NULL)
+    {
+        ESP_LOGE(TAG, "接收缓冲区分配失败(%d字节)", ws_rx_max + 1);
+        ws_rx_max = 0;
+        return ESP_ERR_NO_MEM;
+    }
 
     /**
      * 【创建HTTP服务器】
@@ -259,57 +991,61 @@ esp_err_t ws_server_start(ws_server_config_t *config)
      * 默认512字节不够用，增加到1024字节避免"431 Request Header Fields Too Large"错误
      */
     httpd_config.uri_match_fn = httpd_uri_match_wildcard; // 支持通配符匹配
-    httpd_config.max_uri_handlers = 8;                    // 最大URI处理器数量
+    httpd_config.max_uri_handlers = WS_ROUTE_COUNT;       // 路由表大小
     httpd_config.stack_size = 8192;                       // 增加栈大小以处理WebSocket
+    httpd_config.close_fn = ws_on_close;                  // socket关闭时清理会话表
+    httpd_config.lru_purge_enable = true;                 // socket用完时关闭最久未使用的连接，而不是拒绝新连接
+    httpd_config.send_wait_timeout = WS_SERVER_SEND_TIMEOUT_S;
 
+    ws_session_reset();
+    ws_touch(); // 启动时刻作为第一次活动，空闲计时从这里开始
+
+#if CONFIG_WIFI_PROVISION_DIAG
+    uint32_t heap_before = esp_get_free_heap_size();
+#endif
     esp_err_t ret = httpd_start(&server_handle, &httpd_config);
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "启动HTTP服务器失败: %s", esp_err_to_name(ret));
+        PROV_FREE(WIFI_PROVISION_MEM_WS_SERVER, ws_rx_buf);
+        ws_rx_buf = NULL;
+        ws_rx_max = 0;
         return ret;
     }
+    PROV_TRACE(WIFI_PROVISION_TRACE_HTTPD_START);
+    taskENTER_CRITICAL(&ws_tx_lock);
+    ws_tx_open = true;
+    taskEXIT_CRITICAL(&ws_tx_lock);
+#if CONFIG_WIFI_PROVISION_DIAG
+    // httpd内部的分配无法逐个记账，用启动前后的剩余堆之差估算
+    PROV_DIAG_SET_HTTPD_HEAP(heap_before - esp_get_free_heap_size());
+#endif
     ESP_LOGI(TAG, "HTTP服务器启动成功，端口: %d", httpd_config.server_port);
 
-    /**
-     * 【注册HTTP路由】
-     * httpd_uri_t结构体定义一个URL处理规则：
-     * - uri: URL路径
-     * - method: HTTP方法 (GET/POST/PUT/DELETE等)
-     * - handler: 处理函数
-     * - user_ctx: 用户上下文（传给handler）
-     * - is_websocket: 是否WebSocket端点
-     */
+    for (size_t i = 0; i < WS_ROUTE_COUNT; i++)
+    {
+        httpd_register_uri_handler(server_handle, &ws_routes[i]);
+        ESP_LOGI(TAG, "注册路由: %s %s", ws_routes[i].method == HTTP_POST ? "POST" : "GET", ws_routes[i].uri);
+    }
 
-    // 注册根路径 - 返回HTML页面
-    httpd_uri_t uri = {
-        .uri = "/",
-        .method = HTTP_GET,
-        .handler = get_hyyp_req,
-        .user_ctx = NULL,
-    };
-    httpd_register_uri_handler(server_handle, &uri);
-    ESP_LOGI(TAG, "注册路由: GET /");
-
-    // 注册WebSocket端点
-    httpd_uri_t uri_ws = {
-        .uri = "/ws",
-        .method = HTTP_GET,
-        .handler = handle_ws_req,
-        .user_ctx = NULL,
-        .is_websocket = true, // 启用WebSocket处理
-    };
-    httpd_register_uri_handler(server_handle, &uri_ws);
-    ESP_LOGI(TAG, "注册路由: GET /ws (WebSocket)");
-
-    // 注册favicon.ico处理 - 避免404警告
-    httpd_uri_t uri_favicon = {
-        .uri = "/favicon.ico",
-        .method = HTTP_GET,
-        .handler = favicon_handler,
-        .user_ctx = NULL,
-    };
-    httpd_register_uri_handler(server_handle, &uri_favicon);
-    ESP_LOGI(TAG, "注册路由: GET /favicon.ico");
+    if (config->ping_interval_ms > 0)
+    {
+        const esp_timer_create_args_t ping_timer_args = {
+            .callback = ws_ping_timer_cb,
+            .name = "ws_ping",
+        };
+        ws_ping_timeout_us = (int64_t)config->ping_timeout_ms * 1000;
+        ws_ping_scheduled = false;
+        if (esp_timer_create(&ping_timer_args, &ws_ping_timer) == ESP_OK)
+        {
+            esp_timer_start_periodic(ws_ping_timer, (uint64_t)config->ping_interval_ms * 1000);
+        }
+        else
+        {
+            ws_ping_timer = NULL;
+            ESP_LOGW(TAG, "保活定时器创建失败，不检测掉线的客户端");
+        }
+    }
 
     return ESP_OK;
 }
@@ -327,52 +1063,231 @@ esp_err_t ws_server_stop(void)
     if (server_handle)
     {
         ESP_LOGI(TAG, "停止HTTP服务器");
+        // 之后的异步发送直接失败，不会留下帧被下一次启动的会话收到
+        taskENTER_CRITICAL(&ws_tx_lock);
+        ws_tx_open = false;
+        taskEXIT_CRITICAL(&ws_tx_lock);
+        if (ws_ping_timer)
+        {
+            esp_timer_stop(ws_ping_timer);
+            esp_timer_delete(ws_ping_timer);
+            ws_ping_timer = NULL;
+        }
+        PROV_DIAG_SET_TASK(WIFI_PROVISION_TASK_HTTPD, NULL); // httpd任务即将被删除
         httpd_stop(server_handle);
         server_handle = NULL;
-        socket_fd = -1; // 重置socket描述符
+        ws_session_reset(); // 清空会话表
+        ws_tx_flush(ESP_ERR_INVALID_STATE); // httpd任务已停止，丢弃未发送的帧
+
+        // 释放接收缓冲区
+        PROV_FREE(WIFI_PROVISION_MEM_WS_SERVER, ws_rx_buf);
+        ws_rx_buf = NULL;
+        ws_rx_max = 0;
     }
     return ESP_OK;
 }
 
 /**
- * @brief 通过WebSocket主动发送数据到浏览器
+ * @brief 通过WebSocket广播文本数据到所有使用文本帧的客户端
  *
- * @param data 要发送的数据
+ * @param data 要发送的数据（调用方只需序列化一次）
  * @param len  数据长度
- * @return ESP_OK 成功，ESP_ERR_xxx 失败
+ * @return ESP_OK 至少一个客户端发送成功，ESP_FAIL 没有客户端或全部失败
  *
  * 【使用场景】
  * - WiFi扫描完成后，主动推送结果到网页
  * - 设备状态变化时，实时通知网页
  *
  * 【注意】
- * 必须在WebSocket连接建立后才能调用（socket_fd有效）
+ * 同一个缓冲区依次发给会话表中的每个客户端，不会重复序列化。
+ * 已经不是WebSocket的fd（握手后断开但关闭回调还没来得及执行）会被跳过并移除。
+ * 此函数会阻塞到数据写入socket为止，不方便阻塞的任务请使用ws_server_send_async()
  */
-esp_err_t ws_server_send(uint8_t *data, int len)
+esp_err_t ws_server_broadcast(const uint8_t *data, size_t len)
 {
-    if (socket_fd < 0)
+    if (server_handle == NULL)
     {
-        ESP_LOGE(TAG, "WebSocket未连接，无法发送");
+        ESP_LOGE(TAG, "HTTP服务器未启动，无法发送");
         return ESP_FAIL;
     }
 
     // 构建WebSocket帧
     httpd_ws_frame_t ws_pkt;
     memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-    ws_pkt.payload = data;            // 数据内容
+    ws_pkt.payload = (uint8_t *)data; // 数据内容（发送过程中不会被修改）
     ws_pkt.len = len;                 // 数据长度
     ws_pkt.type = HTTPD_WS_TYPE_TEXT; // 帧类型：文本
 
-    /**
-     * httpd_ws_send_data: 发送WebSocket帧
-     * @param server_handle HTTP服务器句柄
-     * @param socket_fd     目标客户端的socket描述符
-     * @param ws_pkt        要发送的WebSocket帧
-     */
-    esp_err_t ret = httpd_ws_send_data(server_handle, socket_fd, &ws_pkt);
-    if (ret != ESP_OK)
+    return ws_send_to_sessions(&ws_pkt, false);
+}
+
+/**
+ * @brief 异步广播数据到所有已连接的浏览器（不阻塞调用者）
+ *
+ * @param data         要发送的数据（函数内部会拷贝，返回后即可释放）
+ * @param len          数据长度
+ * @param type         帧类型，只发给使用该类型的会话
+ * @param coalesce_key 合并键，非0时会替换队列中相同键、相同类型的待发送帧
+ * @param done_cb      发送完成回调（可为NULL），在httpd任务或调用者任务中执行
+ * @param done_arg     回调参数
+ * @return ESP_OK 已入队，ESP_ERR_NO_MEM 内存不足，ESP_FAIL 服务器未启动或正在停止（不回调）
+ *
+ * 【回调结果】
+ * - ESP_OK / ESP_FAIL: 实际发送的结果
+ * - ESP_ERR_INVALID_STATE: 被相同合并键的新帧替换，或服务器已停止
+ * - ESP_ERR_NO_MEM: 队列已满，作为最旧的帧被丢弃
+ * - 其他: 无法向httpd投递发送工作（httpd_queue_work的错误码）
+ */
+esp_err_t ws_server_send_async(const uint8_t *data, size_t len, ws_server_frame_type_t type,
+                               uint8_t coalesce_key, ws_server_send_done_cb done_cb, void *done_arg)
+{
+    if (server_handle == NULL)
     {
-        ESP_LOGE(TAG, "WebSocket发送失败: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "HTTP服务器未启动，无法发送");
+        return ESP_FAIL;
     }
-    return ret;
-}
\ No newline at end of file
+
+    // 在临界区外分配内存并拷贝数据
+    uint8_t *payload = PROV_MALLOC(WIFI_PROVISION_MEM_WS_SERVER, len);
+    if (payload == NULL)
+    {
+        ESP_LOGE(TAG, "内存分配失败");
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(payload, data, len);
+
+    ws_tx_frame_t frame = {
+        .payload = payload,
+        .len = len,
+        .coalesce_key = coalesce_key,
+        .type = type,
+        .done_cb = done_cb,
+        .done_arg = done_arg,
+    };
+    ws_tx_frame_t evicted = {0}; // 被替换或被丢弃的帧
+    esp_err_t evicted_result = ESP_OK;
+    bool need_schedule = false;
+
+    taskENTER_CRITICAL(&ws_tx_lock);
+    if (!ws_tx_open)
+    {
+        taskEXIT_CRITICAL(&ws_tx_lock);
+        PROV_FREE(WIFI_PROVISION_MEM_WS_SERVER, payload);
+        return ESP_FAIL;
+    }
+    bool merged = false;
+    if (coalesce_key != 0)
+    {
+        for (int i = 0; i < ws_tx_count; i++)
+        {
+            ws_tx_frame_t *pending = &ws_tx_queue[(ws_tx_head + i) % WS_SERVER_TX_QUEUE_LEN];
+            if (pending->coalesce_key == coalesce_key && pending->type == type)
+            {
+                evicted = *pending;
+                evicted_result = ESP_ERR_INVALID_STATE;
+                *pending = frame;
+                merged = true;
+                break;
+            }
+        }
+    }
+    if (!merged)
+    {
+        if (ws_tx_count == WS_SERVER_TX_QUEUE_LEN)
+        {
+            evicted = ws_tx_queue[ws_tx_head];
+            evicted_result = ESP_ERR_NO_MEM;
+            ws_tx_head = (ws_tx_head + 1) % WS_SERVER_TX_QUEUE_LEN;
+            ws_tx_count--;
+        }
+        ws_tx_queue[(ws_tx_head + ws_tx_count) % WS_SERVER_TX_QUEUE_LEN] = frame;
+        ws_tx_count++;
+    }
+    if (!ws_tx_scheduled)
+    {
+        ws_tx_scheduled = true;
+        need_schedule = true;
+    }
+    taskEXIT_CRITICAL(&ws_tx_lock);
+
+    if (evicted.payload)
+    {
+        if (evicted_result == ESP_ERR_NO_MEM)
+        {
+            ESP_LOGW(TAG, "发送队列已满，丢弃最旧的一帧");
+        }
+        ws_tx_frame_finish(&evicted, evicted_result);
+    }
+
+    if (need_schedule)
+    {
+        /**
+         * httpd_queue_work: 把工作函数投递到httpd任务中执行
+         * 投递失败时没有工作会取走队列中的帧（ws_tx_scheduled仍为true，其他生产者不会投递），
+         * 全部以错误回调并释放，清空后ws_tx_scheduled被清除，下一次入队重新投递
+         */
+        esp_err_t ret = httpd_queue_work(server_handle, ws_tx_work, NULL);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "投递发送工作失败: %s", esp_err_to_name(ret));
+            ws_tx_flush(ret);
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 通过WebSocket主动发送数据到浏览器
+ *
+ * 兼容旧接口，等同于 ws_server_broadcast()
+ */
+esp_err_t ws_server_send(uint8_t *data, int len)
+{
+    return ws_server_broadcast(data, len);
+}
+
+/**
+ * @brief 服务器是否正在运行
+ */
+bool ws_server_is_running(void)
+{
+    return server_handle != NULL;
+}
+
+/**
+ * @brief 当前WebSocket会话数量
+ *
+ * 只统计完成握手的连接，普通HTTP请求不计入
+ */
+int ws_server_get_session_count(void)
+{
+    int fds[WS_SERVER_MAX_CLIENTS];
+    return ws_session_snapshot(fds, -1);
+}
+
+/**
+ * @brief 是否有会话在使用指定类型的帧
+ */
+bool ws_server_has_sessions(ws_server_frame_type_t type)
+{
+    int fds[WS_SERVER_MAX_CLIENTS];
+    return ws_session_snapshot(fds, type) > 0;
+}
+
+/**
+ * @brief 最近一次HTTP/WebSocket请求的时间
+ *
+ * @return esp_timer_get_time()时间戳（微秒），服务器未运行时返回0
+ */
+int64_t ws_server_get_last_activity(void)
+{
+    if (server_handle == NULL)
+    {
+        return 0;
+    }
+    int64_t t;
+    taskENTER_CRITICAL(&ws_sessions_lock);
+    t = ws_last_activity_us;
+    taskEXIT_CRITICAL(&ws_sessions_lock);
+    return t;
+}
@@ -1,17 +1,90 @@
 #ifndef _WS_SERVER_H_
 #define _WS_SERVER_H_
 #include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
-typedef void (*ws_server_receive_cb)(const char *data, int len);
+
+/** 同时在线的WebSocket客户端数量上限（与热点max_connection一致） */
+#define WS_SERVER_MAX_CLIENTS 4
+
+/** 异步发送队列长度（帧数），队列满时丢弃最旧的帧 */
+#define WS_SERVER_TX_QUEUE_LEN 8
+
+/** 未指定max_frame_size时允许接收的最大WebSocket帧长度（字节） */
+#define WS_SERVER_DEFAULT_MAX_FRAME 1024
+
+/** If-None-Match请求头的最大长度（字节），可以容纳几个ETag组成的列表 */
+#define WS_SERVER_IF_NONE_MATCH_MAX 128
+
+/** 发送超时（秒）：手机掉线时TCP发不出去，最多卡住httpd任务这么久，随后关闭该连接 */
+#define WS_SERVER_SEND_TIMEOUT_S 2
+
+/** WebSocket帧类型：浏览器使用文本(JSON)，原生工具使用二进制协议 */
+typedef enum
+{
+    WS_SERVER_FRAME_TEXT = 0,
+    WS_SERVER_FRAME_BINARY,
+} ws_server_frame_type_t;
+
+/** 接收回调（data只在回调期间有效；文本帧保证以'\0'结尾） */
+typedef void (*ws_server_receive_cb)(const uint8_t *data, int len, ws_server_frame_type_t type);
+/** 异步发送完成回调（result含义见ws_server_send_async） */
+typedef void (*ws_server_send_done_cb)(esp_err_t result, void *arg);
+/**
+ * POST /provision 回调（在httpd任务中执行，body只在回调期间有效）
+ * @param resp     响应内容（JSON，以'\0'结尾）
+ * @return ESP_OK -> 202，ESP_ERR_INVALID_SIZE/INVALID_ARG -> 400，
+ *         ESP_ERR_INVALID_CRC/INVALID_STATE -> 403，ESP_ERR_NOT_SUPPORTED -> 404，其他 -> 500
+ */
+typedef esp_err_t (*ws_server_post_cb)(const uint8_t *body, size_t len, char *resp, size_t resp_cap);
+
+/** 静态网页资源（编译期资源表的一项，见web_assets.h） */
 typedef struct
 {
-    const char *html_code;
+    const char *path;   // 请求路径（如"/"、"/apcfg.css"），不含查询参数
+    const char *mime;   // Content-Type
+    const uint8_t *data; // 内容（gzip为true时是压缩数据）
+    size_t len;         // 内容长度（字节）
+    bool gzip;          // 是否附加Content-Encoding: gzip
+    const char *etag;   // 带引号的ETag
+    uint32_t max_age_s; // 缓存时间（秒），0表示no-cache（每次用ETag验证）
+} ws_server_asset_t;
+
+typedef struct
+{
+    const ws_server_asset_t *assets; // 静态资源表（第一项通常是首页"/"）
+    size_t asset_count;
     ws_server_receive_cb cb;
+    size_t max_frame_size; // 允许接收的最大帧长度，0表示使用WS_SERVER_DEFAULT_MAX_FRAME（也是POST请求体上限）
+    ws_server_post_cb post_cb; // POST /provision 处理函数，NULL表示不注册该路由
+    const char *portal_host;   // 强制门户地址（如"192.168.100.1"），其他路径都重定向到这里；NULL表示不重定向
+    uint32_t ping_interval_ms; // 向每个会话发送PING的间隔，0表示不发送（不检测掉线的客户端）
+    uint32_t ping_timeout_ms;  // 超过这么久没有收到会话的任何帧（含PONG）就关闭它
 } ws_server_config_t;
 
 esp_err_t ws_server_start(ws_server_config_t *config);
 
 esp_err_t ws_server_stop(void);
 
+/** 向所有已连接的WebSocket客户端广播同一份数据 */
+esp_err_t ws_server_broadcast(const uint8_t *data, size_t len);
+
+/** 异步广播：数据拷贝入队后立即返回，由httpd任务发送给使用type类型帧的会话 */
+esp_err_t ws_server_send_async(const uint8_t *data, size_t len, ws_server_frame_type_t type,
+                               uint8_t coalesce_key, ws_server_send_done_cb done_cb, void *done_arg);
+
 esp_err_t ws_server_send(uint8_t *data, int len);
-#endif
\ No newline at end of file
+
+/** 服务器是否正在运行 */
+bool ws_server_is_running(void);
+
+/** 当前WebSocket会话数量 */
+int ws_server_get_session_count(void);
+
+/** 是否有会话在使用type类型的帧（用于跳过没人接收的编码） */
+bool ws_server_has_sessions(ws_server_frame_type_t type);
+
+/** 最近一次HTTP/WebSocket请求的时间（esp_timer_get_time，微秒），未运行时为0 */
+int64_t ws_server_get_last_activity(void);
+#endif
@@ -0,0 +1,266 @@
+/**
+ * @file wifi_cred_store.c
+ * @brief 多网络凭据存储 - 在NVS中保存最多WIFI_CRED_STORE_MAX组网络
+ *
+ * 【用途】
+ * 驱动自己只记得最后一次配网的网络，设备换到另一个现场就得重新配网。
+ * 这里保存每个连接成功过的网络（SSID、密码、最近的BSSID/信道、成功次数、最近RSSI），
+ * 上电或断线时扫描一次，直接连接附近最合适的已知网络。
+ *
+ * 【选择规则】
+ * 分数 = 本次扫描RSSI + 3 × min(成功次数, 10) − 10 × min(连续认证失败, 3)，
+ * 最近一次成功连接的网络再加5分；信号相近时优先选择历史上稳定的网络。
+ *
+ * 【存储】
+ * 整个表作为一个blob保存，内容没变时不写Flash。
+ * 调用者分布在事件任务、wifi_manager管理器任务和httpd任务中，所有接口都在互斥锁内完成。
+ */
+
+#include "wifi_cred_store.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "wifi_manager_private.h"
+#include <string.h>
+
+#define TAG "wifi_cred"
+
+#define CRED_STORE_VERSION 1
+
+typedef struct
+{
+    uint8_t version;
+    uint8_t count;
+    uint16_t reserved;
+    uint32_t seq; // last_used的分配计数
+    wifi_cred_t entries[WIFI_CRED_STORE_MAX];
+} cred_table_t;
+
+static cred_table_t cred_table = {0};
+static SemaphoreHandle_t cred_mutex = NULL;
+
+static bool ssid_equal(const uint8_t *a, const uint8_t *b)
+{
+    return strncmp((const char *)a, (const char *)b, 32) == 0;
+}
+
+static int cred_find(const uint8_t *ssid)
+{
+    for (int i = 0; i < cred_table.count; i++)
+    {
+        if (ssid_equal(cred_table.entries[i].ssid, ssid))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief 写入NVS（调用者持有锁）
+ */
+static void cred_save(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+        return;
+    if (nvs_set_blob(nvs, WIFI_CRED_STORE_NVS_KEY, &cred_table, sizeof(cred_table)) != ESP_OK ||
+        nvs_commit(nvs) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "保存网络列表失败");
+    }
+    nvs_close(nvs);
+}
+
+void wifi_cred_store_init(void)
+{
+    if (cred_mutex == NULL)
+        cred_mutex = xSemaphoreCreateMutex();
+
+    memset(&cred_table, 0, sizeof(cred_table));
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        size_t len = sizeof(cred_table);
+        if (nvs_get_blob(nvs, WIFI_CRED_STORE_NVS_KEY, &cred_table, &len) != ESP_OK ||
+            len != sizeof(cred_table) || cred_table.version != CRED_STORE_VERSION ||
+            cred_table.count > WIFI_CRED_STORE_MAX)
+        {
+            memset(&cred_table, 0, sizeof(cred_table));
+        }
+        nvs_close(nvs);
+    }
+    cred_table.version = CRED_STORE_VERSION;
+    ESP_LOGI(TAG, "已保存 %d 个网络", cred_table.count);
+}
+
+int wifi_cred_store_count(void)
+{
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    int count = cred_table.count;
+    xSemaphoreGive(cred_mutex);
+    return count;
+}
+
+void wifi_cred_store_record_success(const uint8_t *ssid, const uint8_t *password, const uint8_t *bssid,
+                                    uint8_t channel, int8_t rssi)
+{
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    int idx = cred_find(ssid);
+    if (idx < 0)
+    {
+        if (cred_table.count < WIFI_CRED_STORE_MAX)
+        {
+            idx = cred_table.count++;
+        }
+        else
+        {
+            // 存满：替换最久未成功连接的网络
+            idx = 0;
+            for (int i = 1; i < cred_table.count; i++)
+            {
+                if (cred_table.entries[i].last_used < cred_table.entries[idx].last_used)
+                    idx = i;
+            }
+            ESP_LOGI(TAG, "网络列表已满，替换 %.32s", cred_table.entries[idx].ssid);
+        }
+        memset(&cred_table.entries[idx], 0, sizeof(wifi_cred_t));
+        memcpy(cred_table.entries[idx].ssid, ssid, 32);
+    }
+
+    wifi_cred_t *e = &cred_table.entries[idx];
+    wifi_cred_t before = *e;
+    memcpy(e->password, password, sizeof(e->password));
+    memcpy(e->bssid, bssid, sizeof(e->bssid));
+    e->channel = channel;
+    e->last_rssi = rssi;
+    e->fail_count = 0;
+    if (e->success_count < UINT16_MAX)
+        e->success_count++;
+    // 已经是最近使用的网络时不更新序号，减少Flash写入
+    bool most_recent = (e->last_used != 0 && e->last_used == cred_table.seq);
+    if (!most_recent)
+        e->last_used = ++cred_table.seq;
+
+    /**
+     * 只在影响下次选择的内容变化时写Flash：
+     * 连接参数、失败计数、最近使用顺序，以及评分上限内的成功次数。
+     * 同一个网络反复重连只会改变RSSI和已封顶的成功次数，不写Flash。
+     */
+    bool persist = before.success_count < 10 || before.fail_count != 0 || !most_recent ||
+                   memcmp(before.password, e->password, sizeof(e->password)) != 0 ||
+                   memcmp(before.bssid, e->bssid, sizeof(e->bssid)) != 0 || before.channel != e->channel;
+    if (persist)
+    {
+        cred_save();
+    }
+    xSemaphoreGive(cred_mutex);
+}
+
+void wifi_cred_store_record_failure(const uint8_t *ssid)
+{
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    int idx = cred_find(ssid);
+    if (idx >= 0 && cred_table.entries[idx].fail_count < 3)
+    {
+        cred_table.entries[idx].fail_count++;
+        cred_save();
+    }
+    xSemaphoreGive(cred_mutex);
+}
+
+esp_err_t wifi_cred_store_remove(const char *ssid)
+{
+    uint8_t key[32] = {0};
+    strncpy((char *)key, ssid, sizeof(key));
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    int idx = cred_find(key);
+    if (idx >= 0)
+    {
+        memmove(&cred_table.entries[idx], &cred_table.entries[idx + 1],
+                (cred_table.count - idx - 1) * sizeof(wifi_cred_t));
+        cred_table.count--;
+        memset(&cred_table.entries[cred_table.count], 0, sizeof(wifi_cred_t));
+        cred_save();
+        ret = ESP_OK;
+    }
+    xSemaphoreGive(cred_mutex);
+    return ret;
+}
+
+void wifi_cred_store_clear(void)
+{
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    if (cred_table.count > 0)
+    {
+        memset(cred_table.entries, 0, sizeof(cred_table.entries));
+        cred_table.count = 0;
+        cred_save();
+    }
+    xSemaphoreGive(cred_mutex);
+}
+
+void wifi_cred_store_observe(const wifi_ap_record_t *ap, int n, wifi_cred_seen_t *seen)
+{
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    for (int i = 0; i < n; i++)
+    {
+        int idx = cred_find(ap[i].ssid);
+        if (idx < 0)
+            continue;
+        wifi_cred_seen_t *s = &seen[idx];
+        if (!s->found || ap[i].rssi > s->rssi)
+        {
+            memcpy(s->ssid, ap[i].ssid, sizeof(s->ssid));
+            memcpy(s->bssid, ap[i].bssid, sizeof(s->bssid));
+            s->channel = ap[i].primary;
+            s->rssi = ap[i].rssi;
+            s->found = true;
+        }
+    }
+    xSemaphoreGive(cred_mutex);
+}
+
+/**
+ * @brief 候选评分（见文件头的选择规则）
+ */
+static int cred_score(const wifi_cred_t *e, int8_t rssi)
+{
+    int success = e->success_count > 10 ? 10 : e->success_count;
+    int fail = e->fail_count > 3 ? 3 : e->fail_count;
+    int score = rssi + 3 * success - 10 * fail;
+    if (e->last_used != 0 && e->last_used == cred_table.seq)
+        score += 5;
+    return score;
+}
+
+bool wifi_cred_store_pick(const wifi_cred_seen_t *seen, wifi_cred_t *out)
+{
+    bool found = false;
+    int best_score = 0;
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    for (int i = 0; i < WIFI_CRED_STORE_MAX; i++)
+    {
+        if (!seen[i].found)
+            continue;
+        // 按SSID重新查找：观察之后列表可能被修改
+        int idx = cred_find(seen[i].ssid);
+        if (idx < 0)
+            continue;
+        int score = cred_score(&cred_table.entries[idx], seen[i].rssi);
+        ESP_LOGI(TAG, "候选 %.32s: RSSI %d, 成功 %d 次, 分数 %d", seen[i].ssid, seen[i].rssi,
+                 cred_table.entries[idx].success_count, score);
+        if (!found || score > best_score)
+        {
+            found = true;
+            best_score = score;
+            *out = cred_table.entries[idx];
+            memcpy(out->bssid, seen[i].bssid, sizeof(out->bssid));
+            out->channel = seen[i].channel;
+            out->last_rssi = seen[i].rssi;
+        }
+    }
+    xSemaphoreGive(cred_mutex);
+    return found;
+}
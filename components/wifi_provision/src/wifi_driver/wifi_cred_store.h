@@ -0,0 +1,82 @@
+#ifndef _WIFI_CRED_STORE_H_
+#define _WIFI_CRED_STORE_H_
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** 最多保存的网络数量 */
+#define WIFI_CRED_STORE_MAX 5
+
+#define WIFI_CRED_STORE_NVS_KEY "creds"
+
+/**
+ * @brief 一组保存的网络凭据
+ */
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+    uint8_t bssid[6];       // 最近一次连接的AP
+    uint8_t channel;        // 最近一次连接的信道
+    int8_t last_rssi;       // 最近一次看到的信号强度
+    uint16_t success_count; // 累计连接成功次数
+    uint16_t fail_count;    // 连续认证失败次数（成功后清零）
+    uint32_t last_used;     // 最近一次连接成功的序号，越大越新
+} wifi_cred_t;
+
+/**
+ * @brief 一次扫描中看到的已保存网络（用于选择连接目标）
+ */
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    bool found;
+} wifi_cred_seen_t;
+
+/** 初始化并从NVS加载（需在nvs_flash_init之后调用） */
+void wifi_cred_store_init(void);
+
+/** 已保存的网络数量 */
+int wifi_cred_store_count(void);
+
+/**
+ * @brief 记录一次连接成功（不存在时新增，存满时替换最久未用的）
+ *
+ * 内容有变化时写入NVS
+ */
+void wifi_cred_store_record_success(const uint8_t *ssid, const uint8_t *password, const uint8_t *bssid,
+                                    uint8_t channel, int8_t rssi);
+
+/** 记录一次认证失败（路由器改了密码等） */
+void wifi_cred_store_record_failure(const uint8_t *ssid);
+
+/**
+ * @brief 删除保存的网络
+ * @return ESP_OK 已删除，ESP_ERR_NOT_FOUND 不存在
+ */
+esp_err_t wifi_cred_store_remove(const char *ssid);
+
+/** 删除所有保存的网络 */
+void wifi_cred_store_clear(void);
+
+/**
+ * @brief 从扫描结果中找出已保存的网络，每个SSID保留信号最强的BSSID
+ *
+ * @param seen 长度为WIFI_CRED_STORE_MAX的数组，第一次调用前清零，可以对多批结果重复调用
+ */
+void wifi_cred_store_observe(const wifi_ap_record_t *ap, int n, wifi_cred_seen_t *seen);
+
+/**
+ * @brief 按信号强度和历史记录选出最佳候选
+ *
+ * @param seen 由wifi_cred_store_observe填充
+ * @param out  输出凭据，bssid/channel/last_rssi为本次扫描看到的值
+ * @return true 找到候选，false 附近没有已保存的网络
+ */
+bool wifi_cred_store_pick(const wifi_cred_seen_t *seen, wifi_cred_t *out);
+
+#endif
@@ -0,0 +1,100 @@
+/**
+ * @file wifi_link_monitor.c
+ * @brief 链路质量统计 - RSSI平均值、历史记录和质量等级
+ *
+ * 【为什么用平均值？】
+ * 单次RSSI受人体遮挡、多径影响会跳动5~10 dB，直接用来判断会频繁误报。
+ * 指数加权平均只需要一个变量，α = 1/4 时大约4次采样（8秒）跟上真实变化。
+ * 平均值放大16倍用整数保存，不需要浮点运算。
+ *
+ * 【线程安全】
+ * 采样在esp_timer任务中进行，读取可能来自任何任务，统计数据都在临界区内读写。
+ */
+
+#include "wifi_link_monitor.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+static int32_t link_avg_x16 = 0; // 平均RSSI × 16
+static int8_t link_last = 0;
+static wifi_link_quality_t link_quality = WIFI_LINK_UNKNOWN;
+static int8_t link_ring[WIFI_LINK_HISTORY_LEN];
+static uint8_t link_ring_head = 0; // 下一次写入的位置
+static uint8_t link_ring_len = 0;
+static uint32_t link_samples = 0;
+static portMUX_TYPE link_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief 按平均RSSI划分等级；已经是GOOD/POOR时，要越过门限再加上回差才离开
+ */
+static wifi_link_quality_t link_classify(int avg, wifi_link_quality_t cur)
+{
+    int good = WIFI_LINK_GOOD_RSSI;
+    int poor = WIFI_LINK_POOR_RSSI;
+    switch (cur)
+    {
+    case WIFI_LINK_GOOD:
+        good -= WIFI_LINK_HYSTERESIS_DB;
+        break;
+    case WIFI_LINK_POOR:
+        poor += WIFI_LINK_HYSTERESIS_DB;
+        break;
+    default:
+        break;
+    }
+    if (avg >= good)
+        return WIFI_LINK_GOOD;
+    if (avg <= poor)
+        return WIFI_LINK_POOR;
+    return WIFI_LINK_FAIR;
+}
+
+void wifi_link_monitor_reset(void)
+{
+    taskENTER_CRITICAL(&link_lock);
+    link_avg_x16 = 0;
+    link_last = 0;
+    link_quality = WIFI_LINK_UNKNOWN;
+    link_ring_head = 0;
+    link_ring_len = 0;
+    link_samples = 0;
+    taskEXIT_CRITICAL(&link_lock);
+}
+
+bool wifi_link_monitor_sample(int8_t rssi)
+{
+    taskENTER_CRITICAL(&link_lock);
+    if (link_samples == 0)
+        link_avg_x16 = rssi * 16;
+    else
+        link_avg_x16 += (rssi * 16 - link_avg_x16) / (1 << WIFI_LINK_EWMA_SHIFT);
+    link_samples++;
+    link_last = rssi;
+
+    link_ring[link_ring_head] = rssi;
+    link_ring_head = (link_ring_head + 1) % WIFI_LINK_HISTORY_LEN;
+    if (link_ring_len < WIFI_LINK_HISTORY_LEN)
+        link_ring_len++;
+
+    wifi_link_quality_t q = link_classify(link_avg_x16 / 16, link_quality);
+    bool changed = q != link_quality;
+    link_quality = q;
+    taskEXIT_CRITICAL(&link_lock);
+    return changed;
+}
+
+void wifi_link_monitor_get(wifi_link_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    taskENTER_CRITICAL(&link_lock);
+    out->rssi = link_last;
+    out->rssi_avg = link_avg_x16 / 16;
+    out->quality = link_quality;
+    out->samples = link_samples;
+    out->history_len = link_ring_len;
+    // 环形缓冲区展开为从旧到新
+    uint8_t start = (link_ring_head + WIFI_LINK_HISTORY_LEN - link_ring_len) % WIFI_LINK_HISTORY_LEN;
+    for (uint8_t i = 0; i < link_ring_len; i++)
+        out->history[i] = link_ring[(start + i) % WIFI_LINK_HISTORY_LEN];
+    taskEXIT_CRITICAL(&link_lock);
+}
@@ -0,0 +1,53 @@
+#ifndef _WIFI_LINK_MONITOR_H_
+#define _WIFI_LINK_MONITOR_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * 驱动层的链路统计，不依赖组件的公共头文件；
+ * wifi_provision.c负责转换成wifi_provision_link_stats_t
+ */
+typedef enum
+{
+    WIFI_LINK_UNKNOWN, // 未连接或还没有采样
+    WIFI_LINK_GOOD,
+    WIFI_LINK_FAIR,
+    WIFI_LINK_POOR,
+} wifi_link_quality_t;
+
+/** RSSI历史记录长度（采样次数） */
+#define WIFI_LINK_HISTORY_LEN 16
+
+typedef struct
+{
+    int8_t rssi;                           // 最近一次采样
+    int8_t rssi_avg;                       // 指数加权平均
+    wifi_link_quality_t quality;
+    uint8_t history_len;                   // history中的有效采样数
+    int8_t history[WIFI_LINK_HISTORY_LEN]; // 最近的采样，从旧到新
+    uint32_t samples;                      // 本次连接的总采样次数
+} wifi_link_stats_t;
+
+/** 质量等级门限（平均RSSI，dBm） */
+#define WIFI_LINK_GOOD_RSSI -65
+#define WIFI_LINK_POOR_RSSI -78
+
+/** 回差（dB）：离开当前等级要多越过门限这么多，避免在门限附近来回跳 */
+#define WIFI_LINK_HYSTERESIS_DB 3
+
+/** 平均值的权重：avg += (rssi - avg) / 2^WIFI_LINK_EWMA_SHIFT */
+#define WIFI_LINK_EWMA_SHIFT 2
+
+/** 清空统计（每次连接成功后调用） */
+void wifi_link_monitor_reset(void);
+
+/**
+ * @brief 加入一次RSSI采样
+ * @return true 质量等级发生了变化
+ */
+bool wifi_link_monitor_sample(int8_t rssi);
+
+/** 读取统计 */
+void wifi_link_monitor_get(wifi_link_stats_t *out);
+
+#endif
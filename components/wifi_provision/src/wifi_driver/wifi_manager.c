@@ -7,30 +7,833 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "lwip/ip4_addr.h"
+#include "nvs.h"
+#include "prov_diag.h"
+#include "prov_trace.h"
+#include "wifi_cred_store.h"
+#include "wifi_link_monitor.h"
 #include "wifi_manager_private.h"
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define TAG "wifi_mgr"
 
 static wifi_manager_config_internal_t g_config = WIFI_MANAGER_DEFAULT_CONFIG();
-static int sta_connect_count = 0;
+/**
+ * STA连接状态机
+ *
+ * 【阶段】
+ * - PROVISION: 配网时连接用户刚输入的网络，重试预算小，密码错误立即失败，
+ *              让网页尽快提示用户重新输入
+ * - STEADY:    上电连接已保存的网络或连接成功之后，断线后持续重试，
+ *              设备不会因为路由器夜间重启而永久离线
+ *
+ * 【退避】
+ * 第n次重试延迟 = min(base * 2^n, max)，再取一半加随机抖动，避免多台设备同时重连；
+ * 延迟由esp_timer驱动，不占用事件循环任务。
+ */
+typedef enum
+{
+    STA_PHASE_IDLE,      // 没有可连接的网络
+    STA_PHASE_PROVISION, // 配网连接
+    STA_PHASE_STEADY,    // 常态连接
+} sta_phase_t;
+
+static sta_phase_t sta_phase = STA_PHASE_IDLE;
+static int sta_connect_count = 0;            // 本轮已重试次数
+static bool sta_fail_reported = false;       // 本轮断线是否已上报过连接失败
+static bool sta_disconnect_expected = false; // 主动断开产生的断线事件不计入重试
+static uint32_t sta_attempt = 0;             // 当前配网连接的序号（见wifi_manager_connect）
+static p_wifi_progress_callback progress_cb = NULL;
+static esp_timer_handle_t retry_timer = NULL;
 static esp_netif_t *ap_netif = NULL;
+static esp_netif_t *sta_netif = NULL;
 static p_wifi_state_callback wifi_state_cb = NULL;
 static bool is_sta_connected = false;
+static p_wifi_ap_sta_callback ap_sta_cb = NULL;
+static p_wifi_channel_switch_callback channel_switch_cb = NULL;
+static int ap_sta_count = 0; // 连接到热点的客户端数量（只在事件任务中修改）
+
+/**
+ * 管理器任务
+ *
+ * 【为什么需要？】
+ * 每次扫描临时创建任务会反复分配/释放4KB的栈；配网任务里的连接、
+ * 开关热点和扫描同时操作射频时会互相打断。所有射频操作都作为命令
+ * 排进这个常驻任务按顺序执行，任务栈和队列静态分配，运行期间没有堆分配。
+ */
+typedef enum
+{
+    WIFI_CMD_SCAN,    // 执行一次扫描（结果分发给所有等待者）
+    WIFI_CMD_CONNECT, // 连接新网络（配网）
+    WIFI_CMD_AP,      // 开启热点
+    WIFI_CMD_STOP_AP, // 关闭热点
+    WIFI_CMD_RETRY,   // 退避定时器到期后的重连
+    WIFI_CMD_ROAM,    // 链路变差，扫描更好的已知AP
+    WIFI_CMD_SCAN_REPLAY, // 把扫描缓存交给一个回调
+    WIFI_CMD_SELECT,  // 扫描并连接最合适的已知网络
+} wifi_cmd_type_t;
+
+typedef struct
+{
+    wifi_cmd_type_t type;
+    char ssid[33];
+    char password[65];
+    uint32_t attempt;             // CONNECT：配网连接序号
+    p_wifi_scan_callback scan_cb; // SCAN_REPLAY：接收缓存的回调
+} wifi_cmd_t;
+
+static StaticTask_t worker_tcb;
+static StackType_t worker_stack[WIFI_MANAGER_TASK_STACK_SIZE];
+static TaskHandle_t worker_task_handle = NULL;
+static StaticQueue_t worker_queue_buf;
+static uint8_t worker_queue_storage[WIFI_MANAGER_CMD_QUEUE_LEN * sizeof(wifi_cmd_t)];
+static QueueHandle_t worker_queue = NULL;
+
+static void worker_task(void *arg);
+static bool ap_has_clients(void);
 
 static SemaphoreHandle_t scan_semaphore = NULL;
-static TaskHandle_t scan_task_handle = NULL;
 
+/**
+ * 扫描结果缓存
+ *
+ * 【为什么需要缓存？】
+ * APSTA模式下每次扫描都会让射频离开热点信道，手机端的网页会卡顿。
+ * TTL内的扫描请求直接用缓存回答；扫描进行中的请求登记为等待者，
+ * 与正在进行的扫描共享同一份结果，不再返回ESP_ERR_INVALID_STATE。
+ *
+ * 缓存按SSID去重，同名热点只保留信号最强的BSSID。
+ * scan_building在扫描过程中逐批合并，扫描结束后与scan_cache交换。
+ *
+ * 【回调只在管理器任务中执行】
+ * 缓存命中和中途加入的等待者都不在调用者任务中直接回调：
+ * 缓存命中投递WIFI_CMD_SCAN_REPLAY，中途加入的等待者在下一批结果时先收到已合并的部分。
+ * 两个数组只由管理器任务修改，回调期间不持有scan_cache_mutex；
+ * 互斥量只保护其他任务读取缓存时间和内容（TTL判断、查找信道）。
+ */
+static wifi_ap_record_t *scan_cache = NULL;
+static wifi_ap_record_t *scan_building = NULL;
+static int scan_cache_count = 0;
+static int scan_building_count = 0;
+static int64_t scan_cache_time_us = 0; // 缓存生成时间，0表示无效
+static SemaphoreHandle_t scan_cache_mutex = NULL;
+
+/**
+ * 等待本次扫描结果的回调（自动去重）
+ *
+ * scan_open在分发最后一批（done）的同一临界区内清除，之后不再接受等待者，
+ * 迟到的调用者改为回放刚提交的缓存，不会登记后收不到done
+ */
 typedef struct
 {
     p_wifi_scan_callback cb;
-} wifi_scan_task_ctx_t;
+    bool synced; // 已收到之前的全部批次；中途加入的等待者先补发已合并的结果
+} scan_waiter_t;
+static scan_waiter_t scan_waiters[WIFI_MANAGER_SCAN_WAITERS];
+static int scan_waiter_count = 0;
+static bool scan_open = false; // 扫描进行中且还没有分发最后一批
+static portMUX_TYPE scan_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** 一批扫描结果的缓冲区（只在管理器任务中使用） */
+PROV_BULK_BSS static wifi_ap_record_t scan_batch[WIFI_MANAGER_SCAN_CACHE_MAX];
+
+/**
+ * 快速重连状态
+ *
+ * 【原理】
+ * 每次获取IP后把AP的BSSID、信道和租约写入NVS；下次上电时
+ * 指定bssid_set+channel直接连接，省去全信道扫描；
+ * 可选地直接复用上次的IP租约，省去DHCP交互。
+ * 快速连接失败一次就回退到普通流程（全信道扫描+DHCP）。
+ */
+static wifi_fast_hint_t fast_hint = {0};
+static bool fast_hint_valid = false;
+static bool fast_attempt = false;     // 当前连接是否使用了快速重连参数
+static bool fast_static_ip = false;   // 当前是否复用了上次的租约（DHCP客户端已停止）
+static bool boot_ip_reported = false; // 上电到获取IP的耗时只统计一次
+
+/**
+ * 已知网络选择
+ *
+ * 有已保存的网络时，上电、快速重连失败、配网失败和每次退避重连前先扫描一次，
+ * 由wifi_cred_store按RSSI和历史记录选出附近最合适的网络，指定BSSID/信道直接连接。
+ * 附近没有已知网络时按驱动保存的配置普通连接，由断线事件驱动后续退避。
+ */
+static wifi_cred_seen_t select_seen[WIFI_CRED_STORE_MAX];
+static bool select_running = false; // 选择扫描进行中（只在管理器任务中读写）
+static bool select_attempt = false; // 当前连接是否来自选择结果
+
+/**
+ * 配网前的STA配置
+ *
+ * 配网的账号密码只写入RAM，获取IP后才写入Flash；
+ * 连接失败时恢复这份配置并重新连接已知网络，输错的密码不会在重启后继续被使用
+ */
+static wifi_config_t sta_prev_cfg = {0};
+
+/**
+ * 链路监测与漫游
+ *
+ * 连接后用esp_timer定期读取RSSI（esp_wifi_sta_get_ap_info只读驱动中的值，不产生空口流量），
+ * 由wifi_link_monitor维护平均值、历史和质量等级，等级变化时回调上层。
+ * 等级为POOR时交给管理器任务扫描一次，wifi_cred_store选出的候选
+ * 比当前平均RSSI强WIFI_MANAGER_ROAM_MIN_GAIN_DB以上才切换，赶在断线之前换到更好的AP。
+ * 热点有客户端（正在配网）时不漫游。
+ */
+static esp_timer_handle_t link_timer = NULL;
+static p_wifi_link_callback link_cb = NULL;
+static int64_t roam_last_us = 0;    // 最近一次漫游扫描的时间，0表示本次连接还没有扫描过
+static bool roam_running = false;   // 漫游扫描进行中（只在管理器任务中修改）
+static wifi_cred_seen_t roam_seen[WIFI_CRED_STORE_MAX];
+
+/**
+ * @brief 向管理器任务提交命令
+ *
+ * @param wait 队列满时的等待时间；管理器任务自己提交时必须为0，否则可能死锁
+ */
+static esp_err_t worker_post(const wifi_cmd_t *cmd, TickType_t wait)
+{
+    if (worker_queue == NULL)
+        return ESP_ERR_INVALID_STATE;
+    if (xQueueSend(worker_queue, cmd, wait) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "命令队列已满，丢弃命令 %d", cmd->type);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 外部API提交命令（在管理器任务内调用时不等待）
+ */
+static esp_err_t worker_submit(const wifi_cmd_t *cmd)
+{
+    bool self = xTaskGetCurrentTaskHandle() == worker_task_handle;
+    return worker_post(cmd, self ? 0 : pdMS_TO_TICKS(WIFI_MANAGER_CMD_TIMEOUT_MS));
+}
+
+/**
+ * @brief 从NVS读取快速重连参数
+ */
+static void fast_hint_load(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+        return;
+    size_t len = sizeof(fast_hint);
+    fast_hint_valid = (nvs_get_blob(nvs, WIFI_MANAGER_NVS_KEY_HINT, &fast_hint, &len) == ESP_OK &&
+                       len == sizeof(fast_hint) && fast_hint.channel != 0);
+    nvs_close(nvs);
+}
+
+/**
+ * @brief 获取IP后保存快速重连参数（内容没变时不写Flash）
+ */
+static void fast_hint_save(const esp_netif_ip_info_t *ip_info)
+{
+    wifi_config_t sta_cfg = {0};
+    wifi_ap_record_t ap_info = {0};
+    if (esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) != ESP_OK || esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+        return;
+
+    wifi_fast_hint_t hint = {0};
+    memcpy(hint.ssid, sta_cfg.sta.ssid, sizeof(hint.ssid));
+    memcpy(hint.bssid, ap_info.bssid, sizeof(hint.bssid));
+    hint.channel = ap_info.primary;
+    hint.ip = ip_info->ip.addr;
+    hint.gw = ip_info->gw.addr;
+    hint.netmask = ip_info->netmask.addr;
+    esp_netif_dns_info_t dns = {0};
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK)
+        hint.dns = dns.ip.u_addr.ip4.addr;
+
+    if (fast_hint_valid && memcmp(&hint, &fast_hint, sizeof(hint)) == 0)
+        return;
+
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+        return;
+    if (nvs_set_blob(nvs, WIFI_MANAGER_NVS_KEY_HINT, &hint, sizeof(hint)) == ESP_OK && nvs_commit(nvs) == ESP_OK)
+    {
+        fast_hint = hint;
+        fast_hint_valid = true;
+        ESP_LOGI(TAG, "已保存快速重连参数 (信道 %d)", hint.channel);
+    }
+    nvs_close(nvs);
+}
+
+/**
+ * @brief 修改STA配置但不写入Flash
+ *
+ * 快速重连参数只对本次连接有效，不应覆盖驱动保存在NVS中的配网结果
+ */
+static void sta_set_config_volatile(wifi_config_t *cfg)
+{
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_wifi_set_config(WIFI_IF_STA, cfg);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+}
+
+/**
+ * @brief 连接选出的已知网络
+ *
+ * SSID/密码写入驱动配置（换网络后下次上电直接连接它），
+ * BSSID/信道只对本次连接有效；失败时由fast_fallback去掉限制重试
+ */
+static void sta_connect_cred(const wifi_cred_t *cred)
+{
+    wifi_config_t cfg = {0};
+    memcpy(cfg.sta.ssid, cred->ssid, sizeof(cfg.sta.ssid));
+    memcpy(cfg.sta.password, cred->password, sizeof(cfg.sta.password));
+
+    wifi_config_t cur = {0};
+    esp_wifi_get_config(WIFI_IF_STA, &cur);
+    if (memcmp(cur.sta.ssid, cfg.sta.ssid, sizeof(cfg.sta.ssid)) != 0 ||
+        memcmp(cur.sta.password, cfg.sta.password, sizeof(cfg.sta.password)) != 0)
+    {
+        esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    }
+
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, cred->bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = cred->channel;
+    cfg.sta.scan_method = WIFI_FAST_SCAN;
+    sta_set_config_volatile(&cfg);
+
+    fast_attempt = true;
+    select_attempt = true;
+    ESP_LOGI(TAG, "连接已知网络 %.32s (信道 %d, RSSI %d)", cred->ssid, cred->channel, cred->last_rssi);
+    esp_wifi_connect();
+}
+
+/**
+ * @brief 选择扫描的结果回调（管理器任务中执行）
+ */
+static void sta_select_on_scan(wifi_ap_record_t *ap, int ap_count, bool done)
+{
+    wifi_cred_store_observe(ap, ap_count, select_seen);
+    if (!done)
+        return;
+    select_running = false;
+
+    // 扫描期间用户开始了配网，不再抢占
+    if (sta_phase != STA_PHASE_STEADY)
+        return;
+
+    wifi_cred_t cred;
+    if (wifi_cred_store_pick(select_seen, &cred))
+    {
+        sta_connect_cred(&cred);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "附近没有已保存的网络");
+        esp_wifi_connect();
+    }
+}
+
+/**
+ * @brief 是否应该先扫描再选择网络
+ */
+static bool sta_should_select(void)
+{
+    return g_config.select_known_networks && sta_phase == STA_PHASE_STEADY && wifi_cred_store_count() > 0;
+}
+
+/**
+ * @brief 扫描并连接最合适的已知网络（管理器任务中执行）
+ */
+static void worker_do_select(void)
+{
+    if (select_running)
+        return;
+    select_running = true;
+    memset(select_seen, 0, sizeof(select_seen));
+    ESP_LOGI(TAG, "扫描附近的已知网络...");
+    if (wifi_manager_scan(sta_select_on_scan) != ESP_OK)
+    {
+        select_running = false;
+        esp_wifi_connect();
+    }
+}
+
+/**
+ * @brief 请管理器任务扫描并连接已知网络
+ *
+ * 常在事件任务中调用（STA_START、断线），投递时不等待，不阻塞事件循环；
+ * 队列满时退回普通连接，由断线事件驱动后续重试
+ */
+static void sta_select_start(void)
+{
+    wifi_cmd_t cmd = {.type = WIFI_CMD_SELECT};
+    if (worker_post(&cmd, 0) != ESP_OK)
+        esp_wifi_connect();
+}
+
+/**
+ * @brief 上电后的首次连接：有匹配的快速重连参数时指定BSSID和信道
+ */
+static void sta_connect_on_start(void)
+{
+    wifi_config_t sta_cfg = {0};
+    bool has_config = esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) == ESP_OK && sta_cfg.sta.ssid[0] != 0;
+    if (!has_config && wifi_cred_store_count() == 0)
+    {
+        ESP_LOGI(TAG, "没有保存的网络，等待配网");
+        sta_phase = STA_PHASE_IDLE;
+        return;
+    }
+    sta_phase = STA_PHASE_STEADY;
+    sta_connect_count = 0;
+
+    if (g_config.fast_reconnect && fast_hint_valid &&
+        memcmp(sta_cfg.sta.ssid, fast_hint.ssid, sizeof(fast_hint.ssid)) == 0)
+    {
+        sta_cfg.sta.bssid_set = true;
+        memcpy(sta_cfg.sta.bssid, fast_hint.bssid, sizeof(sta_cfg.sta.bssid));
+        sta_cfg.sta.channel = fast_hint.channel;
+        sta_cfg.sta.scan_method = WIFI_FAST_SCAN;
+        sta_set_config_volatile(&sta_cfg);
+        fast_attempt = true;
+        ESP_LOGI(TAG, "快速重连: 信道 %d, BSSID %02x:%02x:%02x:%02x:%02x:%02x", fast_hint.channel,
+                 fast_hint.bssid[0], fast_hint.bssid[1], fast_hint.bssid[2],
+                 fast_hint.bssid[3], fast_hint.bssid[4], fast_hint.bssid[5]);
+        esp_wifi_connect();
+        return;
+    }
+
+    // 没有可用的快速重连参数：有已保存的网络时先扫描选择，否则普通连接
+    if (!has_config || (g_config.select_known_networks && wifi_cred_store_count() > 0))
+        sta_select_start();
+    else
+        esp_wifi_connect();
+}
+
+/**
+ * @brief 关联成功后复用上次的租约（可选）
+ *
+ * 静态IP必须在关联成功后设置，esp_netif随后会发出IP_EVENT_STA_GOT_IP
+ */
+static void fast_apply_lease(void)
+{
+    if (!fast_attempt || !g_config.fast_reuse_lease || fast_hint.ip == 0)
+        return;
+    // 选择结果可能是另一个网络，只复用同一网络的租约
+    wifi_config_t sta_cfg = {0};
+    if (esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) != ESP_OK ||
+        memcmp(sta_cfg.sta.ssid, fast_hint.ssid, sizeof(fast_hint.ssid)) != 0)
+        return;
+
+    esp_netif_ip_info_t ip_info = {
+        .ip = {.addr = fast_hint.ip},
+        .netmask = {.addr = fast_hint.netmask},
+        .gw = {.addr = fast_hint.gw},
+    };
+    if (esp_netif_dhcpc_stop(sta_netif) != ESP_OK)
+        return;
+    fast_static_ip = true;
+    esp_netif_set_ip_info(sta_netif, &ip_info);
+    if (fast_hint.dns != 0)
+    {
+        esp_netif_dns_info_t dns = {0};
+        dns.ip.type = ESP_IPADDR_TYPE_V4;
+        dns.ip.u_addr.ip4.addr = fast_hint.dns;
+        esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+    ESP_LOGI(TAG, "复用上次的IP租约");
+}
+
+/**
+ * @brief 快速重连失败：去掉BSSID/信道限制并恢复DHCP，按普通流程重连
+ *
+ * @return true 已回退并重新发起连接，false 当前不是快速重连
+ */
+static bool fast_fallback(void)
+{
+    if (!fast_attempt)
+        return false;
+    fast_attempt = false;
+    bool was_select = select_attempt;
+    select_attempt = false;
+
+    if (fast_static_ip)
+    {
+        fast_static_ip = false;
+        esp_netif_dhcpc_start(sta_netif);
+    }
+
+    // 上电快速重连失败（设备可能换了地方）：先看看附近有没有别的已知网络
+    if (!was_select && sta_should_select())
+    {
+        ESP_LOGW(TAG, "快速重连失败，扫描附近的已知网络");
+        sta_select_start();
+        return true;
+    }
+
+    wifi_config_t sta_cfg = {0};
+    if (esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) == ESP_OK)
+    {
+        sta_cfg.sta.bssid_set = false;
+        sta_cfg.sta.channel = 0;
+        sta_cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        sta_set_config_volatile(&sta_cfg);
+    }
+    ESP_LOGW(TAG, "快速重连失败，回退到普通连接流程");
+    esp_wifi_connect();
+    return true;
+}
+
+/**
+ * @brief 判断断线原因是否为认证失败（通常是密码错误）
+ */
+static bool is_auth_failure(uint8_t reason)
+{
+    switch (reason)
+    {
+    case WIFI_REASON_AUTH_FAIL:
+    case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_MIC_FAILURE:
+    case WIFI_REASON_802_1X_AUTH_FAILED:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief 计算第attempt次重试的退避时间（带抖动）
+ */
+static uint32_t retry_backoff_ms(int attempt)
+{
+    uint32_t delay = g_config.backoff_base_ms;
+    for (int i = 0; i < attempt && delay < g_config.backoff_max_ms; i++)
+        delay *= 2;
+    if (delay > g_config.backoff_max_ms)
+        delay = g_config.backoff_max_ms;
+    // 等量抖动：[delay/2, delay]
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+/**
+ * @brief 上报配网连接进度（只在配网阶段）
+ */
+static void report_progress(WIFI_CONNECT_STAGE stage, uint8_t reason)
+{
+    if (progress_cb == NULL || sta_phase != STA_PHASE_PROVISION)
+        return;
+    wifi_connect_progress_t p = {
+        .attempt = sta_attempt,
+        .stage = stage,
+        .reason = reason,
+        .retry = (uint8_t)sta_connect_count,
+    };
+    progress_cb(&p);
+}
+
+/**
+ * @brief 退避定时器到期：交给管理器任务重连（运行在esp_timer任务中，不能阻塞）
+ */
+static void retry_timer_cb(void *arg)
+{
+    wifi_cmd_t cmd = {.type = WIFI_CMD_RETRY};
+    worker_post(&cmd, 0);
+}
+
+/**
+ * @brief 执行退避重连（管理器任务中执行，与扫描串行）
+ */
+static void worker_do_retry(void)
+{
+    if (sta_should_select())
+    {
+        sta_select_start();
+    }
+    else if (sta_phase != STA_PHASE_IDLE)
+    {
+        esp_wifi_connect();
+        report_progress(WIFI_CONNECT_STAGE_AUTH, 0);
+    }
+}
+
+/**
+ * @brief 安排一次退避重连
+ */
+static void retry_schedule(uint32_t delay_ms)
+{
+    esp_timer_stop(retry_timer);
+    esp_timer_start_once(retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+/**
+ * @brief 链路采样定时器（esp_timer任务中执行，不能阻塞）
+ */
+static void link_timer_cb(void *arg)
+{
+    wifi_ap_record_t ap_info;
+    if (!is_sta_connected || esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+        return;
+
+    bool changed = wifi_link_monitor_sample(ap_info.rssi);
+    wifi_link_stats_t stats;
+    wifi_link_monitor_get(&stats);
+    if (changed)
+    {
+        ESP_LOGI(TAG, "链路质量变化: %d (平均RSSI %d)", stats.quality, stats.rssi_avg);
+        if (link_cb)
+            link_cb(&stats);
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (g_config.roam && stats.quality == WIFI_LINK_POOR &&
+        (roam_last_us == 0 || now - roam_last_us >= (int64_t)WIFI_MANAGER_ROAM_COOLDOWN_MS * 1000))
+    {
+        roam_last_us = now;
+        wifi_cmd_t cmd = {.type = WIFI_CMD_ROAM};
+        worker_post(&cmd, 0);
+    }
+}
+
+/**
+ * @brief 连接成功：重新开始链路统计
+ */
+static void link_monitor_start(int8_t rssi)
+{
+    if (link_timer == NULL)
+        return;
+    wifi_link_monitor_reset();
+    wifi_link_monitor_sample(rssi);
+    roam_last_us = 0;
+    esp_timer_stop(link_timer);
+    esp_timer_start_periodic(link_timer, (uint64_t)g_config.link_sample_ms * 1000);
+}
+
+/**
+ * @brief 断线：停止采样，等级回到UNKNOWN
+ */
+static void link_monitor_stop(void)
+{
+    if (link_timer == NULL)
+        return;
+    esp_timer_stop(link_timer);
+    wifi_link_monitor_reset();
+}
+
+/**
+ * @brief 漫游扫描结果（管理器任务中执行）
+ */
+static void roam_on_scan(wifi_ap_record_t *ap, int ap_count, bool done)
+{
+    wifi_cred_store_observe(ap, ap_count, roam_seen);
+    if (!done)
+        return;
+    roam_running = false;
+
+    // 扫描期间断线或开始了配网
+    if (!is_sta_connected || sta_phase != STA_PHASE_STEADY)
+        return;
+
+    wifi_cred_t cred;
+    wifi_ap_record_t cur;
+    wifi_link_stats_t stats;
+    wifi_link_monitor_get(&stats);
+    if (!wifi_cred_store_pick(roam_seen, &cred) || esp_wifi_sta_get_ap_info(&cur) != ESP_OK)
+        return;
+    if (memcmp(cred.bssid, cur.bssid, sizeof(cur.bssid)) == 0 ||
+        cred.last_rssi < stats.rssi_avg + WIFI_MANAGER_ROAM_MIN_GAIN_DB)
+    {
+        ESP_LOGI(TAG, "附近没有明显更好的AP（当前平均RSSI %d）", stats.rssi_avg);
+        return;
+    }
+
+    ESP_LOGW(TAG, "链路变差（平均RSSI %d），漫游到 %.32s (RSSI %d)", stats.rssi_avg, cred.ssid, cred.last_rssi);
+    sta_disconnect_expected = true;
+    esp_wifi_disconnect();
+    sta_connect_cred(&cred);
+}
+
+/**
+ * @brief 开始一次漫游扫描（管理器任务中执行）
+ */
+static void worker_do_roam(void)
+{
+    if (roam_running || !is_sta_connected || sta_phase != STA_PHASE_STEADY || ap_has_clients())
+        return;
+    roam_running = true;
+    memset(roam_seen, 0, sizeof(roam_seen));
+    ESP_LOGI(TAG, "链路变差，扫描附近的已知AP...");
+    if (wifi_manager_scan(roam_on_scan) != ESP_OK)
+        roam_running = false;
+}
+
+/**
+ * @brief 从断线事件中取出SSID和原因
+ */
+static void sta_info_from_disconnect(wifi_state_info_t *info, const wifi_event_sta_disconnected_t *event)
+{
+    info->attempt = sta_attempt;
+    if (event == NULL)
+    {
+        info->reason = WIFI_REASON_UNSPECIFIED;
+        return;
+    }
+    size_t len = event->ssid_len < sizeof(info->ssid) - 1 ? event->ssid_len : sizeof(info->ssid) - 1;
+    memcpy(info->ssid, event->ssid, len);
+    info->ssid[len] = 0;
+    info->reason = event->reason;
+}
+
+/**
+ * @brief 上报连接失败（每轮断线只上报一次）
+ */
+static void report_connect_fail(const wifi_event_sta_disconnected_t *event)
+{
+    if (sta_fail_reported)
+        return;
+    sta_fail_reported = true;
+    if (wifi_state_cb)
+    {
+        wifi_state_info_t info = {0};
+        sta_info_from_disconnect(&info, event);
+        wifi_state_cb(WIFI_STATE_CONNECT_FAIL, &info);
+    }
+}
+
+/**
+ * @brief 配网连接失败：恢复配网前的配置，重新连接已知网络
+ *
+ * 没有任何已保存的网络时回到空闲，等待下一次配网
+ */
+static void sta_provision_recover(void)
+{
+    sta_set_config_volatile(&sta_prev_cfg);
+    sta_connect_count = 0;
+    if (sta_prev_cfg.sta.ssid[0] == 0 && wifi_cred_store_count() == 0)
+    {
+        sta_phase = STA_PHASE_IDLE;
+        return;
+    }
+    sta_phase = STA_PHASE_STEADY;
+    ESP_LOGI(TAG, "重新连接已保存的网络");
+    if (sta_should_select())
+        sta_select_start();
+    else
+        esp_wifi_connect();
+}
+
+/**
+ * @brief 配网连接成功：账号密码写入Flash（BSSID/信道提示不保存）
+ */
+static void sta_persist_config(void)
+{
+    wifi_config_t cfg = {0};
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK)
+        return;
+    cfg.sta.bssid_set = false;
+    cfg.sta.channel = 0;
+    esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    sta_prev_cfg = cfg;
+}
+
+/**
+ * @brief STA断线处理：根据阶段和断线原因决定重试、退避或失败
+ */
+static void sta_handle_disconnect(const wifi_event_sta_disconnected_t *event)
+{
+    uint8_t reason = event ? event->reason : WIFI_REASON_UNSPECIFIED;
+
+    if (is_sta_connected)
+    {
+        is_sta_connected = false;
+        link_monitor_stop();
+        if (wifi_state_cb)
+        {
+            wifi_state_info_t info = {0};
+            sta_info_from_disconnect(&info, event);
+            wifi_state_cb(WIFI_STATE_DISCONNECTED, &info);
+        }
+    }
+
+    // wifi_manager_connect主动断开旧连接产生的事件，新的连接已经发起
+    if (sta_disconnect_expected && reason == WIFI_REASON_ASSOC_LEAVE)
+    {
+        sta_disconnect_expected = false;
+        return;
+    }
+
+    if (fast_fallback())
+        return;
+
+    if (sta_phase == STA_PHASE_PROVISION)
+    {
+        // 密码错误：重试也没有意义，立即失败
+        if (is_auth_failure(reason) || sta_connect_count >= g_config.max_retry)
+        {
+            ESP_LOGW(TAG, "配网连接失败 (原因 %d, 已重试 %d 次)", reason, sta_connect_count);
+            esp_timer_stop(retry_timer);
+            report_connect_fail(event);
+            sta_provision_recover();
+            return;
+        }
+    }
+    else if (sta_phase == STA_PHASE_STEADY)
+    {
+        if (g_config.steady_max_retry >= 0 && sta_connect_count >= g_config.steady_max_retry)
+        {
+            ESP_LOGW(TAG, "重连次数用尽 (原因 %d)，停止重连", reason);
+            sta_phase = STA_PHASE_IDLE;
+            report_connect_fail(event);
+            return;
+        }
+        // 常态下的认证失败（路由器改了密码）：上报失败，以最大间隔慢速重试
+        if (is_auth_failure(reason))
+        {
+            wifi_config_t sta_cfg = {0};
+            if (esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) == ESP_OK)
+                wifi_cred_store_record_failure(sta_cfg.sta.ssid);
+            report_connect_fail(event);
+            sta_connect_count++;
+            uint32_t delay = g_config.backoff_max_ms;
+            ESP_LOGW(TAG, "认证失败 (原因 %d)，%d ms后重试", reason, (int)delay);
+            retry_schedule(delay);
+            return;
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    uint32_t delay = retry_backoff_ms(sta_connect_count);
+    sta_connect_count++;
+    ESP_LOGI(TAG, "断线 (原因 %d)，%d ms后重试... (%d)", reason, (int)delay, sta_connect_count);
+    report_progress(WIFI_CONNECT_STAGE_RETRY, reason);
+    retry_schedule(delay);
+}
+
+/**
+ * @brief 获取IP后把当前网络记入已知网络列表（配网成功的新网络在这里加入）
+ */
+static void sta_record_success(void)
+{
+    wifi_config_t sta_cfg = {0};
+    wifi_ap_record_t ap_info = {0};
+    if (esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) != ESP_OK || esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+        return;
+    wifi_cred_store_record_success(sta_cfg.sta.ssid, sta_cfg.sta.password, ap_info.bssid, ap_info.primary,
+                                   ap_info.rssi);
+}
 
 /**
  * @brief 事件处理逻辑 (重构后的核心)
@@ -42,32 +845,36 @@ static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_
         switch (event_id)
         {
         case WIFI_EVENT_STA_START:
-            esp_wifi_connect();
+            sta_connect_on_start();
             break;
         case WIFI_EVENT_STA_CONNECTED:
             ESP_LOGI(TAG, "已连接到 AP");
+            PROV_TRACE(WIFI_PROVISION_TRACE_STA_ASSOCIATED);
+            sta_disconnect_expected = false; // 主动断开的事件一定在新的关联之前到达
+            fast_apply_lease();
+            report_progress(WIFI_CONNECT_STAGE_DHCP, 0);
             break;
         case WIFI_EVENT_STA_DISCONNECTED:
-            if (is_sta_connected)
-            {
-                if (wifi_state_cb)
-                    wifi_state_cb(WIFI_STATE_DISCONNECTED);
-                is_sta_connected = false;
-            }
-            if (sta_connect_count < g_config.max_retry)
-            {
-                esp_wifi_connect();
-                sta_connect_count++;
-                ESP_LOGI(TAG, "重试连接... (%d/%d)", sta_connect_count, g_config.max_retry);
-            }
-            else
-            {
-                if (wifi_state_cb)
-                    wifi_state_cb(WIFI_STATE_CONNECT_FAIL);
-            }
+            sta_handle_disconnect((wifi_event_sta_disconnected_t *)event_data);
+            break;
+        case WIFI_EVENT_AP_START:
+            PROV_TRACE(WIFI_PROVISION_TRACE_AP_START);
             break;
         case WIFI_EVENT_AP_STACONNECTED:
-            ESP_LOGI(TAG, "客户端已连接到热点");
+            ap_sta_count++;
+            ESP_LOGI(TAG, "客户端已连接到热点（%d 台）", ap_sta_count);
+            if (ap_sta_cb)
+                ap_sta_cb(ap_sta_count);
+            break;
+        case WIFI_EVENT_AP_STADISCONNECTED:
+            if (ap_sta_count > 0)
+                ap_sta_count--;
+            ESP_LOGI(TAG, "客户端已断开热点（剩余 %d 台）", ap_sta_count);
+            if (ap_sta_cb)
+                ap_sta_cb(ap_sta_count);
+            break;
+        case WIFI_EVENT_AP_STOP:
+            ap_sta_count = 0;
             break;
         default:
             break;
@@ -79,10 +886,37 @@ static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_
         {
             ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
             ESP_LOGI(TAG, "获取到 IP: " IPSTR, IP2STR(&event->ip_info.ip));
+            PROV_TRACE(WIFI_PROVISION_TRACE_DHCP_DONE);
+            if (!boot_ip_reported)
+            {
+                boot_ip_reported = true;
+                ESP_LOGI(TAG, "上电到获取IP耗时: %d ms（%s）", (int)(esp_timer_get_time() / 1000),
+                         fast_attempt ? (fast_static_ip ? "快速重连+复用租约" : "快速重连") : "普通连接");
+            }
+            if (sta_phase == STA_PHASE_PROVISION)
+                sta_persist_config();
+            fast_hint_save(&event->ip_info);
+            sta_record_success();
+            fast_attempt = false;
+            select_attempt = false;
             is_sta_connected = true;
+            sta_phase = STA_PHASE_STEADY;
             sta_connect_count = 0;
+            sta_fail_reported = false;
+            esp_timer_stop(retry_timer);
             if (wifi_state_cb)
-                wifi_state_cb(WIFI_STATE_CONNECTED);
+            {
+                wifi_state_info_t info = {.ip = event->ip_info.ip.addr, .attempt = sta_attempt};
+                wifi_ap_record_t ap_info = {0};
+                if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
+                {
+                    memcpy(info.ssid, ap_info.ssid, sizeof(info.ssid) - 1);
+                    info.rssi = ap_info.rssi;
+                    info.channel = ap_info.primary;
+                }
+                link_monitor_start(info.rssi);
+                wifi_state_cb(WIFI_STATE_CONNECTED, &info);
+            }
         }
     }
 }
@@ -94,7 +928,7 @@ void wifi_manager_init(p_wifi_state_callback f)
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
     ap_netif = esp_netif_create_default_wifi_ap();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -105,6 +939,33 @@ void wifi_manager_init(p_wifi_state_callback f)
 
     scan_semaphore = xSemaphoreCreateBinary();
     xSemaphoreGive(scan_semaphore);
+    scan_cache_mutex = xSemaphoreCreateMutex();
+
+    // 先建好命令队列和任务，STA_START之后的重连/扫描都经由它执行
+    worker_queue = xQueueCreateStatic(WIFI_MANAGER_CMD_QUEUE_LEN, sizeof(wifi_cmd_t), worker_queue_storage,
+                                      &worker_queue_buf);
+    worker_task_handle = xTaskCreateStatic(worker_task, "wifi_mgr", WIFI_MANAGER_TASK_STACK_SIZE, NULL,
+                                           WIFI_MANAGER_TASK_PRIORITY, worker_stack, &worker_tcb);
+    PROV_DIAG_SET_TASK(WIFI_PROVISION_TASK_WIFI, worker_task_handle);
+
+    wifi_cred_store_init();
+    fast_hint_load();
+
+    const esp_timer_create_args_t retry_timer_args = {
+        .callback = retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &retry_timer));
+
+    if (g_config.link_sample_ms > 0)
+    {
+        const esp_timer_create_args_t link_timer_args = {
+            .callback = link_timer_cb,
+            .name = "wifi_link",
+            .skip_unhandled_events = true,
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&link_timer_args, &link_timer));
+    }
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_start());
@@ -112,13 +973,91 @@ void wifi_manager_init(p_wifi_state_callback f)
     ESP_LOGI(TAG, "WiFi 管理器初始化成功");
 }
 
-esp_err_t wifi_manager_connect(const char *ssid, const char *password)
+esp_err_t wifi_manager_connect(const char *ssid, const char *password, uint32_t attempt)
+{
+    if (ssid == NULL || password == NULL)
+        return ESP_ERR_INVALID_ARG;
+    wifi_cmd_t cmd = {.type = WIFI_CMD_CONNECT, .attempt = attempt};
+    strncpy(cmd.ssid, ssid, sizeof(cmd.ssid) - 1);
+    strncpy(cmd.password, password, sizeof(cmd.password) - 1);
+    return worker_submit(&cmd);
+}
+
+/**
+ * @brief 热点是否有客户端（此时离开热点信道会让手机的网页卡顿甚至掉线）
+ */
+static bool ap_has_clients(void)
+{
+    wifi_mode_t mode;
+    return esp_wifi_get_mode(&mode) == ESP_OK && mode == WIFI_MODE_APSTA && ap_sta_count > 0;
+}
+
+/**
+ * @brief 从扫描缓存中查找SSID所在的信道（未找到返回0）
+ */
+static uint8_t scan_cache_find_channel(const char *ssid)
+{
+    uint8_t channel = 0;
+    xSemaphoreTake(scan_cache_mutex, portMAX_DELAY);
+    for (int i = 0; i < scan_cache_count; i++)
+    {
+        if (strncmp((const char *)scan_cache[i].ssid, ssid, sizeof(scan_cache[i].ssid)) == 0)
+        {
+            channel = scan_cache[i].primary;
+            break;
+        }
+    }
+    xSemaphoreGive(scan_cache_mutex);
+    return channel;
+}
+
+/**
+ * @brief 连接新网络（管理器任务中执行）
+ *
+ * 【APSTA信道切换】
+ * STA关联到其他信道的路由器时，热点必须跟着切过去（驱动会发CSA通知手机），
+ * 网页的WebSocket会中断一小会儿。目标信道已知（刚扫描过）时：
+ * - 提前通知网页，网页据此显示提示并快速重连，而不是报“连接断开”
+ * - 把信道作为连接提示，驱动先扫描该信道，不用在所有信道之间来回跳
+ *
+ * 【取代进行中的连接】
+ * 上一次配网连接还在认证/重试时（比如用户发现密码输错马上重新提交），
+ * 直接断开并用新的账号密码连接，不用等上一次失败；
+ * 断开产生的事件不计入新连接的重试，旧连接迟到的结果由调用者按序号丢弃。
+ */
+static esp_err_t worker_do_connect(const char *ssid, const char *password, uint32_t attempt)
 {
+    // 已连接或正在连接/等待重试：断开时会产生一次断线事件
+    bool busy = is_sta_connected || sta_phase != STA_PHASE_IDLE;
+    if (sta_phase == STA_PHASE_PROVISION)
+        ESP_LOGI(TAG, "新的配网连接 #%lu 取代 #%lu", (unsigned long)attempt, (unsigned long)sta_attempt);
+
     wifi_config_t wifi_config = {0};
     strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
     strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
+    wifi_config.sta.channel = scan_cache_find_channel(ssid);
 
+    esp_timer_stop(retry_timer);
+    // 取代进行中的配网时，当前配置已经是上一次配网的账号密码，保留最初的那份
+    if (sta_phase != STA_PHASE_PROVISION && esp_wifi_get_config(WIFI_IF_STA, &sta_prev_cfg) == ESP_OK)
+    {
+        // 快速重连的BSSID/信道限制只对那一次连接有效
+        sta_prev_cfg.sta.bssid_set = false;
+        sta_prev_cfg.sta.channel = 0;
+        sta_prev_cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    sta_phase = STA_PHASE_PROVISION;
+    sta_attempt = attempt;
     sta_connect_count = 0;
+    sta_fail_reported = false;
+
+    // 配网连接的是新网络，放弃快速重连参数和复用的租约
+    fast_attempt = false;
+    if (fast_static_ip)
+    {
+        fast_static_ip = false;
+        esp_netif_dhcpc_start(sta_netif);
+    }
 
     wifi_mode_t mode;
     esp_wifi_get_mode(&mode);
@@ -129,16 +1068,162 @@ esp_err_t wifi_manager_connect(const char *ssid, const char *password)
     }
 
     // 在设置新配置和连接前，先主动断开当前连接并清除状态，消除警告
+    sta_disconnect_expected = busy;
     esp_wifi_disconnect();
 
-    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
-    return esp_wifi_connect();
+    wifi_config_t ap_cfg = {0};
+    if (wifi_config.sta.channel != 0 && ap_has_clients() && esp_wifi_get_config(WIFI_IF_AP, &ap_cfg) == ESP_OK &&
+        ap_cfg.ap.channel != wifi_config.sta.channel)
+    {
+        ESP_LOGI(TAG, "热点将从信道 %d 切换到 %d", ap_cfg.ap.channel, wifi_config.sta.channel);
+        if (channel_switch_cb)
+        {
+            channel_switch_cb(wifi_config.sta.channel);
+            vTaskDelay(pdMS_TO_TICKS(WIFI_MANAGER_CHANNEL_SWITCH_NOTICE_MS));
+        }
+    }
+
+    // 获取IP后才写入Flash（sta_persist_config）
+    sta_set_config_volatile(&wifi_config);
+    esp_err_t ret = esp_wifi_connect();
+    report_progress(WIFI_CONNECT_STAGE_AUTH, 0);
+    return ret;
 }
 
 esp_err_t wifi_manager_ap(void)
+{
+    wifi_cmd_t cmd = {.type = WIFI_CMD_AP};
+    return worker_submit(&cmd);
+}
+
+esp_err_t wifi_manager_set_ap_config(const wifi_manager_ap_config_t *config)
+{
+    if (config == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    size_t ssid_len = config->ssid ? strlen(config->ssid) : 0;
+    size_t pw_len = config->password ? strlen(config->password) : 0;
+    if ((config->ssid && (ssid_len == 0 || ssid_len > 32)) ||
+        (config->password && pw_len != 0 && (pw_len < 8 || pw_len > 63)) ||
+        config->channel > 13 || config->max_connection > 4)
+        return ESP_ERR_INVALID_ARG;
+    esp_ip4_addr_t ip;
+    if (config->ip && esp_netif_str_to_ip4(config->ip, &ip) != ESP_OK)
+        return ESP_ERR_INVALID_ARG;
+
+    if (config->ssid)
+        strncpy(g_config.ap_ssid, config->ssid, sizeof(g_config.ap_ssid));
+    if (config->password)
+        snprintf(g_config.ap_password, sizeof(g_config.ap_password), "%s", config->password);
+    if (config->ip)
+        snprintf(g_config.ap_ip, sizeof(g_config.ap_ip), "%s", config->ip);
+    g_config.ap_channel = config->channel;
+    if (config->max_connection)
+        g_config.ap_max_connection = config->max_connection;
+    return ESP_OK;
+}
+
+/**
+ * @brief 快速扫描一次，返回候选信道中最空闲的一个（失败返回0）
+ *
+ * 2.4GHz相邻信道的频谱互相重叠（间隔5个信道以内都有干扰），
+ * 每个热点按距离和信号强度给候选信道计分：
+ *   score += (rssi + 100) * (5 - |候选信道 - 热点信道|) / 5
+ * 分数最低的信道拥塞最轻。
+ */
+static uint8_t ap_pick_quiet_channel(void)
+{
+    wifi_scan_config_t scan_config = {
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = {.min = WIFI_MANAGER_AP_AUTO_DWELL_MS / 2, .max = WIFI_MANAGER_AP_AUTO_DWELL_MS},
+    };
+    if (esp_wifi_scan_start(&scan_config, true) != ESP_OK)
+        return 0;
+    uint16_t ap_num = WIFI_MANAGER_SCAN_CACHE_MAX;
+    if (esp_wifi_scan_get_ap_records(&ap_num, scan_batch) != ESP_OK)
+        return 0;
+
+    wifi_country_t country = {0};
+    uint8_t first_chan = 1;
+    uint8_t last_chan = 11;
+    if (esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0)
+    {
+        first_chan = country.schan;
+        last_chan = country.schan + country.nchan - 1;
+    }
+
+    static const uint8_t candidates[] = WIFI_MANAGER_AP_AUTO_CHANNELS;
+    uint8_t best = 0;
+    int32_t best_score = INT32_MAX;
+    for (int c = 0; c < (int)sizeof(candidates); c++)
+    {
+        uint8_t ch = candidates[c];
+        if (ch < first_chan || ch > last_chan)
+            continue;
+        int32_t score = 0;
+        for (int i = 0; i < ap_num; i++)
+        {
+            int d = abs((int)scan_batch[i].primary - ch);
+            int strength = scan_batch[i].rssi + 100;
+            if (d < 5 && strength > 0)
+                score += strength * (5 - d) / 5;
+        }
+        ESP_LOGD(TAG, "信道 %d 拥塞分数 %ld", ch, (long)score);
+        if (score < best_score)
+        {
+            best_score = score;
+            best = ch;
+        }
+    }
+    ESP_LOGI(TAG, "扫描到 %d 个热点，自动选择信道 %d", ap_num, best);
+    return best;
+}
+
+/**
+ * @brief 确定热点信道
+ *
+ * APSTA模式下射频只有一个，STA关联后热点会被拖到STA的信道上，
+ * 连着热点的手机会因此掉线重连。所以自动模式优先跟随STA：
+ * 已连接时用当前AP的信道，快速重连参数对应当前配置时用保存的信道；
+ * 都没有时才扫描选择最空闲的信道。
+ */
+static uint8_t ap_resolve_channel(wifi_mode_t mode)
+{
+    if (g_config.ap_channel != WIFI_MANAGER_AP_CHANNEL_AUTO)
+        return g_config.ap_channel;
+
+    wifi_ap_record_t sta_ap;
+    if (is_sta_connected && esp_wifi_sta_get_ap_info(&sta_ap) == ESP_OK)
+    {
+        ESP_LOGI(TAG, "热点跟随STA信道 %d", sta_ap.primary);
+        return sta_ap.primary;
+    }
+
+    wifi_config_t sta_cfg = {0};
+    if (fast_hint_valid && esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) == ESP_OK &&
+        memcmp(sta_cfg.sta.ssid, fast_hint.ssid, sizeof(fast_hint.ssid)) == 0 && fast_hint.channel != 0)
+    {
+        ESP_LOGI(TAG, "热点使用目标网络的信道 %d", fast_hint.channel);
+        return fast_hint.channel;
+    }
+
+    // 热点已经开着（重复进入配网）：保持原信道，不让已连接的手机掉线
+    wifi_config_t ap_cfg = {0};
+    if (mode == WIFI_MODE_APSTA && esp_wifi_get_config(WIFI_IF_AP, &ap_cfg) == ESP_OK && ap_cfg.ap.channel != 0)
+        return ap_cfg.ap.channel;
+
+    uint8_t ch = ap_pick_quiet_channel();
+    return ch ? ch : 1;
+}
+
+/**
+ * @brief 开启热点（管理器任务中执行）
+ */
+static esp_err_t worker_do_ap(void)
 {
     wifi_mode_t mode;
     esp_wifi_get_mode(&mode);
+    uint8_t channel = ap_resolve_channel(mode); // 在切换到APSTA之前扫描，避免打扰热点
     if (mode != WIFI_MODE_APSTA)
     {
         esp_wifi_set_mode(WIFI_MODE_APSTA);
@@ -146,12 +1231,12 @@ esp_err_t wifi_manager_ap(void)
 
     wifi_config_t wifi_config = {
         .ap = {
-            .ssid_len = strlen(g_config.ap_ssid),
-            .channel = 1,
-            .max_connection = 4,
-            .authmode = WIFI_AUTH_WPA2_PSK},
+            .ssid_len = strnlen(g_config.ap_ssid, sizeof(g_config.ap_ssid)),
+            .channel = channel,
+            .max_connection = g_config.ap_max_connection,
+            .authmode = g_config.ap_password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN},
     };
-    strncpy((char *)wifi_config.ap.ssid, g_config.ap_ssid, sizeof(wifi_config.ap.ssid));
+    memcpy(wifi_config.ap.ssid, g_config.ap_ssid, sizeof(g_config.ap_ssid));
     strncpy((char *)wifi_config.ap.password, g_config.ap_password, sizeof(wifi_config.ap.password));
 
     esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
@@ -171,57 +1256,406 @@ esp_err_t wifi_manager_ap(void)
     return esp_wifi_start();
 }
 
+void wifi_manager_set_ap_sta_callback(p_wifi_ap_sta_callback f)
+{
+    ap_sta_cb = f;
+}
+
+void wifi_manager_set_channel_switch_callback(p_wifi_channel_switch_callback f)
+{
+    channel_switch_cb = f;
+}
+
+int wifi_manager_get_ap_station_count(void)
+{
+    return ap_sta_count;
+}
+
 esp_err_t wifi_manager_stop_ap(void)
 {
-    return esp_wifi_set_mode(WIFI_MODE_STA);
+    wifi_cmd_t cmd = {.type = WIFI_CMD_STOP_AP};
+    return worker_submit(&cmd);
+}
+
+/**
+ * 渐进式扫描的信道分组（0表示空位）
+ *
+ * 最常用的1/6/11信道放在第一组，手机页面几百毫秒内就能看到大部分热点；
+ * 其余信道按相邻顺序分组，超出国家码允许范围的信道会被跳过。
+ */
+static const uint8_t scan_channel_groups[][4] = {
+    {1, 6, 11, 0},
+    {2, 3, 4, 5},
+    {7, 8, 9, 10},
+    {12, 13, 14, 0},
+};
+#define SCAN_GROUP_COUNT (int)(sizeof(scan_channel_groups) / sizeof(scan_channel_groups[0]))
+
+/**
+ * @brief 热点有客户端时改用短停留的扫描参数
+ *
+ * @return true 已调整（渐进式扫描还需要在信道之间让出时间）
+ */
+static bool scan_apply_apsta(wifi_scan_config_t *cfg)
+{
+    if (!g_config.apsta_gentle_scan || !ap_has_clients())
+        return false;
+    cfg->scan_type = WIFI_SCAN_TYPE_ACTIVE;
+    cfg->scan_time.active.min = WIFI_MANAGER_APSTA_SCAN_MIN_MS;
+    cfg->scan_time.active.max = WIFI_MANAGER_APSTA_SCAN_MAX_MS;
+    cfg->home_chan_dwell_time = WIFI_MANAGER_APSTA_HOME_DWELL_MS;
+    return true;
 }
 
 /**
- * @brief 扫描任务实现
+ * @brief 完整扫描：一次扫描所有信道，结束后回调一次
  */
-static void scan_task(void *pvParameters)
+static void scan_all_channels(p_wifi_scan_callback cb)
 {
-    wifi_scan_task_ctx_t *ctx = (wifi_scan_task_ctx_t *)pvParameters;
     wifi_scan_config_t scan_config = {0};
+    scan_apply_apsta(&scan_config);
 
     if (esp_wifi_scan_start(&scan_config, true) == ESP_OK)
     {
-        uint16_t ap_num = 0;
-        esp_wifi_scan_get_ap_num(&ap_num);
-        if (ap_num > 0)
+        // 驱动按信号强弱排序，超出缓冲区的弱信号记录随get_ap_records一起释放
+        uint16_t ap_num = WIFI_MANAGER_SCAN_CACHE_MAX;
+        if (esp_wifi_scan_get_ap_records(&ap_num, scan_batch) == ESP_OK && ap_num > 0)
         {
-            wifi_ap_record_t *ap_records = malloc(sizeof(wifi_ap_record_t) * ap_num);
-            if (ap_records)
-            {
-                esp_wifi_scan_get_ap_records(&ap_num, ap_records);
-                if (ctx->cb)
-                    ctx->cb(ap_records, ap_num);
-                free(ap_records);
-            }
+            if (cb)
+                cb(scan_batch, ap_num, true);
+            return;
         }
-        else
+    }
+    if (cb)
+        cb(NULL, 0, true);
+}
+
+/**
+ * @brief 扫描单个信道，把结果追加到scan_batch
+ *
+ * @param channel 信道号
+ * @param count   批次中已有的记录数
+ * @note 缓冲区剩余空间不够时只保留本信道信号最强的几条
+ */
+static void scan_one_channel(uint8_t channel, int *count)
+{
+    wifi_scan_config_t scan_config = {
+        .channel = channel,
+    };
+    bool gentle = scan_apply_apsta(&scan_config);
+
+    esp_err_t ret = esp_wifi_scan_start(&scan_config, true);
+    if (gentle)
+    {
+        // 回到热点信道一段时间，让积压的WebSocket数据发出去
+        vTaskDelay(pdMS_TO_TICKS(WIFI_MANAGER_APSTA_SLICE_GAP_MS));
+    }
+    if (ret != ESP_OK)
+    {
+        return;
+    }
+
+    uint16_t ap_num = WIFI_MANAGER_SCAN_CACHE_MAX - *count;
+    if (ap_num == 0)
+    {
+        esp_wifi_clear_ap_list();
+        return;
+    }
+    if (esp_wifi_scan_get_ap_records(&ap_num, scan_batch + *count) == ESP_OK)
+        *count += ap_num;
+}
+
+/**
+ * @brief 渐进式扫描：按信道组扫描，每组结束后立即回调本组结果
+ *
+ * 【为什么分组？】
+ * 阻塞扫描所有信道需要2~4秒，期间网页只能显示加载动画。
+ * 分组扫描时第一组（1/6/11）结束就能把结果推送出去，
+ * 用户可以更早选择网络，后续批次由网页增量合并。
+ */
+static void scan_progressive(p_wifi_scan_callback cb)
+{
+    wifi_country_t country = {0};
+    uint8_t first_chan = 1;
+    uint8_t last_chan = 13;
+    if (esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0)
+    {
+        first_chan = country.schan;
+        last_chan = country.schan + country.nchan - 1;
+    }
+
+    for (int g = 0; g < SCAN_GROUP_COUNT; g++)
+    {
+        int count = 0;
+
+        for (int i = 0; i < 4; i++)
+        {
+            uint8_t ch = scan_channel_groups[g][i];
+            if (ch == 0 || ch < first_chan || ch > last_chan)
+                continue;
+            scan_one_channel(ch, &count);
+        }
+
+        bool done = (g == SCAN_GROUP_COUNT - 1);
+        if (cb && (count > 0 || done))
+            cb(scan_batch, count, done);
+    }
+}
+
+/**
+ * @brief 把一批记录按SSID合并到数组中（同名保留信号最强的）
+ *
+ * @return 合并后的记录数（超过cap的新SSID会被丢弃）
+ */
+static int scan_merge_records(wifi_ap_record_t *dst, int count, int cap, const wifi_ap_record_t *src, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        int j = 0;
+        for (; j < count; j++)
+        {
+            if (strncmp((const char *)dst[j].ssid, (const char *)src[i].ssid, sizeof(dst[j].ssid)) == 0)
+                break;
+        }
+        if (j < count)
         {
-            if (ctx->cb)
-                ctx->cb(NULL, 0);
+            if (src[i].rssi > dst[j].rssi)
+                dst[j] = src[i];
         }
+        else if (count < cap)
+        {
+            dst[count++] = src[i];
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief 扫描批次分发：合并进缓存并转发给所有等待者
+ *
+ * 作为scan_progressive/scan_all_channels的回调，运行在管理器任务中。
+ * 最后一批先提交缓存，再在同一临界区内取出并清空等待表，
+ * 此后到达的调用者看到scan_open为false，改为回放缓存。
+ */
+static void scan_dispatch(wifi_ap_record_t *ap, int ap_count, bool done)
+{
+    xSemaphoreTake(scan_cache_mutex, portMAX_DELAY);
+    scan_building_count = scan_merge_records(scan_building, scan_building_count,
+                                             WIFI_MANAGER_SCAN_CACHE_MAX, ap, ap_count);
+    if (done)
+    {
+        wifi_ap_record_t *tmp = scan_cache;
+        scan_cache = scan_building;
+        scan_building = tmp;
+        scan_cache_count = scan_building_count;
+        scan_building_count = 0;
+        scan_cache_time_us = esp_timer_get_time();
+    }
+    xSemaphoreGive(scan_cache_mutex);
+
+    // 已合并的全部结果（最后一批时已经交换到scan_cache）
+    wifi_ap_record_t *merged = done ? scan_cache : scan_building;
+    int merged_count = done ? scan_cache_count : scan_building_count;
+
+    scan_waiter_t waiters[WIFI_MANAGER_SCAN_WAITERS];
+    int waiter_count;
+    taskENTER_CRITICAL(&scan_lock);
+    waiter_count = scan_waiter_count;
+    memcpy(waiters, scan_waiters, sizeof(waiters));
+    for (int i = 0; i < scan_waiter_count; i++)
+        scan_waiters[i].synced = true;
+    if (done)
+    {
+        scan_waiter_count = 0;
+        scan_open = false;
+    }
+    taskEXIT_CRITICAL(&scan_lock);
+
+    for (int i = 0; i < waiter_count; i++)
+    {
+        if (waiters[i].synced)
+            waiters[i].cb(ap, ap_count, done);
+        else
+            waiters[i].cb(merged, merged_count, done);
     }
+}
+
+/**
+ * @brief 执行一次扫描，缓存在最后一批分发时提交（管理器任务中执行）
+ */
+static void worker_do_scan(void)
+{
+    PROV_TRACE(WIFI_PROVISION_TRACE_SCAN_START);
+    if (g_config.progressive_scan)
+        scan_progressive(scan_dispatch);
+    else
+        scan_all_channels(scan_dispatch);
+    PROV_TRACE(WIFI_PROVISION_TRACE_SCAN_END);
+    ESP_LOGI(TAG, "扫描完成，缓存 %d 个热点", scan_cache_count);
 
     xSemaphoreGive(scan_semaphore);
-    scan_task_handle = NULL;
-    free(ctx);
-    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 把扫描缓存交给回调（管理器任务中执行）
+ *
+ * 缓存只由管理器任务修改，回调期间不需要持有scan_cache_mutex
+ */
+static void worker_do_scan_replay(p_wifi_scan_callback f)
+{
+    if (f)
+        f(scan_cache, scan_cache_count, true);
+}
+
+/**
+ * @brief 管理器任务：逐个执行队列中的命令
+ */
+static void worker_task(void *arg)
+{
+    wifi_cmd_t cmd;
+    for (;;)
+    {
+        if (xQueueReceive(worker_queue, &cmd, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        switch (cmd.type)
+        {
+        case WIFI_CMD_SCAN:
+            worker_do_scan();
+            break;
+        case WIFI_CMD_CONNECT:
+            worker_do_connect(cmd.ssid, cmd.password, cmd.attempt);
+            break;
+        case WIFI_CMD_AP:
+            worker_do_ap();
+            break;
+        case WIFI_CMD_STOP_AP:
+            esp_wifi_set_mode(WIFI_MODE_STA);
+            break;
+        case WIFI_CMD_RETRY:
+            worker_do_retry();
+            break;
+        case WIFI_CMD_ROAM:
+            worker_do_roam();
+            break;
+        case WIFI_CMD_SCAN_REPLAY:
+            worker_do_scan_replay(cmd.scan_cb);
+            break;
+        case WIFI_CMD_SELECT:
+            worker_do_select();
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 登记扫描等待者（同一个回调只登记一次）
+ *
+ * @return ESP_OK 新登记或已登记过，ESP_ERR_NO_MEM 等待表已满，
+ *         ESP_ERR_INVALID_STATE 最后一批已经分发（缓存已提交）
+ */
+static esp_err_t scan_add_waiter(p_wifi_scan_callback f)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    taskENTER_CRITICAL(&scan_lock);
+    if (!scan_open)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        for (int i = 0; i < scan_waiter_count; i++)
+        {
+            if (scan_waiters[i].cb == f)
+                ret = ESP_OK;
+        }
+        if (ret == ESP_ERR_NO_MEM && scan_waiter_count < WIFI_MANAGER_SCAN_WAITERS)
+        {
+            scan_waiters[scan_waiter_count].cb = f;
+            scan_waiters[scan_waiter_count].synced = false;
+            scan_waiter_count++;
+            ret = ESP_OK;
+        }
+    }
+    taskEXIT_CRITICAL(&scan_lock);
+    return ret;
+}
+
+/**
+ * @brief 请管理器任务把缓存交给回调
+ */
+static esp_err_t scan_replay_submit(p_wifi_scan_callback f)
+{
+    wifi_cmd_t cmd = {.type = WIFI_CMD_SCAN_REPLAY, .scan_cb = f};
+    return worker_submit(&cmd);
 }
 
 esp_err_t wifi_manager_scan(p_wifi_scan_callback f)
 {
+    if (f == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    // 1. 缓存在TTL内：交给管理器任务回放
+    xSemaphoreTake(scan_cache_mutex, portMAX_DELAY);
+    int64_t age_ms = (esp_timer_get_time() - scan_cache_time_us) / 1000;
+    bool cache_hit = scan_cache_time_us != 0 && age_ms < g_config.scan_cache_ttl_ms;
+    int cache_count = scan_cache_count;
+    xSemaphoreGive(scan_cache_mutex);
+    if (cache_hit)
+    {
+        ESP_LOGI(TAG, "使用扫描缓存（%d 个热点，%d ms前）", cache_count, (int)age_ms);
+        return scan_replay_submit(f);
+    }
+
+    // 2. 没有正在进行的扫描：启动新扫描
     if (xSemaphoreTake(scan_semaphore, 0) == pdTRUE)
     {
-        wifi_scan_task_ctx_t *ctx = malloc(sizeof(wifi_scan_task_ctx_t));
-        ctx->cb = f;
-        xTaskCreate(scan_task, "wifi_scan", 4096, ctx, 5, &scan_task_handle);
+        if (scan_cache == NULL)
+            scan_cache = PROV_MALLOC_BULK(WIFI_PROVISION_MEM_WIFI_MANAGER,
+                              sizeof(wifi_ap_record_t) * WIFI_MANAGER_SCAN_CACHE_MAX);
+        if (scan_building == NULL)
+            scan_building = PROV_MALLOC_BULK(WIFI_PROVISION_MEM_WIFI_MANAGER,
+                              sizeof(wifi_ap_record_t) * WIFI_MANAGER_SCAN_CACHE_MAX);
+        if (scan_cache == NULL || scan_building == NULL)
+        {
+            xSemaphoreGive(scan_semaphore);
+            return ESP_ERR_NO_MEM;
+        }
+
+        scan_building_count = 0;
+        taskENTER_CRITICAL(&scan_lock);
+        scan_waiters[0].cb = f;
+        scan_waiters[0].synced = true;
+        scan_waiter_count = 1;
+        scan_open = true;
+        taskEXIT_CRITICAL(&scan_lock);
+
+        wifi_cmd_t cmd = {.type = WIFI_CMD_SCAN};
+        if (worker_submit(&cmd) != ESP_OK)
+        {
+            taskENTER_CRITICAL(&scan_lock);
+            scan_waiter_count = 0;
+            scan_open = false;
+            taskEXIT_CRITICAL(&scan_lock);
+            xSemaphoreGive(scan_semaphore);
+            return ESP_ERR_NO_MEM;
+        }
         return ESP_OK;
     }
-    return ESP_ERR_INVALID_STATE;
+
+    // 3. 扫描进行中：合并到本次扫描，下一批时先收到已合并的部分结果
+    esp_err_t ret = scan_add_waiter(f);
+    if (ret == ESP_ERR_INVALID_STATE)
+    {
+        // 最后一批刚分发完，缓存已经提交
+        return scan_replay_submit(f);
+    }
+    return ret;
+}
+
+void wifi_manager_set_scan_cache_ttl(uint32_t ttl_ms)
+{
+    g_config.scan_cache_ttl_ms = ttl_ms;
 }
 
 esp_err_t wifi_manager_get_ip(char *ip_str)
@@ -237,3 +1671,76 @@ esp_err_t wifi_manager_get_ip(char *ip_str)
     }
     return ESP_FAIL;
 }
+
+void wifi_manager_get_ap_ip(char *ip_str)
+{
+    strcpy(ip_str, g_config.ap_ip);
+}
+
+void wifi_manager_set_link_callback(p_wifi_link_callback f)
+{
+    link_cb = f;
+}
+
+void wifi_manager_set_progress_callback(p_wifi_progress_callback f)
+{
+    progress_cb = f;
+}
+
+esp_err_t wifi_manager_get_link_stats(wifi_link_stats_t *out)
+{
+    if (!is_sta_connected)
+        return ESP_ERR_INVALID_STATE;
+    wifi_link_monitor_get(out);
+    return ESP_OK;
+}
+
+/**
+ * @brief 删除保存的快速重连参数
+ */
+static void fast_hint_erase(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK)
+    {
+        nvs_erase_key(nvs, WIFI_MANAGER_NVS_KEY_HINT);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    fast_hint_valid = false;
+}
+
+esp_err_t wifi_manager_forget_network(const char *ssid)
+{
+    if (ssid == NULL || ssid[0] == 0)
+        return ESP_ERR_INVALID_ARG;
+    esp_err_t ret = wifi_cred_store_remove(ssid);
+
+    // 驱动保存的也是这个网络时一并清除，否则下次上电还会连回去
+    wifi_config_t sta_cfg = {0};
+    if (esp_wifi_get_config(WIFI_IF_STA, &sta_cfg) == ESP_OK &&
+        strncmp((const char *)sta_cfg.sta.ssid, ssid, sizeof(sta_cfg.sta.ssid)) == 0)
+    {
+        wifi_config_t empty = {0};
+        esp_wifi_set_config(WIFI_IF_STA, &empty);
+        ret = ESP_OK;
+    }
+    if (strncmp((const char *)sta_prev_cfg.sta.ssid, ssid, sizeof(sta_prev_cfg.sta.ssid)) == 0)
+        memset(&sta_prev_cfg, 0, sizeof(sta_prev_cfg));
+    if (fast_hint_valid && strncmp((const char *)fast_hint.ssid, ssid, sizeof(fast_hint.ssid)) == 0)
+        fast_hint_erase();
+    if (ret == ESP_OK)
+        ESP_LOGI(TAG, "已删除保存的网络 %s", ssid);
+    return ret;
+}
+
+esp_err_t wifi_manager_forget_all(void)
+{
+    wifi_cred_store_clear();
+    fast_hint_erase();
+    memset(&sta_prev_cfg, 0, sizeof(sta_prev_cfg));
+    wifi_config_t empty = {0};
+    esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &empty);
+    ESP_LOGI(TAG, "已删除所有保存的网络");
+    return ret;
+}
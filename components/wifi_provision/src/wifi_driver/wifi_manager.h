@@ -2,6 +2,7 @@
 #define _WIFI_MANAGER_H_
 #include "esp_err.h"
 #include "esp_wifi.h"
+#include "wifi_link_monitor.h"
 
 typedef enum
 {
@@ -10,9 +11,58 @@ typedef enum
     WIFI_STATE_CONNECT_FAIL, // WiFi连接失败（密码错误、找不到热点等）
 } WIFI_STATE;
 
-// wifi状态变化回调函数
-typedef void (*p_wifi_state_callback)(WIFI_STATE state);
-typedef void (*p_wifi_scan_callback)(wifi_ap_record_t *ap, int ap_count);
+/** 状态变化附带的信息（只在回调期间有效） */
+typedef struct
+{
+    char ssid[33];   // 相关的网络
+    uint32_t ip;     // CONNECTED：获取到的IP（网络字节序），其他为0
+    int8_t rssi;     // CONNECTED：当前信号强度
+    uint8_t channel; // CONNECTED：AP所在信道
+    uint8_t reason;  // DISCONNECTED/CONNECT_FAIL：最近一次断线原因（wifi_err_reason_t）
+    uint32_t attempt; // 管理器当前处理的配网连接序号（wifi_manager_connect传入，之后的常态连接沿用）
+} wifi_state_info_t;
+
+/** 配网连接的进度阶段（驱动不单独报告认证/关联/握手，失败的环节由断线原因区分） */
+typedef enum
+{
+    WIFI_CONNECT_STAGE_AUTH,  // 已发起连接：查找AP、认证、关联、四次握手
+    WIFI_CONNECT_STAGE_DHCP,  // 关联和握手完成，等待获取IP
+    WIFI_CONNECT_STAGE_RETRY, // 本次尝试断线，退避后重试（reason有效）
+} WIFI_CONNECT_STAGE;
+
+typedef struct
+{
+    uint32_t attempt; // 配网连接序号
+    WIFI_CONNECT_STAGE stage;
+    uint8_t reason; // RETRY：断线原因（wifi_err_reason_t），其他为0
+    uint8_t retry;  // 已重试次数
+} wifi_connect_progress_t;
+
+/** 配网连接进度回调（在管理器任务或系统事件任务中执行，不要阻塞） */
+typedef void (*p_wifi_progress_callback)(const wifi_connect_progress_t *progress);
+
+/** 链路质量等级变化回调（在esp_timer任务中执行，不要阻塞） */
+typedef void (*p_wifi_link_callback)(const wifi_link_stats_t *stats);
+
+/** wifi状态变化回调函数（在系统事件任务中执行，不要阻塞） */
+typedef void (*p_wifi_state_callback)(WIFI_STATE state, const wifi_state_info_t *info);
+/** 扫描结果回调
+ * @param ap       本批热点记录（回调返回后失效）
+ * @param ap_count 本批热点数量
+ * @param done     true表示扫描结束，这是最后一批
+ * @note 渐进式扫描时每扫完一组信道回调一次，完整扫描只回调一次
+ */
+typedef void (*p_wifi_scan_callback)(wifi_ap_record_t *ap, int ap_count, bool done);
+/** 热点客户端数量变化回调
+ * @param station_count 当前连接到热点的客户端数量
+ * @note 在系统事件任务中执行，不要在回调中阻塞
+ */
+typedef void (*p_wifi_ap_sta_callback)(int station_count);
+/** 热点即将切换信道回调（APSTA下STA要连接其他信道上的路由器）
+ * @param channel 新信道
+ * @note 在管理器任务中执行；回调返回后等待WIFI_MANAGER_CHANNEL_SWITCH_NOTICE_MS再切换
+ */
+typedef void (*p_wifi_channel_switch_callback)(uint8_t channel);
 /** 初始化wifi，默认进入STA模式
  * @param f wifi状态变化回调函数
  * @return 无
@@ -22,27 +72,106 @@ void wifi_manager_init(p_wifi_state_callback f);
 /** 连接wifi
  * @param ssid
  * @param password
- * @return 成功/失败
+ * @param attempt 连接序号，之后的状态和进度回调都带上它，调用者据此丢弃被取代的连接的结果
+ * @return ESP_OK已提交给管理器任务，ESP_ERR_TIMEOUT命令队列已满
+ * @note 连接在管理器任务中异步执行，结果通过状态回调通知；
+ *       上一次连接还没有结果时直接取代它（断开并用新的账号密码重新连接）
  */
-esp_err_t wifi_manager_connect(const char *ssid, const char *password);
+esp_err_t wifi_manager_connect(const char *ssid, const char *password, uint32_t attempt);
+
+/** 设置配网连接进度回调 */
+void wifi_manager_set_progress_callback(p_wifi_progress_callback f);
+/** 热点参数 */
+typedef struct
+{
+    const char *ssid;       // 热点名称（1~32字节）
+    const char *password;   // 密码（8~63字节），空字符串表示开放热点
+    const char *ip;         // 热点IP（网关），如"192.168.100.1"，子网固定为/24
+    uint8_t channel;        // 信道1~13，WIFI_MANAGER_AP_CHANNEL_AUTO表示自动选择
+    uint8_t max_connection; // 最大客户端数量（1~4）
+} wifi_manager_ap_config_t;
+
+/** 自动选择热点信道：STA已连接或即将快速重连时跟随STA的信道，
+ *  否则快速扫描一次，选择1/6/11中最空闲的信道 */
+#define WIFI_MANAGER_AP_CHANNEL_AUTO 0
+
+/** 设置热点参数（下次开启AP时生效）
+ * @param config 热点参数，NULL字段保持原值
+ * @return ESP_OK成功，ESP_ERR_INVALID_ARG参数无效
+ */
+esp_err_t wifi_manager_set_ap_config(const wifi_manager_ap_config_t *config);
+
 /** 开启AP模式
- * @return 成功/失败
+ * @return ESP_OK已提交给管理器任务，ESP_ERR_TIMEOUT命令队列已满
  */
 esp_err_t wifi_manager_ap(void);
 /** 扫描wifi
- * @return 成功/失败
+ * @param f 扫描结果回调
+ * @return ESP_OK成功，ESP_ERR_NO_MEM内存不足或等待者已满，ESP_ERR_TIMEOUT命令队列已满
+ * @note 缓存有效期内回放缓存；扫描进行中时合并到正在进行的扫描；
+ *       回调总是在管理器任务中串行执行（包括缓存命中），不会在调用者任务中执行
  */
 esp_err_t wifi_manager_scan(p_wifi_scan_callback f);
 
+/** 设置扫描缓存有效期
+ * @param ttl_ms 有效期（毫秒），0表示不使用缓存
+ */
+void wifi_manager_set_scan_cache_ttl(uint32_t ttl_ms);
+
 /** 获取当前STA的IP地址字符串
  * @param ip_str 输出缓冲区（至少16字节）
  * @return ESP_OK成功，ESP_FAIL未连接
  */
 esp_err_t wifi_manager_get_ip(char *ip_str);
 
+/** 获取热点的IP地址字符串（即配网页面、强制门户DNS应答的地址）
+ * @param ip_str 输出缓冲区（至少16字节）
+ */
+void wifi_manager_get_ap_ip(char *ip_str);
+
+/** 设置热点客户端数量变化回调
+ * @param f 回调函数，NULL表示取消
+ */
+void wifi_manager_set_ap_sta_callback(p_wifi_ap_sta_callback f);
+
+/** 设置热点切换信道前的通知回调
+ * @param f 回调函数，NULL表示取消
+ */
+void wifi_manager_set_channel_switch_callback(p_wifi_channel_switch_callback f);
+
+/** 设置链路质量等级变化回调
+ * @param f 回调函数，NULL表示取消
+ */
+void wifi_manager_set_link_callback(p_wifi_link_callback f);
+
+/** 读取链路监测统计
+ * @return ESP_OK成功，ESP_ERR_INVALID_STATE未连接
+ */
+esp_err_t wifi_manager_get_link_stats(wifi_link_stats_t *out);
+
+/** 获取当前连接到热点的客户端数量
+ * @return 客户端数量，热点未开启时为0
+ */
+int wifi_manager_get_ap_station_count(void);
+
 /** 关闭AP模式，切换到纯STA模式
- * @return ESP_OK成功，ESP_FAIL失败
- * @note 配网成功后调用此函数关闭热点
+ * @return ESP_OK已提交给管理器任务，ESP_ERR_TIMEOUT命令队列已满
+ * @note 配网成功后调用此函数关闭热点；排在已提交的扫描/连接之后执行
  */
 esp_err_t wifi_manager_stop_ap(void);
+
+/** 删除一个已保存的网络
+ * @param ssid 网络名称
+ * @return ESP_OK成功，ESP_ERR_NOT_FOUND没有保存该网络，ESP_ERR_INVALID_ARG参数无效
+ * @note 配网成功的网络会自动保存（最多WIFI_CRED_STORE_MAX个，满了替换最久未用的），
+ *       上电和断线重连时在其中选择信号和历史记录最好的一个
+ */
+esp_err_t wifi_manager_forget_network(const char *ssid);
+
+/**
+ * @brief 删除所有保存的网络（凭据表、快速重连参数和驱动保存的配置）
+ *
+ * 当前连接不会主动断开，恢复出厂设置时调用后通常直接重启
+ */
+esp_err_t wifi_manager_forget_all(void);
 #endif
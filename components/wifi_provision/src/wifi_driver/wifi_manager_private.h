@@ -12,9 +12,80 @@ typedef struct
     char ap_ssid[32];
     char ap_password[64];
     char ap_ip[16];
-    int max_retry;
+    uint8_t ap_channel;         // 热点信道，0表示自动选择
+    uint8_t ap_max_connection;  // 热点最大客户端数量
+    int max_retry;              // 配网阶段的重试次数
+    int steady_max_retry;       // 常态下的重试次数，-1表示无限重试
+    uint32_t backoff_base_ms;   // 首次重试的退避时间
+    uint32_t backoff_max_ms;    // 退避时间上限
+    bool progressive_scan;      // 按信道组渐进扫描，每组完成后立即回调
+    uint32_t scan_cache_ttl_ms; // 扫描缓存有效期，0表示每次都重新扫描
+    bool fast_reconnect;        // 上电时使用保存的BSSID/信道直接连接
+    bool fast_reuse_lease;      // 快速重连时复用上次的IP租约（跳过DHCP）
+    bool select_known_networks; // 上电/断线时扫描并连接附近最合适的已保存网络
+    bool apsta_gentle_scan;     // 热点有客户端时分片扫描，尽量留在热点信道上
+    uint32_t link_sample_ms;    // 连接后RSSI采样周期，0表示不监测链路
+    bool roam;                  // 链路变差时后台扫描，切换到明显更好的已知AP
 } wifi_manager_config_internal_t;
 
+/**
+ * @brief 快速重连参数（保存在NVS中）
+ */
+typedef struct
+{
+    uint8_t ssid[32];  // 对应的SSID，与驱动中保存的配置一致时才使用
+    uint8_t bssid[6];  // 上次连接的AP
+    uint8_t channel;   // 上次连接的信道
+    uint8_t reserved;  // 对齐保留
+    uint32_t ip;       // 上次的租约（网络字节序）
+    uint32_t gw;
+    uint32_t netmask;
+    uint32_t dns;
+} wifi_fast_hint_t;
+
+#define WIFI_MANAGER_NVS_NAMESPACE "wifi_mgr"
+#define WIFI_MANAGER_NVS_KEY_HINT  "fast_hint"
+
+/** 扫描缓存容量（去重后的SSID数量） */
+#define WIFI_MANAGER_SCAN_CACHE_MAX 32
+
+/** 同时等待一次扫描结果的回调数量上限 */
+#define WIFI_MANAGER_SCAN_WAITERS 4
+
+/** 自动选择热点信道时的候选信道（互不重叠），国家码不允许的会被跳过 */
+#define WIFI_MANAGER_AP_AUTO_CHANNELS {1, 6, 11}
+
+/** 自动选择信道的快速扫描每个信道的停留时间（毫秒） */
+#define WIFI_MANAGER_AP_AUTO_DWELL_MS 40
+
+/**
+ * 热点有客户端时的扫描参数
+ *
+ * 每个信道只主动扫描很短的时间，信道之间回到热点信道停留一段时间，
+ * 让手机的WebSocket数据和信标及时送达；总扫描时间变长，但单次离开热点信道不超过几十毫秒。
+ */
+#define WIFI_MANAGER_APSTA_SCAN_MIN_MS   20 // 每个信道的主动扫描时间
+#define WIFI_MANAGER_APSTA_SCAN_MAX_MS   50
+#define WIFI_MANAGER_APSTA_HOME_DWELL_MS 60 // 整体扫描时驱动在信道之间回到热点信道的时间（30~150）
+#define WIFI_MANAGER_APSTA_SLICE_GAP_MS  60 // 渐进式扫描每个信道之间留在热点信道的时间
+
+/** 热点需要切换信道时，先通知网页，再等待这么久让通知发出去 */
+#define WIFI_MANAGER_CHANNEL_SWITCH_NOTICE_MS 150
+
+/** 漫游：候选AP至少比当前平均RSSI强这么多才切换（dB） */
+#define WIFI_MANAGER_ROAM_MIN_GAIN_DB 8
+
+/** 两次漫游扫描之间的最短间隔（毫秒），链路一直很差时按这个间隔重试 */
+#define WIFI_MANAGER_ROAM_COOLDOWN_MS 60000
+
+/** 管理器任务：栈静态分配（字节），扫描结果回调也在这个任务中执行 */
+#define WIFI_MANAGER_TASK_STACK_SIZE 4096
+#define WIFI_MANAGER_TASK_PRIORITY   5
+
+/** 命令队列深度，以及外部调用者在队列满时最多等待的时间 */
+#define WIFI_MANAGER_CMD_QUEUE_LEN     8
+#define WIFI_MANAGER_CMD_TIMEOUT_MS    100
+
 /**
  * @brief 默认内部配置
  */
@@ -22,6 +93,19 @@ typedef struct
     .ap_ssid = "ESP32_wifi",            \
     .ap_password = "12345678",          \
     .ap_ip = "192.168.100.1",           \
-    .max_retry = 1}
+    .ap_channel = 1,                    \
+    .ap_max_connection = 4,             \
+    .max_retry = 2,                     \
+    .steady_max_retry = -1,             \
+    .backoff_base_ms = 500,             \
+    .backoff_max_ms = 60000,            \
+    .progressive_scan = true,           \
+    .scan_cache_ttl_ms = 10000,         \
+    .fast_reconnect = true,             \
+    .fast_reuse_lease = false,          \
+    .select_known_networks = true,      \
+    .apsta_gentle_scan = true,          \
+    .link_sample_ms = 2000,             \
+    .roam = true}
 
 #endif // WIFI_MANAGER_PRIVATE_H
@@ -4,167 +4,1321 @@
  */
 
 #include "wifi_provision.h"
+#include "json_writer.h"  // 内部模块
+#include "dns_server.h"   // 内部模块
+#include "prov_bin.h"     // 内部模块
+#include "prov_blob.h"    // 内部模块
+#include "prov_cmd.h"     // 内部模块
+#include "prov_diag.h"    // 内部模块
+#include "prov_trace.h"   // 内部模块
+#include "scan_topn.h"    // 内部模块
+#include "web_assets.h"   // 构建时生成的网页资源表
 #include "wifi_manager.h" // 内部模块
 #include "ws_server.h"    // 内部模块
-#include <cJSON.h>
+#include <esp_timer.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/event_groups.h>
+#include <freertos/queue.h>
 #include <string.h>
 
 #define TAG "wifi_prov"
 
-/* 引用嵌入的 HTML 资源 */
-extern const uint8_t apcfg_html_start[] asm("_binary_apcfg_html_start");
-extern const uint8_t apcfg_html_end[]   asm("_binary_apcfg_html_end");
-
-/* 事件组定义 */
+/* 事件组定义（只用于配网成功后的交接等待） */
 static EventGroupHandle_t prov_ev_group;
-#define PROV_WIFI_CONNECTED_BIT BIT0
-#define PROV_WIFI_FAIL_BIT      BIT1
-#define PROV_WIFI_SUCCESS_BIT   BIT2
+#define PROV_STATUS_SENT_BIT    BIT0 // "connected" 帧已交给协议栈（发送完成回调）
+#define PROV_STATUS_ACK_BIT     BIT1 // 网页确认收到 "connected" 帧
+
+/* 配网任务消息 */
+typedef enum {
+    PROV_MSG_AP_JOIN, // 有手机连上热点，按需启动 Web 服务器
+    PROV_MSG_AP_IDLE, // 配网热点空闲超时
+    PROV_MSG_RESULT,  // 配网连接有了结果（event.type 为 CONNECTED 或 CONNECT_FAIL）
+} prov_msg_type_t;
+
+typedef struct {
+    prov_msg_type_t type;
+    wifi_provision_event_t event;
+} prov_msg_t;
+
+#define PROV_MSG_QUEUE_LEN 8
+static QueueHandle_t prov_queue = NULL;
+static StaticQueue_t prov_queue_buf;
+static uint8_t prov_queue_storage[PROV_MSG_QUEUE_LEN * sizeof(prov_msg_t)];
+
+/* 配网成功后的交接：收到网页确认立即关闭热点；只收到发送完成时再等一个往返；都没有则超时关闭 */
+#define PROV_HANDOVER_TIMEOUT_MS    3000
+#define PROV_HANDOVER_SENT_GRACE_MS 300
+
+/* 异步发送合并键：同类消息在发送队列中只保留最新一条 */
+#define PROV_WS_KEY_STATUS   1
+#define PROV_WS_KEY_PROGRESS 2
+
+/* JSON 输出缓冲区大小：扫描结果约 50 字节/热点，4KB 可容纳 60 个以上 */
+#define PROV_SCAN_JSON_BUF_SIZE   4096
+/* 扫描结果结尾 ],"batch":n,"done":false,"top":N} 的预留空间：
+ * batch 按 int32 最长 11 字符、top 2 位计算为 44 字节，留一点余量 */
+#define PROV_SCAN_JSON_TAIL_RESERVE 48
+#define PROV_STATUS_JSON_BUF_SIZE 192
+#define PROV_TIMELINE_JSON_BUF_SIZE 1024
+#define PROV_DIAG_JSON_BUF_SIZE   512
+
+/* 二进制协议缓冲区：每个热点最多 37 字节，1.5KB 足够一次扫描缓存的全部热点 */
+#define PROV_SCAN_BIN_BUF_SIZE   1536
+#define PROV_STATUS_BIN_BUF_SIZE 64
+
+#if CONFIG_WIFI_PROVISION_SCAN_TOP_N > 0
+/* 扫描结果前N名：堆和排序后的输出各一份，JSON 和二进制编码共用排序结果 */
+PROV_BULK_BSS static wifi_ap_record_t scan_top_heap[CONFIG_WIFI_PROVISION_SCAN_TOP_N];
+PROV_BULK_BSS static wifi_ap_record_t scan_top_sorted[CONFIG_WIFI_PROVISION_SCAN_TOP_N];
+static scan_topn_t scan_top = {
+    .heap = scan_top_heap,
+    .cap = CONFIG_WIFI_PROVISION_SCAN_TOP_N,
+};
+#endif
 
-static char current_ssid[33] = {0};
-static char current_password[65] = {0};
-static bool is_configuring = false;
 static wifi_provision_cb_t user_callback = NULL;
 
 /**
- * @brief 发送状态到网页
+ * 配网状态机
+ *
+ * 连接阶段、热点是否开启、当前网络和 IP 放在同一个结构体中，
+ * 由系统事件任务、Web 服务器任务和配网任务共同修改，统一在 prov_state_lock 内读写：
+ * "检查当前阶段 + 转换"是原子的，事件携带的是转换后的一致快照。
+ */
+static wifi_provision_status_t prov_status = {.phase = WIFI_PROVISION_PHASE_IDLE};
+static portMUX_TYPE prov_state_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * 配网连接序号（同样在 prov_state_lock 内读写）
+ *
+ * 每次提交账号密码加一并传给 wifi_manager_connect，新提交会取代还没有结果的上一次连接；
+ * 管理器的回调带着它正在处理的序号，CONNECTING 阶段序号不一致的结果和进度属于被取代的连接，直接丢弃。
+ */
+static uint32_t prov_attempt = 0;
+
+/** 状态事件订阅者（cb 为 NULL 表示空闲） */
+typedef struct {
+    wifi_provision_event_cb_t cb;
+    void *arg;
+} prov_subscriber_t;
+
+static prov_subscriber_t prov_subscribers[WIFI_PROVISION_MAX_SUBSCRIBERS];
+static portMUX_TYPE prov_sub_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * 配网热点空闲管理
+ *
+ * 热点开启后 Web 服务器延迟到第一台手机连上热点时才启动（不连就不占 8KB 栈）。
+ * 最近活动时间取 HTTP/WebSocket 请求、手机连上/断开热点中最晚的一次；
+ * 有手机连着且网页保持 WebSocket 连接时视为正在使用。
+ * 空闲超过 CONFIG_WIFI_PROVISION_AP_IDLE_TIMEOUT_S 秒后关闭热点和 Web 服务器，
+ * 并通过 WIFI_PROVISION_STATE_AP_TIMEOUT 通知应用。
+ */
+#define PROV_IDLE_CHECK_PERIOD_MS 1000
+static esp_timer_handle_t idle_timer = NULL;
+static int64_t prov_last_activity_us = 0;
+static portMUX_TYPE prov_activity_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void ws_receive_handle(const uint8_t *data, int len, ws_server_frame_type_t type);
+static void internal_wifi_cb(WIFI_STATE state, const wifi_state_info_t *info);
+
+/**
+ * @brief 分发状态事件：先调用 init 的回调（只有原来的四种状态），再按顺序调用订阅者
+ *
+ * 订阅表拷贝一份快照后再调用，回调执行期间不持有锁
+ */
+static void prov_emit(const wifi_provision_event_t *event)
+{
+    if (user_callback && event->type <= WIFI_PROVISION_STATE_AP_TIMEOUT) {
+        user_callback(event->type);
+    }
+
+    prov_subscriber_t subs[WIFI_PROVISION_MAX_SUBSCRIBERS];
+    taskENTER_CRITICAL(&prov_sub_lock);
+    memcpy(subs, prov_subscribers, sizeof(subs));
+    taskEXIT_CRITICAL(&prov_sub_lock);
+    for (int i = 0; i < WIFI_PROVISION_MAX_SUBSCRIBERS; i++) {
+        if (subs[i].cb) {
+            subs[i].cb(event, subs[i].arg);
+        }
+    }
+}
+
+/**
+ * @brief 修改热点开启标志并分发 APCFG_START/APCFG_STOP
+ */
+static void prov_set_apcfg_active(bool active)
+{
+    wifi_provision_event_t ev = {
+        .type = active ? WIFI_PROVISION_STATE_APCFG_START : WIFI_PROVISION_STATE_APCFG_STOP,
+        .time_us = esp_timer_get_time(),
+    };
+    taskENTER_CRITICAL(&prov_state_lock);
+    prov_status.apcfg_active = active;
+    ev.status = prov_status;
+    taskEXIT_CRITICAL(&prov_state_lock);
+    prov_emit(&ev);
+}
+
+/**
+ * @brief 向配网任务投递消息（不等待，队列满时丢弃）
+ */
+static void prov_post(prov_msg_type_t type, const wifi_provision_event_t *event)
+{
+    prov_msg_t msg = {.type = type};
+    if (event) {
+        msg.event = *event;
+    }
+    if (prov_queue == NULL || xQueueSend(prov_queue, &msg, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "配网任务队列已满，丢弃消息 %d", type);
+    }
+}
+
+/**
+ * @brief IP（网络字节序）转点分十进制
  */
-static void send_status_to_web(const char *status, const char *ssid, const char *ip)
+static void prov_ip_str(uint32_t ip, char *out, size_t out_len)
 {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "status", status);
-    cJSON_AddStringToObject(root, "ssid", ssid);
+    const uint8_t *b = (const uint8_t *)&ip;
+    snprintf(out, out_len, "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+}
+static esp_err_t blob_post_handle(const uint8_t *body, size_t len, char *resp, size_t resp_cap);
+
+/**
+ * @brief 以二进制协议发送状态（STATUS 帧）
+ */
+static void send_status_binary(const char *status, const char *ssid, const char *ip, uint8_t reason,
+                               ws_server_send_done_cb done_cb)
+{
+    uint8_t buf[PROV_STATUS_BIN_BUF_SIZE];
+    prov_bin_writer_t w;
+    prov_bin_writer_init(&w, buf, sizeof(buf), PROV_BIN_OP_STATUS);
+
+    uint8_t code = strcmp(status, "connected") == 0 ? PROV_BIN_STATUS_CONNECTED : PROV_BIN_STATUS_FAILED;
+    prov_bin_put_tlv(&w, PROV_BIN_T_STATUS, &code, 1);
+    prov_bin_put_tlv(&w, PROV_BIN_T_SSID, ssid, strnlen(ssid, 32));
+    unsigned int ip4[4];
+    if (ip && sscanf(ip, "%u.%u.%u.%u", &ip4[0], &ip4[1], &ip4[2], &ip4[3]) == 4) {
+        uint8_t ip_bytes[4] = {ip4[0], ip4[1], ip4[2], ip4[3]};
+        prov_bin_put_tlv(&w, PROV_BIN_T_IP, ip_bytes, sizeof(ip_bytes));
+    }
+    if (reason) {
+        prov_bin_put_tlv(&w, PROV_BIN_T_REASON, &reason, 1);
+    }
+
+    size_t len = 0;
+    const uint8_t *frame = prov_bin_finish(&w, &len);
+    if (frame) {
+        ws_server_send_async(frame, len, WS_SERVER_FRAME_BINARY, PROV_WS_KEY_STATUS, done_cb, NULL);
+    }
+}
+
+/**
+ * @brief 断线原因对应的连接环节（网页据此提示"密码错误""找不到网络"等）
+ */
+static const char *reason_stage_name(uint8_t reason)
+{
+    switch (reason) {
+        case WIFI_REASON_NO_AP_FOUND:
+        case WIFI_REASON_NO_AP_FOUND_W_COMPATIBLE_SECURITY:
+        case WIFI_REASON_NO_AP_FOUND_IN_AUTHMODE_THRESHOLD:
+        case WIFI_REASON_NO_AP_FOUND_IN_RSSI_THRESHOLD:
+            return "scan";
+        case WIFI_REASON_AUTH_EXPIRE:
+        case WIFI_REASON_AUTH_FAIL:
+        case WIFI_REASON_802_1X_AUTH_FAILED:
+            return "auth";
+        case WIFI_REASON_ASSOC_EXPIRE:
+        case WIFI_REASON_ASSOC_FAIL:
+            return "assoc";
+        case WIFI_REASON_MIC_FAILURE:
+        case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+        case WIFI_REASON_HANDSHAKE_TIMEOUT:
+            return "handshake";
+        default:
+            return "link";
+    }
+}
+
+/**
+ * @brief 发送状态到网页（JSON）和原生工具（二进制协议）
+ *
+ * @param reason 失败时的断线原因，0 表示不附带
+ */
+static void send_status_to_web(const char *status, const char *ssid, const char *ip, uint8_t reason,
+                               ws_server_send_done_cb done_cb)
+{
+    if (ws_server_has_sessions(WS_SERVER_FRAME_BINARY)) {
+        send_status_binary(status, ssid, ip, reason, done_cb);
+    }
+    if (!ws_server_has_sessions(WS_SERVER_FRAME_TEXT)) {
+        return;
+    }
+
+    char buf[PROV_STATUS_JSON_BUF_SIZE];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf));
+    json_writer_object_begin(&w);
+    json_writer_kv_string(&w, "status", status);
+    json_writer_kv_string(&w, "ssid", ssid);
     if (ip) {
-        cJSON_AddStringToObject(root, "ip", ip);
+        json_writer_kv_string(&w, "ip", ip);
+    }
+    if (reason) {
+        json_writer_kv_int(&w, "reason", reason);
+        json_writer_kv_string(&w, "stage", reason_stage_name(reason));
     }
+    json_writer_object_end(&w);
 
-    char *json_str = cJSON_PrintUnformatted(root);
-    ws_server_send((uint8_t *)json_str, strlen(json_str));
-    cJSON_free(json_str);
-    cJSON_Delete(root);
+    size_t len = 0;
+    const char *json_str = json_writer_finish(&w, &len);
+    if (json_str) {
+        ws_server_send_async((const uint8_t *)json_str, len, WS_SERVER_FRAME_TEXT, PROV_WS_KEY_STATUS, done_cb,
+                             NULL);
+    } else if (done_cb) {
+        done_cb(ESP_ERR_NO_MEM, NULL);
+    }
+}
+
+/**
+ * @brief "connected" 帧发送完成回调（在 httpd 任务中执行）
+ */
+static void connected_status_sent(esp_err_t result, void *arg)
+{
+    if (result == ESP_OK) {
+        xEventGroupSetBits(prov_ev_group, PROV_STATUS_SENT_BIT);
+    }
+}
+
+/**
+ * @brief 等待网页收到 "connected" 帧，取代固定 2 秒延时
+ *
+ * 帧交给 TCP 协议栈不代表已到达手机，立刻关闭热点仍可能丢失，
+ * 因此发送完成后再给网页一个往返的时间回复 {"ack":"connected"}。
+ * 不支持确认的旧页面最多多等 PROV_HANDOVER_SENT_GRACE_MS。
+ */
+static void wait_status_handover(void)
+{
+    EventBits_t bits = xEventGroupWaitBits(prov_ev_group, PROV_STATUS_ACK_BIT | PROV_STATUS_SENT_BIT,
+                                           pdFALSE, pdFALSE, pdMS_TO_TICKS(PROV_HANDOVER_TIMEOUT_MS));
+    if (!(bits & PROV_STATUS_ACK_BIT) && (bits & PROV_STATUS_SENT_BIT)) {
+        bits = xEventGroupWaitBits(prov_ev_group, PROV_STATUS_ACK_BIT, pdFALSE, pdFALSE,
+                                   pdMS_TO_TICKS(PROV_HANDOVER_SENT_GRACE_MS));
+    }
+    xEventGroupClearBits(prov_ev_group, PROV_STATUS_ACK_BIT | PROV_STATUS_SENT_BIT);
+
+    if (bits & PROV_STATUS_ACK_BIT) {
+        PROV_TRACE(WIFI_PROVISION_TRACE_STATUS_ACKED);
+        ESP_LOGI(TAG, "网页已确认，关闭热点");
+    } else if (bits & PROV_STATUS_SENT_BIT) {
+        ESP_LOGI(TAG, "状态已发送，网页未确认，关闭热点");
+    } else {
+        ESP_LOGW(TAG, "等待网页确认超时，关闭热点");
+    }
+}
+
+/**
+ * @brief 记录一次配网热点活动（手机连上/断开热点、进入配网）
+ */
+static void prov_touch(void)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&prov_activity_lock);
+    prov_last_activity_us = now;
+    taskEXIT_CRITICAL(&prov_activity_lock);
+}
+
+/**
+ * @brief 热点客户端数量变化（系统事件任务中执行）
+ */
+static void ap_station_changed(int station_count)
+{
+    prov_touch();
+    if (station_count > 0) {
+        prov_post(PROV_MSG_AP_JOIN, NULL);
+    }
+}
+
+/**
+ * @brief 热点即将切换信道（WiFi 管理器任务中执行）
+ *
+ * 发送 {"channel_switch":n}，网页据此提示用户并在连接中断后快速重连
+ */
+static void ap_channel_switching(uint8_t channel)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "{\"channel_switch\":%d}", channel);
+    ws_server_send_async((const uint8_t *)buf, len, WS_SERVER_FRAME_TEXT, 0, NULL, NULL);
+}
+
+/**
+ * @brief 空闲检查定时器回调（esp_timer 任务中执行，不阻塞）
+ *
+ * 判断为空闲时只向配网任务的消息队列投递 PROV_MSG_AP_IDLE，由状态机关闭热点
+ */
+static void idle_check_cb(void *arg)
+{
+    wifi_provision_status_t status;
+    wifi_provision_get_status(&status);
+    if (!status.apcfg_active || status.phase == WIFI_PROVISION_PHASE_CONNECTING) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (wifi_manager_get_ap_station_count() > 0 && ws_server_get_session_count() > 0) {
+        prov_touch(); // 网页正开着，不算空闲
+        return;
+    }
+
+    int64_t last;
+    taskENTER_CRITICAL(&prov_activity_lock);
+    last = prov_last_activity_us;
+    taskEXIT_CRITICAL(&prov_activity_lock);
+    int64_t ws_last = ws_server_get_last_activity();
+    if (ws_last > last) {
+        last = ws_last;
+    }
+
+    if (now - last >= (int64_t)CONFIG_WIFI_PROVISION_AP_IDLE_TIMEOUT_S * 1000000) {
+        prov_post(PROV_MSG_AP_IDLE, NULL); // 配网任务处理前可能重复投递，处理时会再检查一次
+    }
+}
+
+/**
+ * @brief 启动 Web 服务器（已在运行时什么也不做）
+ */
+static void start_web_server(void)
+{
+    if (ws_server_is_running()) {
+        return;
+    }
+    ws_server_config_t config = {
+        .assets = web_assets,
+        .asset_count = web_assets_count,
+        .cb = ws_receive_handle,
+        .max_frame_size = 1024, // 网页只发送命令和账号密码，转义后也远小于1KB
+        .post_cb = blob_post_handle,
+#if CONFIG_WIFI_PROVISION_WS_PING_INTERVAL_S > 0
+        .ping_interval_ms = CONFIG_WIFI_PROVISION_WS_PING_INTERVAL_S * 1000,
+        .ping_timeout_ms = CONFIG_WIFI_PROVISION_WS_PING_TIMEOUT_S * 1000,
+#endif
+    };
+#if CONFIG_WIFI_PROVISION_CAPTIVE_PORTAL
+    // 所有域名都解析到热点，手机连上后系统会自动弹出配网页
+    static char ap_ip[16];
+    wifi_manager_get_ap_ip(ap_ip);
+    config.portal_host = ap_ip;
+#endif
+    if (ws_server_start(&config) != ESP_OK) {
+        return;
+    }
+#if CONFIG_WIFI_PROVISION_CAPTIVE_PORTAL
+    if (dns_server_start(ap_ip) != ESP_OK) {
+        ESP_LOGW(TAG, "强制门户DNS启动失败，需手动打开 http://%s/", ap_ip);
+    }
+#endif
+}
+
+/**
+ * @brief 退出配网：关闭 Web 服务器和热点，释放服务器内存
+ */
+static void stop_apcfg(void)
+{
+    if (idle_timer) {
+        esp_timer_stop(idle_timer);
+    }
+#if CONFIG_WIFI_PROVISION_CAPTIVE_PORTAL
+    if (dns_server_stop() != ESP_OK) {
+        ESP_LOGW(TAG, "强制门户DNS没有按时停止");
+    }
+#endif
+    ws_server_stop();
+    wifi_manager_stop_ap();
+    PROV_TRACE(WIFI_PROVISION_TRACE_AP_TEARDOWN);
+    prov_set_apcfg_active(false);
+}
+
+#if CONFIG_WIFI_PROVISION_TRACE
+/**
+ * @brief 打印本次配网的时间线，可选推送到网页
+ *
+ * 推送格式：{"timeline":[{"ev":"ap_start","t":12345},...]}，t 为相对配网开始的毫秒数
+ * （微秒用 int32 只能表示 35 分钟，配网页开着时会话可以更长）。
+ * prov_task 和 httpd 任务都会调用，输出缓冲区放在栈上。
+ */
+static void report_timeline(bool push)
+{
+    wifi_provision_trace_event_t events[PROV_TRACE_RING_SIZE];
+    size_t n = wifi_provision_get_timeline(events, PROV_TRACE_RING_SIZE);
+    for (size_t i = 0; i < n; i++) {
+        ESP_LOGI(TAG, "[timeline] %-16s %7d ms", wifi_provision_trace_point_name(events[i].point),
+                 (int)(events[i].time_us / 1000));
+    }
+    if (!push) return;
+
+    char buf[PROV_TIMELINE_JSON_BUF_SIZE];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf));
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "timeline");
+    json_writer_array_begin(&w);
+    for (size_t i = 0; i < n; i++) {
+        json_writer_object_begin(&w);
+        json_writer_kv_string(&w, "ev", wifi_provision_trace_point_name(events[i].point));
+        json_writer_kv_int(&w, "t", (int32_t)(events[i].time_us / 1000));
+        json_writer_object_end(&w);
+    }
+    json_writer_array_end(&w);
+    json_writer_object_end(&w);
+
+    size_t len = 0;
+    const char *json_str = json_writer_finish(&w, &len);
+    if (json_str) {
+        ws_server_send_async((const uint8_t *)json_str, len, WS_SERVER_FRAME_TEXT, 0, NULL, NULL);
+    }
+}
+#endif
+
+/**
+ * @brief 配网连接成功：通知网页，等网页确认后关闭热点
+ */
+static void prov_finish_connected(const wifi_provision_status_t *status)
+{
+    char ip_str[16];
+    prov_ip_str(status->ip, ip_str, sizeof(ip_str));
+    ESP_LOGI(TAG, "WiFi 连接成功, IP: %s, RSSI: %d", ip_str, status->rssi);
+    xEventGroupClearBits(prov_ev_group, PROV_STATUS_ACK_BIT | PROV_STATUS_SENT_BIT);
+    send_status_to_web("connected", status->ssid, ip_str, 0, connected_status_sent);
+    PROV_TRACE(WIFI_PROVISION_TRACE_STATUS_SENT);
+#if CONFIG_WIFI_PROVISION_TRACE_PUSH
+    report_timeline(true);
+#endif
+
+    wait_status_handover();
+    stop_apcfg();
+#if CONFIG_WIFI_PROVISION_TRACE
+    report_timeline(false);
+#endif
 }
 
 /**
  * @brief 配网处理任务
+ *
+ * 状态转换在事件发生的任务中完成并立即通知订阅者，
+ * 这里只做需要阻塞的收尾工作（启动 Web 服务器、等待网页确认、关闭热点）。
  */
 static void wifi_provision_task(void *arg)
 {
-    EventBits_t bits;
-    const EventBits_t ALL_BITS = PROV_WIFI_CONNECTED_BIT | PROV_WIFI_FAIL_BIT | PROV_WIFI_SUCCESS_BIT;
+    prov_msg_t msg;
+    wifi_provision_status_t status;
 
     while (1) {
-        bits = xEventGroupWaitBits(prov_ev_group, ALL_BITS, pdTRUE, pdFALSE, portMAX_DELAY);
+        xQueueReceive(prov_queue, &msg, portMAX_DELAY);
+        wifi_provision_get_status(&status);
 
-        if (bits & PROV_WIFI_CONNECTED_BIT) {
-            ESP_LOGI(TAG, "开始连接 WiFi: %s", current_ssid);
-            wifi_manager_connect(current_ssid, current_password);
+        switch (msg.type) {
+            case PROV_MSG_AP_JOIN:
+                if (status.apcfg_active) {
+                    start_web_server();
+                }
+                break;
+            case PROV_MSG_RESULT:
+                if (msg.event.type == WIFI_PROVISION_STATE_CONNECTED) {
+                    prov_finish_connected(&msg.event.status);
+                } else {
+                    ESP_LOGW(TAG, "WiFi 连接失败 (原因 %d)", msg.event.reason);
+                    send_status_to_web("failed", msg.event.status.ssid, NULL, msg.event.reason, NULL);
+                }
+                break;
+            case PROV_MSG_AP_IDLE:
+                if (status.apcfg_active && status.phase != WIFI_PROVISION_PHASE_CONNECTING) {
+                    ESP_LOGI(TAG, "配网热点空闲 %d 秒，自动关闭", CONFIG_WIFI_PROVISION_AP_IDLE_TIMEOUT_S);
+                    stop_apcfg();
+                    wifi_provision_event_t ev = {
+                        .type = WIFI_PROVISION_STATE_AP_TIMEOUT,
+                        .time_us = esp_timer_get_time(),
+                    };
+                    wifi_provision_get_status(&ev.status);
+                    prov_emit(&ev);
+                }
+                break;
         }
+    }
+}
 
-        if (bits & PROV_WIFI_FAIL_BIT) {
-            ESP_LOGW(TAG, "WiFi 连接失败");
-            send_status_to_web("failed", current_ssid, NULL);
-            is_configuring = false;
-        }
+/**
+ * @brief 驱动层的链路统计转换成公共类型
+ */
+static wifi_provision_link_quality_t link_quality_from_driver(wifi_link_quality_t q)
+{
+    switch (q) {
+        case WIFI_LINK_GOOD:
+            return WIFI_PROVISION_LINK_GOOD;
+        case WIFI_LINK_FAIR:
+            return WIFI_PROVISION_LINK_FAIR;
+        case WIFI_LINK_POOR:
+            return WIFI_PROVISION_LINK_POOR;
+        default:
+            return WIFI_PROVISION_LINK_UNKNOWN;
+    }
+}
 
-        if (bits & PROV_WIFI_SUCCESS_BIT) {
-            char ip_str[16] = {0};
-            wifi_manager_get_ip(ip_str);
-            ESP_LOGI(TAG, "WiFi 连接成功, IP: %s", ip_str);
-            send_status_to_web("connected", current_ssid, ip_str);
-            is_configuring = false;
+static void link_stats_from_driver(wifi_provision_link_stats_t *out, const wifi_link_stats_t *in)
+{
+    memset(out, 0, sizeof(*out));
+    out->rssi = in->rssi;
+    out->rssi_avg = in->rssi_avg;
+    out->quality = link_quality_from_driver(in->quality);
+    out->samples = in->samples;
+    out->history_len = in->history_len;
+    if (out->history_len > WIFI_PROVISION_LINK_HISTORY_LEN) {
+        out->history_len = WIFI_PROVISION_LINK_HISTORY_LEN;
+    }
+    // 保留最新的采样
+    memcpy(out->history, in->history + (in->history_len - out->history_len), out->history_len);
+}
 
-            vTaskDelay(pdMS_TO_TICKS(2000));
-            ws_server_stop();
-            wifi_manager_stop_ap();
-        }
+/**
+ * @brief 链路质量等级变化（esp_timer 任务中执行）
+ */
+static void link_quality_changed(const wifi_link_stats_t *stats)
+{
+    wifi_provision_event_t ev = {
+        .type = WIFI_PROVISION_STATE_LINK_QUALITY,
+        .time_us = esp_timer_get_time(),
+    };
+    taskENTER_CRITICAL(&prov_state_lock);
+    if (prov_status.phase == WIFI_PROVISION_PHASE_CONNECTED) {
+        prov_status.rssi = stats->rssi_avg;
+        prov_status.link_quality = link_quality_from_driver(stats->quality);
     }
+    ev.status = prov_status;
+    taskEXIT_CRITICAL(&prov_state_lock);
+    prov_emit(&ev);
 }
 
 /**
- * @brief 内部 WiFi 状态回调
+ * @brief 配网连接进度（管理器任务或系统事件任务中执行）
+ *
+ * 发送 {"progress":"auth|dhcp|retry","ssid":..,"attempt":n,"retry":k[,"reason":r,"stage":..]}，
+ * 网页据此显示进行到哪一步，并在每次进度后重新计算超时
  */
-static void internal_wifi_cb(WIFI_STATE state)
+static void connect_progress(const wifi_connect_progress_t *progress)
 {
+    static const char *const stage_names[] = {
+        [WIFI_CONNECT_STAGE_AUTH] = "auth",
+        [WIFI_CONNECT_STAGE_DHCP] = "dhcp",
+        [WIFI_CONNECT_STAGE_RETRY] = "retry",
+    };
+    char ssid[33];
+    taskENTER_CRITICAL(&prov_state_lock);
+    bool current = prov_status.phase == WIFI_PROVISION_PHASE_CONNECTING && progress->attempt == prov_attempt;
+    memcpy(ssid, prov_status.ssid, sizeof(ssid));
+    taskEXIT_CRITICAL(&prov_state_lock);
+    if (!current || !ws_server_has_sessions(WS_SERVER_FRAME_TEXT)) {
+        return;
+    }
+
+    char buf[PROV_STATUS_JSON_BUF_SIZE];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf));
+    json_writer_object_begin(&w);
+    json_writer_kv_string(&w, "progress", stage_names[progress->stage]);
+    json_writer_kv_string(&w, "ssid", ssid);
+    json_writer_kv_int(&w, "attempt", (int32_t)progress->attempt);
+    json_writer_kv_int(&w, "retry", progress->retry);
+    if (progress->reason) {
+        json_writer_kv_int(&w, "reason", progress->reason);
+        json_writer_kv_string(&w, "stage", reason_stage_name(progress->reason));
+    }
+    json_writer_object_end(&w);
+
+    size_t len = 0;
+    const char *json_str = json_writer_finish(&w, &len);
+    if (json_str) {
+        ws_server_send_async((const uint8_t *)json_str, len, WS_SERVER_FRAME_TEXT, PROV_WS_KEY_PROGRESS, NULL,
+                             NULL);
+    }
+}
+
+/**
+ * @brief 内部 WiFi 状态回调（系统事件任务中执行）
+ *
+ * 在锁内完成阶段转换，再把带快照的事件分发给订阅者；
+ * 配网连接的结果另外交给配网任务收尾。
+ * 被新提交取代的连接的结果（序号不一致）不改变阶段，也不通知，新连接开始时会断开它。
+ */
+static void internal_wifi_cb(WIFI_STATE state, const wifi_state_info_t *info)
+{
+    int64_t now = esp_timer_get_time();
+    wifi_provision_event_t ev = {
+        .reason = info->reason,
+        .time_us = now,
+    };
+    wifi_provision_link_stats_t link = {.quality = WIFI_PROVISION_LINK_UNKNOWN};
+    if (state == WIFI_STATE_CONNECTED) {
+        wifi_provision_get_link_stats(&link); // 连接时已经采样了一次
+    }
+
+    taskENTER_CRITICAL(&prov_state_lock);
+    bool connecting = prov_status.phase == WIFI_PROVISION_PHASE_CONNECTING;
+    if (connecting && state != WIFI_STATE_DISCONNECTED && info->attempt != prov_attempt) {
+        taskEXIT_CRITICAL(&prov_state_lock);
+        ESP_LOGI(TAG, "忽略已被取代的连接 #%lu 的结果", (unsigned long)info->attempt);
+        return;
+    }
     switch (state) {
         case WIFI_STATE_CONNECTED:
-            if (is_configuring) xEventGroupSetBits(prov_ev_group, PROV_WIFI_SUCCESS_BIT);
-            if (user_callback) user_callback(WIFI_PROVISION_STATE_CONNECTED);
+            ev.type = WIFI_PROVISION_STATE_CONNECTED;
+            ev.provisioning = connecting;
+            prov_status.phase = WIFI_PROVISION_PHASE_CONNECTED;
+            if (info->ssid[0]) {
+                memcpy(prov_status.ssid, info->ssid, sizeof(prov_status.ssid));
+            }
+            prov_status.ip = info->ip;
+            prov_status.rssi = info->rssi;
+            prov_status.channel = info->channel;
+            prov_status.link_quality = link.quality;
+            prov_status.since_us = now;
             break;
         case WIFI_STATE_DISCONNECTED:
-            if (user_callback) user_callback(WIFI_PROVISION_STATE_DISCONNECTED);
+            ev.type = WIFI_PROVISION_STATE_DISCONNECTED;
+            prov_status.ip = 0;
+            prov_status.link_quality = WIFI_PROVISION_LINK_UNKNOWN;
+            // 配网时切换网络会先断开旧连接，这不改变"正在连接"的阶段
+            if (!connecting) {
+                prov_status.phase = WIFI_PROVISION_PHASE_IDLE;
+                prov_status.since_us = now;
+            }
             break;
         case WIFI_STATE_CONNECT_FAIL:
-            if (is_configuring) xEventGroupSetBits(prov_ev_group, PROV_WIFI_FAIL_BIT);
-            if (user_callback) user_callback(WIFI_PROVISION_STATE_CONNECT_FAIL);
+            ev.type = WIFI_PROVISION_STATE_CONNECT_FAIL;
+            ev.provisioning = connecting;
+            prov_status.phase = WIFI_PROVISION_PHASE_IDLE;
+            prov_status.ip = 0;
+            prov_status.link_quality = WIFI_PROVISION_LINK_UNKNOWN;
+            prov_status.since_us = now;
             break;
     }
+    ev.status = prov_status;
+    taskEXIT_CRITICAL(&prov_state_lock);
+
+    prov_emit(&ev);
+    if (ev.provisioning) {
+        prov_post(PROV_MSG_RESULT, &ev);
+    }
 }
 
 /**
- * @brief WiFi 扫描结果处理
+ * @brief 以 JSON 发送一批扫描结果
+ *
+ * 用流式写入器直接生成 {"wifi_list":[...],"batch":n,"done":bool,"top":N} 到静态缓冲区（可放在 PSRAM），不构建 cJSON 树；
+ * "top" 只在开启 CONFIG_WIFI_PROVISION_SCAN_TOP_N 时出现。
+ * 缓冲区放不下时在最后一个完整的热点记录处截断，保证输出始终是合法 JSON。
  */
-void wifi_scan_handle(wifi_ap_record_t *ap, int ap_count)
+static void scan_send_json(wifi_ap_record_t *ap, int ap_count, int batch, bool done)
 {
-    cJSON *root = cJSON_CreateObject();
-    cJSON *wifi_list = cJSON_AddArrayToObject(root, "wifi_list");
+    PROV_BULK_BSS static char scan_json_buf[PROV_SCAN_JSON_BUF_SIZE];
+    json_writer_t w;
+    json_writer_init(&w, scan_json_buf, sizeof(scan_json_buf));
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "wifi_list");
+    json_writer_array_begin(&w);
+
+    int written = 0;
     for (int i = 0; i < ap_count; i++) {
-        cJSON *ap_item = cJSON_CreateObject();
-        cJSON_AddStringToObject(ap_item, "ssid", (const char *)ap[i].ssid);
-        cJSON_AddNumberToObject(ap_item, "rssi", ap[i].rssi);
-        cJSON_AddBoolToObject(ap_item, "encrypted", (ap[i].authmode != WIFI_AUTH_OPEN));
-        cJSON_AddItemToArray(wifi_list, ap_item);
+        json_writer_mark_t mark = json_writer_mark(&w);
+        json_writer_object_begin(&w);
+        json_writer_key(&w, "ssid");
+        json_writer_string_n(&w, (const char *)ap[i].ssid, sizeof(ap[i].ssid));
+        json_writer_kv_int(&w, "rssi", ap[i].rssi);
+        json_writer_kv_bool(&w, "encrypted", (ap[i].authmode != WIFI_AUTH_OPEN));
+        json_writer_object_end(&w);
+        // 为结尾的 "],"batch":n,"done":false,"top":N}" 预留空间
+        if (json_writer_remaining(&w) < PROV_SCAN_JSON_TAIL_RESERVE) {
+            json_writer_rollback(&w, &mark);
+            ESP_LOGW(TAG, "扫描结果过多，只发送前 %d/%d 个", written, ap_count);
+            break;
+        }
+        written++;
+    }
+
+    json_writer_array_end(&w);
+    json_writer_kv_int(&w, "batch", batch);
+    json_writer_kv_bool(&w, "done", done);
+#if CONFIG_WIFI_PROVISION_SCAN_TOP_N > 0
+    json_writer_kv_int(&w, "top", CONFIG_WIFI_PROVISION_SCAN_TOP_N); // 每批都是完整的排序列表
+#endif
+    json_writer_object_end(&w);
+
+    size_t len = 0;
+    const char *json_str = json_writer_finish(&w, &len);
+    if (json_str) {
+        // 批次之间不能合并，否则网页会丢失前面批次的热点
+        ws_server_send_async((const uint8_t *)json_str, len, WS_SERVER_FRAME_TEXT, 0, NULL, NULL);
+    }
+}
+
+/**
+ * @brief 以二进制协议发送一批扫描结果（SCAN_RESULT 帧）
+ */
+static void scan_send_binary(wifi_ap_record_t *ap, int ap_count, int batch, bool done)
+{
+    PROV_BULK_BSS static uint8_t scan_bin_buf[PROV_SCAN_BIN_BUF_SIZE];
+    prov_bin_writer_t w;
+    prov_bin_writer_init(&w, scan_bin_buf, sizeof(scan_bin_buf), PROV_BIN_OP_SCAN_RESULT);
+    prov_bin_put_u8(&w, (uint8_t)batch);
+    uint8_t flags = done ? PROV_BIN_SCAN_FLAG_DONE : 0;
+#if CONFIG_WIFI_PROVISION_SCAN_TOP_N > 0
+    flags |= PROV_BIN_SCAN_FLAG_SNAPSHOT;
+#endif
+    prov_bin_put_u8(&w, flags);
+
+    for (int i = 0; i < ap_count; i++) {
+        if (prov_bin_remaining(&w) < PROV_BIN_AP_MAX_SIZE) {
+            ESP_LOGW(TAG, "扫描结果过多，二进制帧只发送前 %d/%d 个", i, ap_count);
+            break;
+        }
+        prov_bin_put_ap(&w, ap[i].ssid, ap[i].rssi, (uint8_t)ap[i].authmode, ap[i].primary);
+    }
+
+    size_t len = 0;
+    const uint8_t *frame = prov_bin_finish(&w, &len);
+    if (frame) {
+        ws_server_send_async(frame, len, WS_SERVER_FRAME_BINARY, 0, NULL, NULL);
+    }
+}
+
+/**
+ * @brief WiFi 扫描结果处理
+ *
+ * 渐进式扫描时每组信道回调一次，batch 从 0 开始递增，网页据此增量合并；done 为 true 表示最后一批。
+ * 开启 CONFIG_WIFI_PROVISION_SCAN_TOP_N 时先在设备上去重并选出信号最强的 N 个，
+ * 每批发送到目前为止的完整排序列表（前N名没变化的中间批次不发送），网页直接替换显示。
+ * 只为当前在线的客户端类型编码（浏览器 JSON / 原生工具二进制）。
+ * 扫描回调都在wifi_manager的管理器任务中串行执行，发送接口会拷贝数据，静态缓冲区可以安全复用。
+ */
+void wifi_scan_handle(wifi_ap_record_t *ap, int ap_count, bool done)
+{
+    static int batch = 0;
+    if (batch == 0) {
+        PROV_TRACE(WIFI_PROVISION_TRACE_SCAN_FIRST_BATCH);
+    }
+
+#if CONFIG_WIFI_PROVISION_SCAN_TOP_N > 0
+    if (batch == 0) {
+        scan_topn_reset(&scan_top);
+    }
+    bool changed = scan_topn_add(&scan_top, ap, ap_count);
+    if (!changed && !done && batch > 0) {
+        batch++;
+        return;
+    }
+    ap_count = scan_topn_sorted(&scan_top, scan_top_sorted);
+    ap = scan_top_sorted;
+#endif
+
+    if (ws_server_has_sessions(WS_SERVER_FRAME_TEXT)) {
+        scan_send_json(ap, ap_count, batch, done);
+    }
+    if (ws_server_has_sessions(WS_SERVER_FRAME_BINARY)) {
+        scan_send_binary(ap, ap_count, batch, done);
+    }
+    batch = done ? 0 : batch + 1;
+}
+
+/**
+ * @brief 收到账号密码：进入 CONNECTING 阶段并提交连接
+ *
+ * wifi_manager_connect 只把命令放进管理器队列，可以直接在 Web 服务器任务中调用。
+ * 上一次提交还在连接时也直接提交，新的序号取代旧的连接，不用等它超时失败。
+ */
+static void submit_credentials(const char *ssid, size_t ssid_len, const char *password, size_t password_len)
+{
+    char ssid_buf[33];
+    char password_buf[65];
+    snprintf(ssid_buf, sizeof(ssid_buf), "%.*s", (int)ssid_len, ssid);
+    snprintf(password_buf, sizeof(password_buf), "%.*s", (int)password_len, password);
+    PROV_TRACE(WIFI_PROVISION_TRACE_CREDENTIALS);
+
+    wifi_provision_event_t ev = {
+        .type = WIFI_PROVISION_STATE_CONNECTING,
+        .time_us = esp_timer_get_time(),
+    };
+    taskENTER_CRITICAL(&prov_state_lock);
+    uint32_t attempt = ++prov_attempt;
+    prov_status.phase = WIFI_PROVISION_PHASE_CONNECTING;
+    memcpy(prov_status.ssid, ssid_buf, sizeof(prov_status.ssid));
+    prov_status.ip = 0;
+    prov_status.since_us = ev.time_us;
+    ev.status = prov_status;
+    taskEXIT_CRITICAL(&prov_state_lock);
+    prov_emit(&ev);
+
+    ESP_LOGI(TAG, "开始连接 WiFi: %s (#%lu)", ssid_buf, (unsigned long)attempt);
+    if (wifi_manager_connect(ssid_buf, password_buf, attempt) != ESP_OK) {
+        // 管理器队列已满：按连接失败处理，网页会收到 "failed"
+        wifi_state_info_t info = {.reason = WIFI_REASON_UNSPECIFIED, .attempt = attempt};
+        memcpy(info.ssid, ssid_buf, sizeof(info.ssid));
+        internal_wifi_cb(WIFI_STATE_CONNECT_FAIL, &info);
+    }
+    memset(password_buf, 0, sizeof(password_buf));
+}
+
+/**
+ * @brief 预签名配网数据的处理结果名称（用于回复）
+ */
+static const char *blob_result_name(esp_err_t ret)
+{
+    switch (ret) {
+        case ESP_OK:
+            return "accepted";
+        case ESP_ERR_NOT_SUPPORTED:
+            return "disabled";
+        case ESP_ERR_INVALID_CRC:
+            return "bad_signature";
+        case ESP_ERR_INVALID_STATE:
+            return "replayed";
+        default:
+            return "malformed";
+    }
+}
+
+/**
+ * @brief 预签名配网数据校验通过：记录 seq，不扫描直接连接
+ */
+static esp_err_t blob_apply(esp_err_t ret, const prov_blob_creds_t *creds)
+{
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "拒绝配网数据: %s", blob_result_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "收到预签名配网数据: %s (seq %lu)", creds->ssid, (unsigned long)creds->seq);
+    prov_blob_accept(creds->seq);
+    submit_credentials(creds->ssid, strlen(creds->ssid), creds->password, strlen(creds->password));
+    return ESP_OK;
+}
+
+/**
+ * POST /provision，请求体为原始配网数据 -> {"provision":"accepted|disabled|bad_signature|replayed|malformed"}
+ *
+ * 接受后连接结果和网页一样通过 WebSocket 的 status 消息通知
+ */
+static esp_err_t blob_post_handle(const uint8_t *body, size_t len, char *resp, size_t resp_cap)
+{
+    prov_blob_creds_t creds;
+    esp_err_t ret = blob_apply(prov_blob_parse(body, len, &creds), &creds);
+    snprintf(resp, resp_cap, "{\"provision\":\"%s\"}", blob_result_name(ret));
+    return ret;
+}
+
+/**
+ * @brief 二进制协议请求处理（格式见 prov_bin.h）
+ */
+static void handle_binary_request(const uint8_t *data, int len)
+{
+    prov_bin_reader_t r;
+    int opcode = prov_bin_reader_init(&r, data, len);
+    uint8_t type, value_len;
+    const uint8_t *value;
+
+    switch (opcode) {
+        case PROV_BIN_OP_SCAN_REQ:
+            wifi_manager_scan(wifi_scan_handle);
+            break;
+        case PROV_BIN_OP_CONNECT: {
+            const uint8_t *ssid = NULL, *password = NULL;
+            uint8_t ssid_len = 0, password_len = 0;
+            while (prov_bin_next_tlv(&r, &type, &value, &value_len)) {
+                if (type == PROV_BIN_T_SSID) {
+                    ssid = value;
+                    ssid_len = value_len;
+                } else if (type == PROV_BIN_T_PASSWORD) {
+                    password = value;
+                    password_len = value_len;
+                }
+            }
+            if (ssid && password) {
+                submit_credentials((const char *)ssid, ssid_len, (const char *)password, password_len);
+            } else {
+                ESP_LOGW(TAG, "二进制 CONNECT 缺少 SSID 或密码");
+            }
+            break;
+        }
+        case PROV_BIN_OP_PROVISION: {
+            esp_err_t ret = ESP_ERR_INVALID_SIZE;
+            prov_blob_creds_t creds;
+            while (prov_bin_next_tlv(&r, &type, &value, &value_len)) {
+                if (type == PROV_BIN_T_BLOB) {
+                    ret = prov_blob_parse(value, value_len, &creds);
+                }
+            }
+            if (blob_apply(ret, &creds) != ESP_OK) {
+                uint8_t buf[8];
+                prov_bin_writer_t w;
+                prov_bin_writer_init(&w, buf, sizeof(buf), PROV_BIN_OP_STATUS);
+                uint8_t code = PROV_BIN_STATUS_REJECTED;
+                prov_bin_put_tlv(&w, PROV_BIN_T_STATUS, &code, 1);
+                size_t frame_len = 0;
+                const uint8_t *frame = prov_bin_finish(&w, &frame_len);
+                if (frame) {
+                    ws_server_send_async(frame, frame_len, WS_SERVER_FRAME_BINARY, 0, NULL, NULL);
+                }
+            }
+            break;
+        }
+        case PROV_BIN_OP_ACK:
+            while (prov_bin_next_tlv(&r, &type, &value, &value_len)) {
+                if (type == PROV_BIN_T_STATUS && value_len == 1 && value[0] == PROV_BIN_STATUS_CONNECTED) {
+                    xEventGroupSetBits(prov_ev_group, PROV_STATUS_ACK_BIT);
+                }
+            }
+            break;
+        default:
+            ESP_LOGW(TAG, "未知的二进制操作码: 0x%02x", opcode);
+            break;
     }
-    char *json_str = cJSON_PrintUnformatted(root);
-    ws_server_send((uint8_t *)json_str, strlen(json_str));
-    cJSON_free(json_str);
-    cJSON_Delete(root);
 }
 
 /**
  * @brief WebSocket 消息接收处理
+ *
+ * 文本帧为网页的 JSON 命令，交给命令表分发；二进制帧为批量配网工具的紧凑协议
+ */
+void ws_receive_handle(const uint8_t *data, int len, ws_server_frame_type_t type)
+{
+    if (type == WS_SERVER_FRAME_BINARY) {
+        handle_binary_request(data, len);
+        return;
+    }
+
+    if (prov_cmd_dispatch((const char *)data, len) == ESP_ERR_NOT_FOUND) {
+        static const char reply[] = "{\"error\":\"unknown_cmd\"}";
+        wifi_provision_send_text(reply, sizeof(reply) - 1);
+    }
+}
+
+/*
+ * 内置命令（在 Web 服务器任务中执行）
+ */
+
+/** {"cmd":"scan"}，兼容 {"scan":"start"} */
+static void cmd_scan(const wifi_provision_msg_t *msg)
+{
+    wifi_manager_scan(wifi_scan_handle);
+}
+
+/** {"cmd":"connect","ssid":"..","password":".."}，没有 password 表示开放网络 */
+static void cmd_connect(const wifi_provision_msg_t *msg)
+{
+    char ssid[33], password[65];
+    int ssid_len = wifi_provision_msg_get_string(msg, "ssid", ssid, sizeof(ssid));
+    int password_len = wifi_provision_msg_get_string(msg, "password", password, sizeof(password));
+    if (ssid_len <= 0) {
+        ESP_LOGW(TAG, "connect 命令缺少 SSID 或 SSID 过长");
+        return;
+    }
+    if (password_len < 0) {
+        if (wifi_provision_msg_has(msg, "password")) {
+            ESP_LOGW(TAG, "connect 命令密码过长");
+            return;
+        }
+        password_len = 0;
+    }
+    submit_credentials(ssid, ssid_len, password, password_len);
+}
+
+/** {"cmd":"ack","status":"connected"}，兼容 {"ack":"connected"} */
+static void cmd_ack(const wifi_provision_msg_t *msg)
+{
+    char status[16];
+    if (wifi_provision_msg_get_string(msg, "status", status, sizeof(status)) < 0 &&
+        wifi_provision_msg_get_string(msg, "ack", status, sizeof(status)) < 0) {
+        return;
+    }
+    if (strcmp(status, "connected") == 0) {
+        xEventGroupSetBits(prov_ev_group, PROV_STATUS_ACK_BIT);
+    }
+}
+
+/**
+ * {"cmd":"status"} -> {"state":"connected|connecting|disconnected","ssid":..,"ip":..,"ap_clients":n}
+ *
+ * 用 "state" 而不是 "status"，避免网页把查询结果当成配网结果处理
  */
-void ws_receive_handle(const char *data, int len)
+static void cmd_status(const wifi_provision_msg_t *msg)
 {
-    cJSON *root = cJSON_Parse(data);
-    if (!root) return;
+    static const char *const phase_names[] = {"disconnected", "connecting", "connected"};
+    wifi_provision_status_t status;
+    wifi_provision_get_status(&status);
 
-    cJSON *scan_js = cJSON_GetObjectItem(root, "scan");
-    if (scan_js && cJSON_IsString(scan_js) && strcmp(scan_js->valuestring, "start") == 0) {
-        wifi_manager_scan(wifi_scan_handle);
+    char buf[PROV_STATUS_JSON_BUF_SIZE];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf));
+    json_writer_object_begin(&w);
+    json_writer_kv_string(&w, "state", phase_names[status.phase]);
+    json_writer_kv_string(&w, "ssid", status.ssid);
+    if (status.phase == WIFI_PROVISION_PHASE_CONNECTED) {
+        char ip_str[16];
+        prov_ip_str(status.ip, ip_str, sizeof(ip_str));
+        json_writer_kv_string(&w, "ip", ip_str);
+        json_writer_kv_int(&w, "rssi", status.rssi);
     }
+    json_writer_kv_int(&w, "ap_clients", wifi_manager_get_ap_station_count());
+    json_writer_object_end(&w);
 
-    cJSON *ssid_js = cJSON_GetObjectItem(root, "ssid");
-    cJSON *pwd_js = cJSON_GetObjectItem(root, "password");
-    if (ssid_js && pwd_js && cJSON_IsString(ssid_js) && cJSON_IsString(pwd_js)) {
-        snprintf(current_ssid, sizeof(current_ssid), "%s", ssid_js->valuestring);
-        snprintf(current_password, sizeof(current_password), "%s", pwd_js->valuestring);
-        is_configuring = true;
-        xEventGroupSetBits(prov_ev_group, PROV_WIFI_CONNECTED_BIT);
+    size_t len = 0;
+    const char *json_str = json_writer_finish(&w, &len);
+    if (json_str) {
+        wifi_provision_send_text(json_str, len);
     }
+}
 
-    cJSON_Delete(root);
+/** {"cmd":"provision","blob":"<base64>"} -> {"provision":"accepted|disabled|bad_signature|replayed|malformed"} */
+static void cmd_provision(const wifi_provision_msg_t *msg)
+{
+    char blob[(PROV_BLOB_MAX_SIZE + 2) / 3 * 4 + 1];
+    int len = wifi_provision_msg_get_string(msg, "blob", blob, sizeof(blob));
+    prov_blob_creds_t creds;
+    esp_err_t ret = len > 0 ? prov_blob_parse_base64(blob, len, &creds) : ESP_ERR_INVALID_SIZE;
+    ret = blob_apply(ret, &creds);
+
+    char reply[48];
+    int n = snprintf(reply, sizeof(reply), "{\"provision\":\"%s\"}", blob_result_name(ret));
+    wifi_provision_send_text(reply, n);
 }
 
-void wifi_provision_init(wifi_provision_cb_t callback)
+/** {"cmd":"forget","ssid":".."} -> {"forget":"ssid","ok":true|false} */
+static void cmd_forget(const wifi_provision_msg_t *msg)
 {
+    char ssid[33];
+    if (wifi_provision_msg_get_string(msg, "ssid", ssid, sizeof(ssid)) <= 0) {
+        return;
+    }
+    bool ok = wifi_manager_forget_network(ssid) == ESP_OK;
+
+    char buf[96];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf));
+    json_writer_object_begin(&w);
+    json_writer_kv_string(&w, "forget", ssid);
+    json_writer_kv_bool(&w, "ok", ok);
+    json_writer_object_end(&w);
+
+    size_t len = 0;
+    const char *json_str = json_writer_finish(&w, &len);
+    if (json_str) {
+        wifi_provision_send_text(json_str, len);
+    }
+}
+
+#if CONFIG_WIFI_PROVISION_TRACE
+/** {"cmd":"timeline"} -> {"timeline":[...]} */
+static void cmd_timeline(const wifi_provision_msg_t *msg)
+{
+    report_timeline(true);
+}
+#endif
+
+#if CONFIG_WIFI_PROVISION_DIAG
+/**
+ * {"cmd":"diag"} -> {"diag":{"heap":n,"heap_min":n,"httpd_heap":n,"sessions":n,
+ *                    "mem":[{"sub","cur","peak","allocs","frees"}],"stack":{"prov_task":n,...}}}
+ */
+static void cmd_diag(const wifi_provision_msg_t *msg)
+{
+    wifi_provision_diag_t diag;
+    if (wifi_provision_get_diag(&diag) != ESP_OK) {
+        return;
+    }
+
+    char buf[PROV_DIAG_JSON_BUF_SIZE];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf));
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "diag");
+    json_writer_object_begin(&w);
+    json_writer_kv_int(&w, "heap", diag.free_heap);
+    json_writer_kv_int(&w, "heap_min", diag.min_free_heap);
+    json_writer_kv_int(&w, "internal", diag.free_internal);
+    json_writer_kv_int(&w, "internal_min", diag.min_free_internal);
+    json_writer_kv_int(&w, "httpd_heap", diag.httpd_heap);
+    json_writer_kv_int(&w, "sessions", diag.sessions);
+    json_writer_key(&w, "mem");
+    json_writer_array_begin(&w);
+    for (int i = 0; i < WIFI_PROVISION_MEM_MAX; i++) {
+        json_writer_object_begin(&w);
+        json_writer_kv_string(&w, "sub", wifi_provision_mem_subsys_name(i));
+        json_writer_kv_int(&w, "cur", diag.mem[i].current_bytes);
+        json_writer_kv_int(&w, "peak", diag.mem[i].peak_bytes);
+        json_writer_kv_int(&w, "allocs", diag.mem[i].allocs);
+        json_writer_kv_int(&w, "frees", diag.mem[i].frees);
+        json_writer_object_end(&w);
+    }
+    json_writer_array_end(&w);
+    json_writer_key(&w, "stack");
+    json_writer_object_begin(&w);
+    for (int i = 0; i < WIFI_PROVISION_TASK_MAX; i++) {
+        json_writer_kv_int(&w, wifi_provision_diag_task_name(i), diag.stack_free[i]);
+    }
+    json_writer_object_end(&w);
+    json_writer_object_end(&w);
+    json_writer_object_end(&w);
+
+    size_t len = 0;
+    const char *json_str = json_writer_finish(&w, &len);
+    if (json_str) {
+        wifi_provision_send_text(json_str, len);
+    }
+}
+#endif
+
+esp_err_t wifi_provision_send_text(const char *text, size_t len)
+{
+    return ws_server_send_async((const uint8_t *)text, len, WS_SERVER_FRAME_TEXT, 0, NULL, NULL);
+}
+
+esp_err_t wifi_provision_init(wifi_provision_cb_t callback, const wifi_provision_config_t *config)
+{
+    const wifi_provision_config_t default_config = WIFI_PROVISION_DEFAULT_CONFIG();
+    if (config == NULL) {
+        config = &default_config;
+    }
+    const wifi_manager_ap_config_t ap_config = {
+        .ssid = config->ap_ssid,
+        .password = config->ap_password,
+        .ip = config->ap_ip,
+        .channel = config->ap_channel,
+        .max_connection = config->ap_max_connection,
+    };
+    // 先校验再初始化，参数错误时不留下半初始化的状态
+    esp_err_t ret = wifi_manager_set_ap_config(&ap_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "热点参数无效");
+        return ret;
+    }
+
     user_callback = callback;
     wifi_manager_init(internal_wifi_cb);
+    wifi_manager_set_ap_sta_callback(ap_station_changed);
+    wifi_manager_set_channel_switch_callback(ap_channel_switching);
+    wifi_manager_set_link_callback(link_quality_changed);
+    wifi_manager_set_progress_callback(connect_progress);
     prov_ev_group = xEventGroupCreate();
-    xTaskCreatePinnedToCore(wifi_provision_task, "prov_task", 4096, NULL, 3, NULL, 1);
+    prov_queue = xQueueCreateStatic(PROV_MSG_QUEUE_LEN, sizeof(prov_msg_t), prov_queue_storage, &prov_queue_buf);
+
+    wifi_provision_register_command("scan", cmd_scan);
+    wifi_provision_register_command("connect", cmd_connect);
+    wifi_provision_register_command("ack", cmd_ack);
+    wifi_provision_register_command("status", cmd_status);
+    wifi_provision_register_command("forget", cmd_forget);
+    wifi_provision_register_command("provision", cmd_provision);
+#if CONFIG_WIFI_PROVISION_TRACE
+    wifi_provision_register_command("timeline", cmd_timeline);
+#endif
+#if CONFIG_WIFI_PROVISION_DIAG
+    wifi_provision_register_command("diag", cmd_diag);
+#endif
+
+    const esp_timer_create_args_t idle_timer_args = {
+        .callback = idle_check_cb,
+        .name = "prov_idle",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&idle_timer_args, &idle_timer));
+
+    TaskHandle_t prov_task = NULL;
+    xTaskCreatePinnedToCore(wifi_provision_task, "prov_task", 4096, NULL, 3, &prov_task, 1);
+    PROV_DIAG_SET_TASK(WIFI_PROVISION_TASK_PROV, prov_task);
+    return ESP_OK;
 }
 
 void wifi_provision_start_apcfg(void)
 {
     ESP_LOGI(TAG, "启动 AP 配网模式...");
+    PROV_TRACE_RESET();
+    PROV_DIAG_SESSION_RESET();
+    PROV_TRACE(WIFI_PROVISION_TRACE_APCFG_START);
     wifi_manager_ap();
+    prov_touch();
+    prov_set_apcfg_active(true);
 
-    ws_server_config_t config = {
-        .html_code = (const char *)apcfg_html_start, // 直接使用嵌入的 HTML
-        .cb = ws_receive_handle,
-    };
-    ws_server_start(&config);
+    // Web 服务器等到有手机连上热点再启动；重复进入配网时手机可能已经连着
+    if (wifi_manager_get_ap_station_count() > 0) {
+        prov_post(PROV_MSG_AP_JOIN, NULL);
+    }
+
+    if (CONFIG_WIFI_PROVISION_AP_IDLE_TIMEOUT_S > 0) {
+        esp_timer_stop(idle_timer); // 重复进入配网时重新开始计时
+        esp_timer_start_periodic(idle_timer, PROV_IDLE_CHECK_PERIOD_MS * 1000);
+    }
+}
+
+esp_err_t wifi_provision_forget_all(void)
+{
+    return wifi_manager_forget_all();
+}
+
+esp_err_t wifi_provision_subscribe(wifi_provision_event_cb_t cb, void *arg)
+{
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    int free_slot = -1;
+    taskENTER_CRITICAL(&prov_sub_lock);
+    for (int i = 0; i < WIFI_PROVISION_MAX_SUBSCRIBERS; i++) {
+        if (prov_subscribers[i].cb == cb && prov_subscribers[i].arg == arg) {
+            free_slot = -1;
+            ret = ESP_OK;
+            break;
+        }
+        if (prov_subscribers[i].cb == NULL && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot >= 0) {
+        prov_subscribers[free_slot].cb = cb;
+        prov_subscribers[free_slot].arg = arg;
+        ret = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&prov_sub_lock);
+    return ret;
+}
+
+esp_err_t wifi_provision_unsubscribe(wifi_provision_event_cb_t cb, void *arg)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    taskENTER_CRITICAL(&prov_sub_lock);
+    for (int i = 0; i < WIFI_PROVISION_MAX_SUBSCRIBERS; i++) {
+        if (prov_subscribers[i].cb == cb && prov_subscribers[i].arg == arg) {
+            prov_subscribers[i].cb = NULL;
+            prov_subscribers[i].arg = NULL;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&prov_sub_lock);
+    return ret;
+}
+
+esp_err_t wifi_provision_get_link_stats(wifi_provision_link_stats_t *out)
+{
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    wifi_link_stats_t stats;
+    esp_err_t ret = wifi_manager_get_link_stats(&stats);
+    if (ret == ESP_OK) {
+        link_stats_from_driver(out, &stats);
+    }
+    return ret;
+}
+
+void wifi_provision_get_status(wifi_provision_status_t *out)
+{
+    taskENTER_CRITICAL(&prov_state_lock);
+    *out = prov_status;
+    taskEXIT_CRITICAL(&prov_state_lock);
 }
@@ -0,0 +1,373 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+配网服务器基准测试工具 - 在电脑上运行，连接设备热点后测量 HTTP/WebSocket 性能
+
+用法（电脑先连上 ESP32_wifi 热点）：
+    python prov_bench.py [--host 192.168.100.1] [--repeat 10] [--clients 1,2,3,4]
+                         [--duration 5] [--label <固件版本>] [--out result.json]
+                         [--ssid <路由器> --password <密码>]
+
+测量项目：
+1. page       首页加载耗时（完整下载 / ETag 验证后 304）
+2. handshake  WebSocket 握手耗时（TCP 连接 + 协议升级）
+3. scan       扫描往返耗时（发送 scan 到第一批结果 / 最后一批结果）
+4. load       1~4 个并发客户端（热点 max_connection = 4）下的首页吞吐，
+              以及命令回复广播到所有 WebSocket 客户端的耗时
+5. connect    提交账号密码到收到 "connected" 的耗时（只在给出 --ssid 时测量，
+              测完设备会关闭热点，所以放在最后）
+6. diag / timeline  固件开启诊断/追踪时附带设备端的内存和时间线数据
+              （时间线每项 {"ev": 事件名, "t": 相对配网开始的毫秒数}）
+
+结果以 JSON 输出到标准输出（或 --out 指定的文件），便于按固件版本对比。
+只依赖 Python 标准库。
+"""
+
+import argparse
+import base64
+import http.client
+import json
+import os
+import socket
+import statistics
+import struct
+import sys
+import threading
+import time
+
+
+def now_ms():
+    return time.perf_counter() * 1000.0
+
+
+def summarize(samples):
+    """耗时样本统计（毫秒）"""
+    if not samples:
+        return None
+    s = sorted(samples)
+    p95 = s[min(len(s) - 1, int(round(0.95 * (len(s) - 1))))]
+    return {
+        'n': len(s),
+        'min': round(s[0], 2),
+        'median': round(statistics.median(s), 2),
+        'p95': round(p95, 2),
+        'max': round(s[-1], 2),
+    }
+
+
+class WsClient:
+    """最小 WebSocket 客户端（只支持本工具需要的文本帧）"""
+
+    def __init__(self, host, port, timeout):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b''
+        key = base64.b64encode(os.urandom(16)).decode()
+        req = ('GET /ws HTTP/1.1\r\n'
+               'Host: %s\r\n'
+               'Upgrade: websocket\r\n'
+               'Connection: Upgrade\r\n'
+               'Sec-WebSocket-Key: %s\r\n'
+               'Sec-WebSocket-Version: 13\r\n\r\n') % (host, key)
+        self.sock.sendall(req.encode())
+        while b'\r\n\r\n' not in self.buf:
+            self._fill()
+        head, self.buf = self.buf.split(b'\r\n\r\n', 1)
+        if b' 101 ' not in head.split(b'\r\n', 1)[0]:
+            raise RuntimeError('handshake rejected: %r' % head[:64])
+
+    def _fill(self):
+        chunk = self.sock.recv(4096)
+        if not chunk:
+            raise ConnectionError('connection closed')
+        self.buf += chunk
+
+    def _read(self, n):
+        while len(self.buf) < n:
+            self._fill()
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def _send_frame(self, opcode, payload):
+        mask = os.urandom(4)
+        n = len(payload)
+        if n < 126:
+            head = struct.pack('!BB', 0x80 | opcode, 0x80 | n)
+        elif n < 65536:
+            head = struct.pack('!BBH', 0x80 | opcode, 0x80 | 126, n)
+        else:
+            head = struct.pack('!BBQ', 0x80 | opcode, 0x80 | 127, n)
+        body = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(head + mask + body)
+
+    def send_json(self, obj):
+        self._send_frame(0x1, json.dumps(obj).encode())
+
+    def recv_frame(self):
+        """返回 (opcode, payload)，自动回复 ping"""
+        while True:
+            b0, b1 = self._read(2)
+            n = b1 & 0x7F
+            if n == 126:
+                n = struct.unpack('!H', self._read(2))[0]
+            elif n == 127:
+                n = struct.unpack('!Q', self._read(8))[0]
+            mask = self._read(4) if b1 & 0x80 else None
+            payload = self._read(n)
+            if mask:
+                payload = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+            opcode = b0 & 0x0F
+            if opcode == 0x9:
+                self._send_frame(0xA, payload)
+                continue
+            if opcode == 0x8:
+                raise ConnectionError('server closed websocket')
+            return opcode, payload
+
+    def recv_json(self, pred, timeout):
+        """等待第一条满足 pred 的 JSON 文本消息，超时返回 None"""
+        deadline = time.monotonic() + timeout
+        while True:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            self.sock.settimeout(left)
+            try:
+                opcode, payload = self.recv_frame()
+            except socket.timeout:
+                return None
+            if opcode != 0x1:
+                continue
+            try:
+                msg = json.loads(payload.decode('utf-8'))
+            except ValueError:
+                continue
+            if pred(msg):
+                return msg
+
+    def close(self):
+        try:
+            self._send_frame(0x8, b'')
+        except OSError:
+            pass
+        self.sock.close()
+
+
+def fetch_page(host, port, timeout, etag=None):
+    """完整获取首页，返回 (耗时ms, 状态码, 字节数, ETag)"""
+    t0 = now_ms()
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    headers = {'Accept-Encoding': 'gzip', 'Connection': 'close'}
+    if etag:
+        headers['If-None-Match'] = etag
+    conn.request('GET', '/', headers=headers)
+    resp = conn.getresponse()
+    body = resp.read()
+    elapsed = now_ms() - t0
+    conn.close()
+    return elapsed, resp.status, len(body), resp.getheader('ETag')
+
+
+def bench_page(args):
+    cold, revalidate = [], []
+    size, etag = 0, None
+    for _ in range(args.repeat):
+        ms, status, n, etag = fetch_page(args.host, args.port, args.timeout)
+        if status == 200:
+            cold.append(ms)
+            size = n
+    if etag:
+        for _ in range(args.repeat):
+            ms, status, _, _ = fetch_page(args.host, args.port, args.timeout, etag)
+            if status == 304:
+                revalidate.append(ms)
+    return {'bytes': size, 'full_ms': summarize(cold), 'etag_304_ms': summarize(revalidate)}
+
+
+def bench_handshake(args):
+    samples = []
+    for _ in range(args.repeat):
+        t0 = now_ms()
+        ws = WsClient(args.host, args.port, args.timeout)
+        samples.append(now_ms() - t0)
+        ws.close()
+        time.sleep(0.05)  # 给服务器时间执行关闭回调，避免会话表占满
+    return summarize(samples)
+
+
+def bench_scan(args):
+    ws = WsClient(args.host, args.port, args.timeout)
+    first, done = [], []
+    aps = 0
+    for _ in range(args.scan_repeat):
+        t0 = now_ms()
+        ws.send_json({'cmd': 'scan'})
+        got_first = None
+        while True:
+            msg = ws.recv_json(lambda m: 'wifi_list' in m, args.timeout)
+            if msg is None:
+                break
+            if got_first is None:
+                got_first = now_ms() - t0
+            if msg.get('done', True):
+                done.append(now_ms() - t0)
+                aps = max(aps, len(msg.get('wifi_list', [])))
+                break
+        if got_first is not None:
+            first.append(got_first)
+    ws.close()
+    # 第一次是真实扫描，之后在缓存有效期内命中缓存
+    return {
+        'first_batch_ms': summarize(first[:1]),
+        'done_ms': summarize(done[:1]),
+        'cached_ms': summarize(done[1:]),
+        'last_batch_aps': aps,
+    }
+
+
+def page_worker(args, stop_at, out):
+    while time.monotonic() < stop_at:
+        try:
+            ms, status, _, _ = fetch_page(args.host, args.port, args.timeout)
+            out.append(ms if status == 200 else None)
+        except OSError:
+            out.append(None)
+
+
+def bench_load(args):
+    results = []
+    for n in args.clients:
+        # HTTP：n 个客户端同时循环下载首页
+        per_client = [[] for _ in range(n)]
+        stop_at = time.monotonic() + args.duration
+        threads = [threading.Thread(target=page_worker, args=(args, stop_at, per_client[i])) for i in range(n)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        samples = [ms for c in per_client for ms in c if ms is not None]
+        errors = sum(1 for c in per_client for ms in c if ms is None)
+
+        # WebSocket：命令回复会广播给所有文本会话，测量送达全部 n 个客户端的耗时
+        fanout = []
+        clients = []
+        try:
+            clients = [WsClient(args.host, args.port, args.timeout) for _ in range(n)]
+            for _ in range(args.repeat):
+                t0 = now_ms()
+                arrivals = [None] * n
+
+                def wait(i):
+                    if clients[i].recv_json(lambda m: 'state' in m, args.timeout) is not None:
+                        arrivals[i] = now_ms() - t0
+
+                waiters = [threading.Thread(target=wait, args=(i,)) for i in range(n)]
+                for t in waiters:
+                    t.start()
+                clients[0].send_json({'cmd': 'status'})
+                for t in waiters:
+                    t.join()
+                if all(a is not None for a in arrivals):
+                    fanout.append(max(arrivals))
+                else:
+                    errors += 1
+        except (OSError, RuntimeError) as e:
+            sys.stderr.write('ws load with %d clients failed: %s\n' % (n, e))
+            errors += 1
+        finally:
+            for c in clients:
+                c.close()
+
+        results.append({
+            'clients': n,
+            'page_req_per_s': round(len(samples) / args.duration, 2),
+            'page_ms': summarize(samples),
+            'status_fanout_ms': summarize(fanout),
+            'errors': errors,
+        })
+        time.sleep(0.2)
+    return results
+
+
+def query(args, cmd, key):
+    """发送诊断类命令，固件未开启对应功能时返回 None"""
+    ws = WsClient(args.host, args.port, args.timeout)
+    ws.send_json({'cmd': cmd})
+    msg = ws.recv_json(lambda m: key in m or m.get('error') == 'unknown_cmd', 2.0)
+    ws.close()
+    if msg is None or key not in msg:
+        return None
+    return msg[key]
+
+
+def bench_connect(args):
+    ws = WsClient(args.host, args.port, args.timeout)
+    t0 = now_ms()
+    ws.send_json({'cmd': 'connect', 'ssid': args.ssid, 'password': args.password})
+    msg = ws.recv_json(lambda m: m.get('status') in ('connected', 'fail'), args.connect_timeout)
+    elapsed = now_ms() - t0
+    result = {'ok': False, 'ms': None}
+    if msg is not None:
+        result = {'ok': msg['status'] == 'connected', 'ms': round(elapsed, 2), 'ip': msg.get('ip')}
+        if result['ok']:
+            ws.send_json({'cmd': 'ack', 'status': 'connected'})
+            # 开启 TRACE_PUSH 时时间线紧跟在状态后面推送
+            tl = ws.recv_json(lambda m: 'timeline' in m, 1.0)
+            if tl is not None:
+                result['timeline'] = tl['timeline']
+    ws.close()
+    return result
+
+
+def parse_clients(text):
+    clients = [int(x) for x in text.split(',') if x.strip()]
+    if not clients or min(clients) < 1 or max(clients) > 4:
+        raise argparse.ArgumentTypeError('clients must be between 1 and 4')
+    return clients
+
+
+def main():
+    ap = argparse.ArgumentParser(description='WiFi provisioning server benchmark')
+    ap.add_argument('--host', default='192.168.100.1')
+    ap.add_argument('--port', type=int, default=80)
+    ap.add_argument('--repeat', type=int, default=10, help='samples per latency metric')
+    ap.add_argument('--scan-repeat', type=int, default=3, help='scan requests (first one is uncached)')
+    ap.add_argument('--clients', type=parse_clients, default=[1, 2, 3, 4], help='e.g. 1,2,4')
+    ap.add_argument('--duration', type=float, default=5.0, help='seconds per load step')
+    ap.add_argument('--timeout', type=float, default=10.0)
+    ap.add_argument('--connect-timeout', type=float, default=30.0)
+    ap.add_argument('--ssid', help='router to provision (ends the session, measured last)')
+    ap.add_argument('--password', default='')
+    ap.add_argument('--label', default='', help='firmware build id stored in the result')
+    ap.add_argument('--out', help='write JSON here instead of stdout')
+    args = ap.parse_args()
+
+    result = {
+        'label': args.label,
+        'host': args.host,
+        'time': time.strftime('%Y-%m-%dT%H:%M:%S'),
+    }
+    try:
+        result['diag_before'] = query(args, 'diag', 'diag')
+        result['page'] = bench_page(args)
+        result['handshake_ms'] = bench_handshake(args)
+        result['scan'] = bench_scan(args)
+        result['load'] = bench_load(args)
+        result['diag_after'] = query(args, 'diag', 'diag')
+        result['timeline'] = query(args, 'timeline', 'timeline')
+        if args.ssid:
+            result['connect'] = bench_connect(args)
+    except (OSError, RuntimeError) as e:
+        result['error'] = str(e)
+
+    text = json.dumps(result, indent=2, ensure_ascii=False)
+    if args.out:
+        with open(args.out, 'w', encoding='utf-8') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+    return 1 if 'error' in result else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
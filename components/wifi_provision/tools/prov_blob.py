@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+预签名配网数据生成工具 - 批量部署时一次请求完成配网
+
+格式见 src/common/prov_blob.h：
+    [version:1][ssid_len:1][ssid][pw_len:1][password][seq:4 LE][mac:16]
+mac 为 HMAC-SHA256(key, 前面所有字节) 的前16字节，key 与固件的
+CONFIG_WIFI_PROVISION_BLOB_KEY 相同。
+
+用法：
+    python prov_blob.py --key <密钥> --ssid <路由器> --password <密码> --seq <序号>
+        输出 base64，可用于 {"cmd":"provision","blob":"..."}
+    python prov_blob.py ... --post 192.168.100.1
+        直接 POST 到设备的 /provision（电脑需先连上配网热点）
+
+seq 每次更换网络时递增；设备拒绝比已接受的 seq 更小的数据。
+"""
+
+import argparse
+import base64
+import hashlib
+import hmac
+import http.client
+import struct
+import sys
+
+BLOB_VERSION = 1
+MAC_LEN = 16
+
+
+def make_blob(key, ssid, password, seq):
+    ssid_b = ssid.encode('utf-8')
+    pw_b = password.encode('utf-8')
+    if not 1 <= len(ssid_b) <= 32:
+        raise ValueError('ssid must be 1..32 bytes')
+    if len(pw_b) > 64:
+        raise ValueError('password must be at most 64 bytes')
+    body = bytes([BLOB_VERSION, len(ssid_b)]) + ssid_b + bytes([len(pw_b)]) + pw_b + struct.pack('<I', seq)
+    mac = hmac.new(key.encode('utf-8'), body, hashlib.sha256).digest()[:MAC_LEN]
+    return body + mac
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Build a signed provisioning blob')
+    ap.add_argument('--key', required=True, help='CONFIG_WIFI_PROVISION_BLOB_KEY')
+    ap.add_argument('--ssid', required=True)
+    ap.add_argument('--password', default='')
+    ap.add_argument('--seq', type=int, default=1)
+    ap.add_argument('--post', metavar='HOST', help='POST the blob to http://HOST/provision')
+    ap.add_argument('--port', type=int, default=80)
+    args = ap.parse_args()
+
+    try:
+        blob = make_blob(args.key, args.ssid, args.password, args.seq)
+    except ValueError as e:
+        sys.stderr.write('%s\n' % e)
+        return 1
+
+    if not args.post:
+        print(base64.b64encode(blob).decode())
+        return 0
+
+    conn = http.client.HTTPConnection(args.post, args.port, timeout=10)
+    conn.request('POST', '/provision', body=blob, headers={'Content-Type': 'application/octet-stream'})
+    resp = conn.getresponse()
+    print(resp.status, resp.read().decode('utf-8', 'replace'))
+    conn.close()
+    return 0 if resp.status == 202 else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+配网网页资源表生成工具 - 把网页目录打包成编译期资源表
+
+由 components/wifi_provision/CMakeLists.txt 在构建时调用：
+    python web_assets.py <网页目录> <输出.c>
+
+处理步骤：
+1. 目录中的每个文件用 web_pack.minify 精简（html/css/js），gzip 压缩
+2. 计算压缩数据的 FNV-1a 哈希作为 ETag
+3. index.html 映射为 "/"，其中对其他资源的引用（如 "/apcfg.css"）改写为
+   "/apcfg.css?v=<哈希>"，内容变化时地址随之变化
+4. 生成 web_assets.c：每个资源一个常量数组，加上 ws_server_asset_t 资源表
+
+缓存策略：
+- "/" 用 no-cache + ETag，每次打开都验证（固件升级后立即生效）
+- 其他资源地址带版本号，可以长期缓存，再次打开配网页时不用重新传输
+"""
+
+import gzip
+import os
+import sys
+
+sys.dont_write_bytecode = True  # 构建时不在源码目录留下__pycache__
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from web_pack import minify  # noqa: E402
+
+INDEX = 'index.html'
+LONG_MAX_AGE_S = 365 * 24 * 3600
+
+MIME_TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.css': 'text/css; charset=utf-8',
+    '.js': 'application/javascript; charset=utf-8',
+    '.svg': 'image/svg+xml',
+    '.png': 'image/png',
+    '.ico': 'image/x-icon',
+    '.json': 'application/json',
+}
+# 文本资源精简并gzip；png等已经压缩过的格式原样嵌入
+TEXT_TYPES = ('.html', '.css', '.js', '.svg', '.json')
+
+
+def fnv1a(data):
+    h = 0x811C9DC5
+    for b in data:
+        h ^= b
+        h = (h * 0x01000193) & 0xFFFFFFFF
+    return h
+
+
+def pack(name, raw):
+    ext = os.path.splitext(name)[1].lower()
+    if ext not in MIME_TYPES:
+        raise ValueError('%s: unknown file type' % name)
+    gz = ext in TEXT_TYPES
+    data = raw
+    if gz:
+        data = gzip.compress(minify(raw.decode('utf-8')).encode('utf-8'), compresslevel=9, mtime=0)
+    return {
+        'name': name,
+        'path': '/' if name == INDEX else '/' + name,
+        'mime': MIME_TYPES[ext],
+        'data': data,
+        'gzip': gz,
+        'hash': '%08x' % fnv1a(data),
+    }
+
+
+def c_ident(name):
+    return 'asset_' + ''.join(c if c.isalnum() else '_' for c in name)
+
+
+def emit(assets, out):
+    lines = [
+        '/* 由 tools/web_assets.py 生成，请勿手动修改 */',
+        '#include "web_assets.h"',
+        '',
+    ]
+    for a in assets:
+        lines.append('static const uint8_t %s[%d] = {' % (c_ident(a['name']), len(a['data'])))
+        data = a['data']
+        for i in range(0, len(data), 16):
+            lines.append('    ' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+        lines.append('};')
+        lines.append('')
+    lines.append('const ws_server_asset_t web_assets[] = {')
+    for a in assets:
+        max_age = 0 if a['path'] == '/' else LONG_MAX_AGE_S
+        lines.append('    {.path = "%s", .mime = "%s", .data = %s, .len = sizeof(%s),' % (
+            a['path'], a['mime'], c_ident(a['name']), c_ident(a['name'])))
+        lines.append('     .gzip = %s, .etag = "\\"%s\\"", .max_age_s = %d},' % (
+            'true' if a['gzip'] else 'false', a['hash'], max_age))
+    lines.append('};')
+    lines.append('')
+    lines.append('const size_t web_assets_count = sizeof(web_assets) / sizeof(web_assets[0]);')
+    lines.append('')
+    with open(out, 'w', encoding='utf-8') as f:
+        f.write('\n'.join(lines))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write('usage: web_assets.py <web dir> <output.c>\n')
+        return 1
+    root = sys.argv[1]
+
+    names = sorted(n for n in os.listdir(root) if os.path.isfile(os.path.join(root, n)))
+    if INDEX not in names:
+        sys.stderr.write('web_assets: %s has no %s\n' % (root, INDEX))
+        return 1
+
+    assets = []
+    for name in names:
+        if name == INDEX:
+            continue
+        with open(os.path.join(root, name), 'rb') as f:
+            assets.append(pack(name, f.read()))
+
+    # 资源内容确定后再改写首页中的引用
+    with open(os.path.join(root, INDEX), 'rb') as f:
+        index = f.read().decode('utf-8')
+    for a in assets:
+        ref = '"%s"' % a['path']
+        if ref not in index:
+            sys.stderr.write('web_assets: warning: %s is not referenced by %s\n' % (a['name'], INDEX))
+        index = index.replace(ref, '"%s?v=%s"' % (a['path'], a['hash']))
+    assets.insert(0, pack(INDEX, index.encode('utf-8')))
+
+    emit(assets, sys.argv[2])
+    total = sum(len(a['data']) for a in assets)
+    print('web_assets: %d files, %d bytes' % (len(assets), total))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
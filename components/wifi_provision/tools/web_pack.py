@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+配网网页打包工具 - 构建时压缩网页资源
+
+构建时由 web_assets.py 调用 minify() 处理网页目录中的每个文件；
+也可以单独运行，查看一个文件的压缩效果：
+    python web_pack.py <输入文件> <输出gz>
+
+处理步骤：
+1. 精简（保守策略，只删除不影响语义的内容）
+   - 删除 HTML 注释 <!-- --> 和 CSS 注释 /* */
+   - 删除每行的前导缩进和行尾空白
+   - 删除空行和整行的 // 注释
+   保留换行符，因此 JS 行尾注释和模板字符串不会被破坏
+2. gzip 压缩（mtime 固定为 0，保证相同输入得到相同输出，ETag 稳定）
+"""
+
+import gzip
+import re
+import sys
+
+
+def minify(text):
+    text = re.sub(r'<!--.*?-->', '', text, flags=re.S)
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if not line or line.startswith('//'):
+            continue
+        lines.append(line)
+    return '\n'.join(lines) + '\n'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write('usage: web_pack.py <input> <output.gz>\n')
+        return 1
+
+    with open(sys.argv[1], 'r', encoding='utf-8') as f:
+        raw = f.read()
+
+    data = minify(raw).encode('utf-8')
+    packed = gzip.compress(data, compresslevel=9, mtime=0)
+
+    with open(sys.argv[2], 'wb') as f:
+        f.write(packed)
+
+    print('web_pack: %s %d -> %d -> %d bytes (gzip)' % (sys.argv[1], len(raw.encode('utf-8')), len(data), len(packed)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -21,10 +21,13 @@
 #include "esp_log.h"
 #include "iot_button.h"
 #include "nvs.h"
+#include "esp_system.h"
 #include "nvs_flash.h"
 #include "wifi_provision.h" // WiFi 配网组件
 #include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 #include <freertos/task.h>
+#include <stdint.h>
 #include <stdio.h>
 #define TAG "MAIN"
 
@@ -36,31 +39,81 @@
  */
 #define BUTTON_GPIO_NUM GPIO_NUM_10
 
+/** 长按多久触发恢复出厂设置（毫秒），比普通长按长，避免误触 */
+#define FACTORY_RESET_PRESS_MS 5000
+
+/** 应用事件队列深度 */
+#define APP_EVENT_QUEUE_LEN 8
+
+/*============================================================================
+ *                           应用事件队列
+ *
+ * 【为什么不在回调里直接干活？】
+ * 按键回调运行在按键组件的定时器里，WiFi状态回调运行在配网组件的任务里。
+ * 开热点要切换WiFi模式、启动DHCP和Web服务器，耗时几十到几百毫秒，
+ * 在定时器里执行会卡住其他按键事件的检测。
+ *
+ * 所以回调只把事件放进队列就返回，app_main阻塞在队列上，
+ * 收到事件后在自己的任务里依次处理。
+ *============================================================================*/
+
+/**
+ * @brief 应用事件类型
+ */
+typedef enum
+{
+    APP_EVT_START_APCFG,   // 单击：进入AP配网模式
+    APP_EVT_SHOW_STATUS,   // 双击：打印当前网络状态
+    APP_EVT_FACTORY_RESET, // 长按：删除保存的网络并重启
+    APP_EVT_WIFI_STATE,    // WiFi状态变化（wifi_state有效）
+} app_event_type_t;
+
+typedef struct
+{
+    app_event_type_t type;
+    wifi_provision_state_t wifi_state;
+} app_event_t;
+
+static StaticQueue_t app_queue_buf;
+static uint8_t app_queue_storage[APP_EVENT_QUEUE_LEN * sizeof(app_event_t)];
+static QueueHandle_t app_queue = NULL;
+
+/**
+ * @brief 投递应用事件（不阻塞，可以在任意任务或定时器回调中调用）
+ */
+static void app_post(app_event_type_t type, wifi_provision_state_t wifi_state)
+{
+    app_event_t evt = {
+        .type = type,
+        .wifi_state = wifi_state,
+    };
+    if (xQueueSend(app_queue, &evt, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "应用事件队列已满，丢弃事件 %d", type);
+    }
+}
+
 /*============================================================================
  *                           按键回调函数
  *============================================================================*/
 
 /**
- * @brief 按键单击事件回调函数
+ * @brief 按键事件回调函数（单击/双击/长按共用）
  *
  * 【回调函数签名说明】
  * 所有按键事件回调函数必须遵循以下格式：
  *   void callback(void *button_handle, void *usr_data)
  *
  * @param button_handle 触发事件的按键句柄（可用于多按键共用回调时区分来源）
- * @param usr_data      用户自定义数据（注册回调时传入的最后一个参数）
+ * @param usr_data      用户自定义数据（注册回调时传入的最后一个参数），这里是要投递的 app_event_type_t
  *
  * 【调用时机】
- * 当检测到"单击"事件时，按键组件会自动调用此函数
- * 单击定义：按下 -> 松开，且按下时间 < long_press_time
+ * 按键组件在自己的定时器中检测到事件后调用此函数，
+ * 这里只投递事件，真正的处理在 app_main 中完成
  */
-static void button_single_click_cb(void *button_handle, void *usr_data)
+static void button_event_cb(void *button_handle, void *usr_data)
 {
-    ESP_LOGI(TAG, "========================================");
-    ESP_LOGI(TAG, "按键单击！启动AP配网模式...");
-    ESP_LOGI(TAG, "========================================");
-
-    wifi_provision_start_apcfg();
+    app_post((app_event_type_t)(intptr_t)usr_data, 0);
 }
 
 /*============================================================================
@@ -71,6 +124,15 @@ static void button_single_click_cb(void *button_handle, void *usr_data)
  * @brief WiFi连接状态变化回调
  */
 static void wifi_state_callback(wifi_provision_state_t state)
+{
+    app_post(APP_EVT_WIFI_STATE, state);
+}
+
+/*============================================================================
+ *                           事件处理函数（在 app_main 中执行）
+ *============================================================================*/
+
+static void app_handle_wifi_state(wifi_provision_state_t state)
 {
     switch (state)
     {
@@ -83,6 +145,77 @@ static void wifi_state_callback(wifi_provision_state_t state)
     case WIFI_PROVISION_STATE_CONNECT_FAIL:
         ESP_LOGW(TAG, "✗ WiFi连接失败，请检查密码");
         break;
+    case WIFI_PROVISION_STATE_AP_TIMEOUT:
+        ESP_LOGI(TAG, "配网热点长时间无人使用，已自动关闭，再次按键可重新进入配网");
+        break;
+    default: // 其他状态只发给 wifi_provision_subscribe 的订阅者
+        break;
+    }
+}
+
+static void app_show_status(void)
+{
+    static const char *const phase_names[] = {"未连接", "连接中", "已连接"};
+    static const char *const quality_names[] = {"未知", "好", "一般", "差"};
+
+    wifi_provision_status_t status;
+    wifi_provision_get_status(&status);
+
+    ESP_LOGI(TAG, "---------- 网络状态 ----------");
+    ESP_LOGI(TAG, "配网热点: %s", status.apcfg_active ? "开启" : "关闭");
+    ESP_LOGI(TAG, "连接状态: %s %s", phase_names[status.phase], status.ssid);
+    if (status.phase == WIFI_PROVISION_PHASE_CONNECTED)
+    {
+        const uint8_t *ip = (const uint8_t *)&status.ip; // 网络字节序，第一个字节是最高位
+        ESP_LOGI(TAG, "IP地址: %d.%d.%d.%d  信道: %d", ip[0], ip[1], ip[2], ip[3], status.channel);
+
+        wifi_provision_link_stats_t link;
+        if (wifi_provision_get_link_stats(&link) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "信号: %d dBm（平均 %d dBm，质量%s，共采样 %lu 次）", link.rssi, link.rssi_avg,
+                     quality_names[link.quality], (unsigned long)link.samples);
+        }
+    }
+    ESP_LOGI(TAG, "------------------------------");
+}
+
+static void app_factory_reset(void)
+{
+    ESP_LOGW(TAG, "========================================");
+    ESP_LOGW(TAG, "恢复出厂设置：删除保存的网络并重启");
+    ESP_LOGW(TAG, "========================================");
+
+    esp_err_t ret = wifi_provision_forget_all();
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "清除网络配置失败: %s", esp_err_to_name(ret));
+    }
+    vTaskDelay(pdMS_TO_TICKS(100)); // 等日志输出完
+    esp_restart();
+}
+
+/**
+ * @brief 处理一个应用事件
+ */
+static void app_dispatch(const app_event_t *evt)
+{
+    switch (evt->type)
+    {
+    case APP_EVT_START_APCFG:
+        ESP_LOGI(TAG, "========================================");
+        ESP_LOGI(TAG, "按键单击！启动AP配网模式...");
+        ESP_LOGI(TAG, "========================================");
+        wifi_provision_start_apcfg();
+        break;
+    case APP_EVT_SHOW_STATUS:
+        app_show_status();
+        break;
+    case APP_EVT_FACTORY_RESET:
+        app_factory_reset();
+        break;
+    case APP_EVT_WIFI_STATE:
+        app_handle_wifi_state(evt->wifi_state);
+        break;
     }
 }
 
@@ -119,10 +252,18 @@ void app_main(void)
     ESP_ERROR_CHECK(ret);
     ESP_LOGI(TAG, "NVS初始化完成");
 
+    // 事件队列要在注册任何回调之前创建
+    app_queue = xQueueCreateStatic(APP_EVENT_QUEUE_LEN, sizeof(app_event_t), app_queue_storage, &app_queue_buf);
+
     /*------------------------------------------------------------------------
      * 第二步：初始化 WiFi 配网组件
+     *
+     * 热点名称/密码/IP 不填则使用组件默认值；信道设为 AUTO，
+     * 开热点前先跟随已保存网络的信道，没有时扫描选择最空闲的信道
      *------------------------------------------------------------------------*/
-    wifi_provision_init(wifi_state_callback);
+    wifi_provision_config_t prov_config = WIFI_PROVISION_DEFAULT_CONFIG();
+    prov_config.ap_channel = WIFI_PROVISION_AP_CHANNEL_AUTO;
+    ESP_ERROR_CHECK(wifi_provision_init(wifi_state_callback, &prov_config));
     ESP_LOGI(TAG, "WiFi 配网组件初始化完成");
 
     /*------------------------------------------------------------------------
@@ -183,10 +324,14 @@ void app_main(void)
     ret = iot_button_new_gpio_device(&btn_cfg, &gpio_cfg, &btn_handle);
     if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "按钮创建失败！错误码: %s", esp_err_to_name(ret));
-        return; // 初始化失败，退出
+        // 不能返回：WiFi状态事件仍会投递到事件队列，需要下面的事件循环处理
+        ESP_LOGE(TAG, "按钮创建失败！错误码: %s，继续运行（按钮不可用）", esp_err_to_name(ret));
+        btn_handle = NULL;
+    }
+    else
+    {
+        ESP_LOGI(TAG, "按钮设备创建成功 (GPIO%d)", BUTTON_GPIO_NUM);
     }
-    ESP_LOGI(TAG, "按钮设备创建成功 (GPIO%d)", BUTTON_GPIO_NUM);
 
     /*------------------------------------------------------------------------
      * 第六步：注册按键事件回调函数
@@ -208,19 +353,38 @@ void app_main(void)
      * BUTTON_LONG_PRESS_START - 长按开始
      * BUTTON_LONG_PRESS_HOLD  - 长按保持中（周期性触发）
      * BUTTON_LONG_PRESS_UP    - 长按后松开
+     *
+     * 三个事件共用 button_event_cb，通过 usr_data 区分要投递的事件；
+     * 恢复出厂设置的长按时间单独设置为 FACTORY_RESET_PRESS_MS
      *------------------------------------------------------------------------*/
-    ret = iot_button_register_cb(btn_handle,             // 按钮句柄
-                                 BUTTON_SINGLE_CLICK,    // 监听单击事件
-                                 NULL,                   // 使用默认配置
-                                 button_single_click_cb, // 回调函数
-                                 NULL);                  // 无用户数据
-    if (ret != ESP_OK)
-    {
-        ESP_LOGE(TAG, "注册回调失败！");
-    }
-    else
+    if (btn_handle != NULL)
     {
-        ESP_LOGI(TAG, "已注册单击事件回调");
+        button_event_args_t reset_args = {
+            .long_press.press_time = FACTORY_RESET_PRESS_MS,
+        };
+        ret = iot_button_register_cb(btn_handle,                             // 按钮句柄
+                                     BUTTON_SINGLE_CLICK,                    // 监听单击事件
+                                     NULL,                                   // 使用默认配置
+                                     button_event_cb,                        // 回调函数
+                                     (void *)(intptr_t)APP_EVT_START_APCFG); // 要投递的事件
+        if (ret == ESP_OK)
+        {
+            ret = iot_button_register_cb(btn_handle, BUTTON_DOUBLE_CLICK, NULL, button_event_cb,
+                                         (void *)(intptr_t)APP_EVT_SHOW_STATUS);
+        }
+        if (ret == ESP_OK)
+        {
+            ret = iot_button_register_cb(btn_handle, BUTTON_LONG_PRESS_START, &reset_args, button_event_cb,
+                                         (void *)(intptr_t)APP_EVT_FACTORY_RESET);
+        }
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "注册回调失败！");
+        }
+        else
+        {
+            ESP_LOGI(TAG, "已注册单击/双击/长按事件回调");
+        }
     }
 
     /*------------------------------------------------------------------------
@@ -229,27 +393,27 @@ void app_main(void)
     ESP_LOGI(TAG, "====================================");
     ESP_LOGI(TAG, "系统初始化完成！");
     ESP_LOGI(TAG, "按下BOOT按钮(GPIO0)进入AP配网模式");
+    ESP_LOGI(TAG, "双击查看网络状态，长按%d秒恢复出厂设置", FACTORY_RESET_PRESS_MS / 1000);
     ESP_LOGI(TAG, "====================================");
 
     /*------------------------------------------------------------------------
-     * 主循环
+     * 事件循环
      *
      * 【为什么需要这个循环？】
      * 1. app_main是一个FreeRTOS任务，如果函数返回，任务会被删除
-     * 2. 按钮检测在后台定时器中运行，不需要主循环处理
-     * 3. 这个循环只是保持任务存活，可以在这里添加其他周期性任务
+     * 2. 按键和WiFi回调只投递事件，真正的处理都在这里依次执行
      *
-     * 【vTaskDelay的作用】
-     * - 让出CPU给其他任务运行
-     * - 降低CPU占用率
-     * - 1000ms检查一次，可以在这里添加状态监控代码
+     * 【xQueueReceive的作用】
+     * - 没有事件时任务一直阻塞，不占用CPU，也不需要定时醒来轮询
+     * - 事件按投递顺序处理，一个事件处理完才处理下一个
+     * - 以后需要周期性任务（电池电量、时间显示等）时，用定时器投递事件即可
      *------------------------------------------------------------------------*/
+    app_event_t evt;
     while (1)
     {
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 延时1秒
-        // 可以在这里添加周期性任务，如：
-        // - 检查电池电量
-        // - 更新时间显示
-        // - 检查传感器数据
+        if (xQueueReceive(app_queue, &evt, portMAX_DELAY) == pdTRUE)
+        {
+            app_dispatch(&evt);
+        }
     }
 }